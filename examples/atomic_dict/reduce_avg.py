@@ -57,6 +57,11 @@ def thread(atomic_dict, iterations):
     atomic_dict.reduce(data, my_reduce_avg)
 
 
+def thread_specialized(atomic_dict, iterations):
+    data = make_data(iterations)
+    atomic_dict.reduce_mean(data)
+
+
 def threaded_avg(threads_num, thread_target):
     atomic_dict = AtomicDict()
     data_size = size // threads_num
@@ -102,3 +107,8 @@ print("\nAveraging using cereggii.AtomicDict.reduce():")
 for count in thread_counts:
     took, average = time_and_run(threaded_avg, count, thread)
     print(f" - Took {took:.3f}s with {count} threads ({took_dict / took:.1f}x faster, {average=:.2f})")
+
+print("\nAveraging using cereggii.AtomicDict.reduce_mean():")
+for count in thread_counts:
+    took, average = time_and_run(threaded_avg, count, thread_specialized)
+    print(f" - Took {took:.3f}s with {count} threads ({took_dict / took:.1f}x faster, {average=:.2f})")
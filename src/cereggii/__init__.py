@@ -10,6 +10,7 @@ from .__about__ import __license__, __version__, __version_tuple__  # noqa: F401
 from .atomic_bool import AtomicBool  # noqa: F401
 from .atomic_dict import AtomicDict  # noqa: F401
 from .atomic_dict.atomic_cache import AtomicCache  # noqa: F401
+from .atomic_dict.atomic_counter_dict import AtomicCounterDict  # noqa: F401
 from .atomic_event import AtomicEvent  # noqa: F401
 from .atomic_int import AtomicInt64  # noqa: F401
 from .atomic_ref import AtomicRef  # noqa: F401
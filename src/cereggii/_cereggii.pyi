@@ -1,5 +1,5 @@
-from collections.abc import Callable, Iterable, Iterator
-from typing import Any, Self, SupportsComplex, SupportsFloat, SupportsInt
+from collections.abc import Buffer, Callable, Collection, Iterable, Iterator, Sequence
+from typing import Any, BinaryIO, Literal, Self, SupportsComplex, SupportsFloat, SupportsInt
 
 Number = SupportsInt | SupportsFloat | SupportsComplex
 
@@ -125,7 +125,14 @@ class AtomicDict[Key, Value]:
         objects cannot be used as keys nor values.
     """
 
-    def __init__(self, initial: dict = {}, *, min_size: int | None = None, buffer_size: int = 4):
+    def __init__(
+        self,
+        initial: dict = {},
+        *,
+        min_size: int | None = None,
+        buffer_size: int = 4,
+        layout: Literal["padded", "compact"] = "padded",
+    ):
         """
         Correctly configuring the `min_size` parameter avoids resizing the `AtomicDict`.
         Inserts that spill over this size will not fail, but may require resizing.
@@ -138,6 +145,16 @@ class AtomicDict[Key, Value]:
         :param buffer_size: The amount of entries that a thread reserves for future
             insertions. A larger value can help reducing contention, but may lead to
             increased fragmentation. Min: 1, max: 64.
+
+        :param layout: How items are laid out in memory.
+            With `"padded"`, each item takes up an entire cache line, so that
+            threads mutating different items never contend for the same line.
+            With `"compact"`, items are densely packed (32 bytes each), using
+            2-4x less memory, and making iterations faster; threads mutating
+            items that share a cache line may slow down each other.
+            Since each thread inserts into its own reserved run of entries
+            (see `buffer_size`), this is usually a good trade-off for large
+            dictionaries.
         """
     # def __contains__(self, item: Key) -> bool: ...
     def __delitem__(self, key: Key) -> None:
@@ -203,6 +220,110 @@ class AtomicDict[Key, Value]:
     # def copy(self) -> AtomicDict: ...
     # @classmethod
     # def fromkeys(cls, iterable: Iterable[Key], value=None) -> AtomicDict: ...
+    @classmethod
+    def from_items(
+        cls,
+        iterable: Iterable[tuple[Key, Value]] | dict | AtomicDict,
+        *,
+        size_hint: int | None = None,
+        min_size: int | None = None,
+        buffer_size: int = 4,
+        layout: Literal["padded", "compact"] = "padded",
+    ) -> Self:
+        """
+        Build a new `AtomicDict` from the `(key, value)` pairs in `iterable`,
+        which can also be a `dict` or another `AtomicDict`.
+
+        This is much faster than inserting the items one at a time: the
+        `AtomicDict` is built privately by the calling thread, without any
+        atomic operation, and is only made visible when complete.
+        As with `dict(iterable)`, when a key is repeated the last value is kept.
+
+        Copying from an `AtomicDict` that is concurrently mutated will see
+        some of the concurrent mutations, but not necessarily all of them.
+
+        :param size_hint: The expected number of items. When not given,
+            `len(iterable)` is used if available. A correct hint avoids
+            re-building the dictionary while loading.
+
+        The other parameters are the same as in
+        [`__init__`][cereggii._cereggii.AtomicDict.__init__].
+        """
+    @classmethod
+    def parallel_load(
+        cls,
+        partitions: Iterable[Iterable[tuple[Key, Value]] | dict],
+        *,
+        threads: int | None = None,
+        size_hint: int | None = None,
+        min_size: int | None = None,
+        buffer_size: int = 4,
+        layout: Literal["padded", "compact"] = "padded",
+    ) -> Self:
+        """
+        Build a new `AtomicDict` from several partitions of `(key, value)`
+        pairs (or `dict`s), using multiple threads.
+
+        The `AtomicDict` is sized up-front for all the partitions, so that it
+        never needs to be resized while loading. Then, the partitions are
+        inserted concurrently by `threads` workers, each taking one partition
+        at a time. The calling thread is one of the workers.
+        Each worker inserts into its own reserved entries (see `buffer_size`):
+        a larger `buffer_size` further reduces contention between workers.
+
+        If any partition raises an exception, the other workers stop at the
+        next item, and the first exception is re-raised.
+
+        This method returns when all the partitions have been inserted.
+        When keys are repeated in different partitions, which value is kept
+        is unspecified.
+
+        !!! note
+
+            Parallelism is only achieved with free-threaded Python builds.
+
+        :param threads: The number of workers. Defaults to one per partition.
+
+        :param size_hint: The expected number of items. When not given, the
+            sum of `len(partition)` is used, for the partitions where it's
+            available.
+
+        The other parameters are the same as in
+        [`__init__`][cereggii._cereggii.AtomicDict.__init__].
+        """
+    @classmethod
+    def load(
+        cls,
+        fileobj: BinaryIO,
+        *,
+        min_size: int | None = None,
+        buffer_size: int = 4,
+        layout: Literal["padded", "compact"] = "padded",
+    ) -> Self:
+        """
+        Build a new `AtomicDict` from the items written to `fileobj` by
+        [`dump`][cereggii._cereggii.AtomicDict.dump].
+
+        The items are read one page at a time, and are bulk loaded as with
+        [`from_items`][cereggii._cereggii.AtomicDict.from_items].
+        The hashes of keys of type `str`, `bytes`, `int`, `float`, and of
+        tuples and frozensets of those, are read from the file too, so that
+        they are not hashed again. If the file was written by a process with a
+        different hash function (for instance, with a different
+        `PYTHONHASHSEED`), these keys are hashed again as well.
+        Keys of any other type are always hashed again: for instance, the hash
+        of an object that uses the default `object.__hash__` depends on its
+        identity, which its unpickled copy doesn't share.
+
+        :param fileobj: A file opened in binary mode. Its `readinto` method is
+            used to read the file.
+
+        :raises ValueError: If the file was not written by `dump`.
+        :raises EOFError: If the file is truncated.
+
+        The other parameters are the same as in
+        [`__init__`][cereggii._cereggii.AtomicDict.__init__].
+        """
     def get(self, key: Key, default: Value | None = None) -> Value:
         """
         Just like Python's [`dict.get`](https://docs.python.org/3/library/stdtypes.html#dict.get):
@@ -222,24 +343,81 @@ class AtomicDict[Key, Value]:
         :param default: The value to return when the key is not found.
         :return: The value associated with `key`, or `default`.
         """
+    def update_and_get(self, key: Key, fn: Callable[[Value], Value], default: Value = NOT_FOUND) -> Value:
+        """
+        Atomically update the value associated with `key` by applying `fn`
+        and return the updated value.
+
+        When `key` is not found, `fn(default)` is inserted.
+
+        !!! warning
+
+            The `fn` function must be **stateless**: it will be called at least
+            once but there is no upper bound to the number of times it will be
+            called within one invocation of this method.
+
+        :param key: The key of the value to update.
+        :param fn: A function that takes the current value and returns the new one.
+        :param default: The value passed to `fn` when `key` is not found.
+        :raises KeyError: If `key` is not found and `default` is not given.
+        """
+    def get_and_update(self, key: Key, fn: Callable[[Value], Value], default: Value = NOT_FOUND) -> Value:
+        """
+        Like [`update_and_get`][cereggii._cereggii.AtomicDict.update_and_get], but returns the
+        value that was associated with `key` before applying this operation,
+        or `default` if `key` was not found.
+        """
     # def items(self) -> Iterable[Key, Value]: ...
     # def keys(self) -> Iterable[Key]: ...
-    # def pop(self, key: Key, default: Value = None) -> Value: ...
+    def pop(self, key: Key, default: Value = ...) -> Value:
+        """
+        Just like Python's [`dict.pop`](https://docs.python.org/3/library/stdtypes.html#dict.pop):
+        remove `key` and return its value.
+
+        The key is looked up and removed in a single probe of the index.
+
+        :param key: The key to be removed.
+        :param default: The value to return when the key is not found.
+        :raises KeyError: If `key` is not found and `default` is not given.
+        """
     # def popitem(self) -> Value: ...
-    # def setdefault(self) -> None: ...
-    # def update(self, other: dict, **kwargs) -> None:  # batch
-    #     """See ``help(dict.update)``.
-    #
-    #     The only difference with the built-in update method is that ``other`` cannot
-    #     be used as a key when calling in the ``**kwargs`` style, as for
-    #     :method:`__init__`, because of the limitations of the ``**kwargs`` behavior.
-    #
-    #     Note that this is also batched, like :method:`batch_lookup`, in the sense
-    #     that ``other`` will be inserted into the dictionary in whole inside the C
-    #     extension code, before returning to the Python interpreter.
-    #
-    #     :returns: None
-    #     """
+    def setdefault(self, key: Key, default: Value | None = None) -> Value:
+        """
+        Just like Python's [`dict.setdefault`](https://docs.python.org/3/library/stdtypes.html#dict.setdefault):
+        insert `default` for `key`, unless `key` is already present.
+
+        The insertion is atomic: when multiple threads call `setdefault` for
+        the same key, they all get back the same value.
+        Unlike a [`compare_and_set`][cereggii._cereggii.AtomicDict.compare_and_set]
+        with `expected=NOT_FOUND` followed by a [`get`][cereggii._cereggii.AtomicDict.get],
+        this only probes the index once.
+
+        :return: The value associated with `key`.
+        """
+    def get_or_insert(self, key: Key, factory: Callable[[], Value]) -> Value:
+        """
+        Like [`setdefault`][cereggii._cereggii.AtomicDict.setdefault],
+        but the value to insert is created by calling `factory()`, only
+        when `key` is not found.
+
+        !!! note
+
+            If another thread inserts `key` concurrently, `factory` may have
+            been called, and its result is discarded.
+            `factory` is called without any internal lock held, so it can
+            access this same `AtomicDict`.
+
+        :return: The value associated with `key`.
+        """
+    def update(self, other: dict | Iterable[tuple[Key, Value]] | AtomicDict = (), /, **kwargs: Value) -> None:
+        """
+        Just like Python's [`dict.update`](https://docs.python.org/3/library/stdtypes.html#dict.update).
+
+        Items are inserted in batches, like with
+        [`batch_setitem`][cereggii._cereggii.AtomicDict.batch_setitem].
+        The update is not atomic: concurrent readers may see some of the
+        items of `other` before others.
+        """
     # def update_by(self, fn: Callable[[Key, Value, Cancel], Value]) -> None:
     #     """Update all values by function result.
     #
@@ -351,7 +529,62 @@ class AtomicDict[Key, Value]:
             return a fairly good approximation.
         """
 
-    def fast_iter(self, partitions=1, this_partition=0) -> Iterator[tuple[Key, Value]]:
+    def compact(self) -> None:
+        """
+        Shrink this `AtomicDict` to fit the items it currently holds.
+
+        Deleted items leave behind tombstones in the index and unused slots in the
+        entries storage. This method migrates the live items into a new, densely
+        packed storage, sized for the current number of items, but never smaller
+        than the `min_size` given at initialization.
+
+        Other threads can keep reading and writing while the compaction takes
+        place: writers help with, or wait for, the migration, as they do when the
+        dictionary grows.
+
+        !!! note
+
+            An `AtomicDict` also shrinks automatically when deletions make it
+            sparse enough. Calling this method explicitly is only useful after
+            a large number of deletions, to reclaim memory right away.
+        """
+
+    def keys(self) -> Collection[Key]:
+        """
+        A view of the keys in this `AtomicDict`.
+
+        The view holds no copy of the keys: iterating over it scans this
+        `AtomicDict`, like [`fast_iter`][cereggii._cereggii.AtomicDict.fast_iter],
+        and the same caveats about concurrent mutations apply.
+        `key in d.keys()` is a lookup, and `len(d.keys())` is
+        [`approx_len`][cereggii._cereggii.AtomicDict.approx_len].
+
+        ```python
+        for key in d.keys():
+            ...
+        ```
+        """
+
+    def values(self) -> Collection[Value]:
+        """
+        A view of the values in this `AtomicDict`, see
+        [`keys`][cereggii._cereggii.AtomicDict.keys].
+
+        As with Python's `dict`, `value in d.values()` scans this `AtomicDict`.
+        """
+
+    def items(self) -> Collection[tuple[Key, Value]]:
+        """
+        A view of the `(key, value)` pairs in this `AtomicDict`, see
+        [`keys`][cereggii._cereggii.AtomicDict.keys].
+
+        `(key, value) in d.items()` looks up `key`, and compares its value
+        with `value`.
+        """
+
+    def fast_iter(
+        self, partitions=1, this_partition=0, *, batched: bool = False
+    ) -> Iterator[tuple[Key, Value]] | Iterator[tuple[list[Key], list[Value]]]:
         """
         A fast, not sequentially consistent iterator.
 
@@ -411,12 +644,138 @@ class AtomicDict[Key, Value]:
             iteration.
         :param this_partition: This thread's assigned partition.
             Valid values are from 0 to `partitions`-1.
+        :param batched: Instead of one `(key, value)` tuple per item, yield a
+            `(keys, values)` pair of lists per page, holding up to 128 items.
+            Pages without items are skipped. This saves much of the per-item
+            overhead when scanning the whole dictionary:
+
+            ```python
+            for keys, values in d.fast_iter(batched=True):
+                writer.writerows(zip(keys, values))
+            ```
         :raises ConcurrentUsageDetected: This method is not safe to call when
-            multiple threads are mutating this `AtomicDict()`. When concurrent
+            multiple threads are mutating this `AtomicDict()`, use
+            [`snapshot`][cereggii._cereggii.AtomicDict.snapshot] instead. When concurrent
             mutations are detected, this exception is raised. *Note that it's
             not always possible to detect concurrent usage.*
         """
 
+    def iter_partitions(
+        self, n: int, *, batched: bool = False
+    ) -> list[Iterator[tuple[Key, Value]]] | list[Iterator[tuple[list[Key], list[Value]]]]:
+        """
+        Split this `AtomicDict` into `n` partitions, and return an iterator for
+        each of them, ready to be handed to `n` threads.
+
+        Differently from [`fast_iter`][cereggii._cereggii.AtomicDict.fast_iter]
+        with `partitions=n`, each partition is a contiguous range of pages,
+        chosen so that all partitions hold about the same number of items:
+        a partition does not finish early because its pages happen to be
+        mostly empty, e.g. after many deletions.
+
+        The returned iterators behave like `fast_iter`: the same caveats about
+        concurrent mutations apply.
+
+        !!! example
+
+            ```python
+            with ThreadPoolExecutor(n) as pool:
+                partials = pool.map(lambda it: sum(v for _, v in it), d.iter_partitions(n))
+            print(sum(partials))
+            ```
+
+        :param n: The number of partitions.
+        :param batched: Yield a `(keys, values)` pair of lists per page, see
+            [`fast_iter`][cereggii._cereggii.AtomicDict.fast_iter].
+        """
+
+    def parallel_for_each(self, fn: Callable[[Key, Value], Any], threads: int) -> None:
+        """
+        Call `fn(key, value)` for each item in this `AtomicDict`, using `threads`
+        threads, including the calling one.
+
+        The pages of this `AtomicDict` are split into many small ranges, which
+        the threads take one at a time: a thread that is done with its range
+        takes the next one available, so the work stays balanced whatever the
+        distribution of the items.
+
+        `fn` is called concurrently by different threads, and in no particular
+        order. If `fn` raises an exception, the remaining ranges are skipped,
+        and the first exception raised is propagated to the caller.
+
+        Items are read like in [`fast_iter`][cereggii._cereggii.AtomicDict.fast_iter]:
+        the same caveats about concurrent mutations apply.
+
+        :param fn: The function to call with each key and value.
+        :param threads: The number of threads to use.
+        """
+
+    def snapshot(self) -> dict[Key, Value]:
+        """
+        Copy the items of this `AtomicDict` into a new `dict`, as they were at a
+        single point in time.
+
+        Differently from [`fast_iter`][cereggii._cereggii.AtomicDict.fast_iter],
+        this method is safe to call while other threads are mutating this
+        `AtomicDict`, and it never returns the same key twice.
+
+        The items are first read without blocking other threads. If some thread
+        performed a write operation in the meantime, the items are read again.
+        After a few failed attempts, writers are paused while the items are
+        read one last time.
+        Each attempt only waits for the write operations already in progress to
+        complete: writers are otherwise not delayed.
+
+        !!! example
+
+            **Periodic checkpoints**
+
+            ```python
+            while True:
+                time.sleep(60)
+                checkpoint = d.snapshot()
+                with open("checkpoint.pickle", "wb") as f:
+                    pickle.dump(checkpoint, f)
+            ```
+
+        !!! note
+
+            When other threads write to this `AtomicDict` very frequently, an
+            optimistic attempt is likely to fail. The items are read again, so
+            a call can take several times as long as a `fast_iter` scan.
+        """
+
+    def dump(self, fileobj: BinaryIO) -> None:
+        """
+        Write the items of this `AtomicDict` to `fileobj`, so that they can be
+        read back with [`load`][cereggii._cereggii.AtomicDict.load].
+
+        The items are written one page at a time, without first copying them
+        into a `dict`. The keys and values of each page are pickled with
+        protocol 5, and their out-of-band buffers (for instance, of NumPy
+        arrays) are written to the file as they are. The hashes of the keys
+        are written alongside them.
+
+        As with [`fast_iter`][cereggii._cereggii.AtomicDict.fast_iter], this
+        method doesn't block other threads: the mutations that happen
+        concurrently may or may not be written. For a consistent checkpoint,
+        dump an `AtomicDict` built from a
+        [`snapshot`][cereggii._cereggii.AtomicDict.snapshot].
+
+        !!! example
+
+            ```python
+            with open("checkpoint.bin", "wb") as f:
+                d.dump(f)
+
+            with open("checkpoint.bin", "rb") as f:
+                d = AtomicDict.load(f)
+            ```
+
+        :param fileobj: A file opened in binary mode. Its `write` method is
+            used to write the file.
+        """
+
     def batch_getitem(self, batch: dict, chunk_size: int = 128) -> dict:
         """Batch many lookups together for efficient memory access.
 
@@ -460,10 +819,78 @@ class AtomicDict[Key, Value]:
         :returns: the input `batch` dictionary, with substituted values.
         """
 
+    def get_many(self, keys: Sequence[Key], default: Value = NOT_FOUND, chunk_size: int = 128) -> list[Value]:
+        """Batch many lookups together for efficient memory access.
+
+        Like [`batch_getitem`][cereggii._cereggii.AtomicDict.batch_getitem], but
+        takes a sequence of keys (e.g. a `list` or a `tuple`), and returns
+        a new `list` with the value of each key, in the same order, or
+        `default` for the keys that were not found.
+
+        !!! example
+
+            ```python
+            foo = AtomicDict({'a': 1, 'b': 2, 'c': 3})
+            foo.get_many(['a', 'f', 'b'])  # [1, <cereggii.NOT_FOUND>, 2]
+            foo.get_many(['a', 'f', 'b'], default=None)  # [1, None, 2]
+            ```
+
+        :param chunk_size: subdivide `keys` in smaller chunks of size `chunk_size` to prevent
+        memory over-prefetching.
+        """
+
+    def batch_setitem(self, batch: dict | Iterable[tuple[Key, Value]] | AtomicDict, chunk_size: int = 128) -> None:
+        """Batch many insertions together for efficient memory access.
+
+        Equivalent to calling `self[key] = value` for each item in `batch`,
+        which is either a mapping or an iterable of `(key, value)` pairs.
+
+        The items are processed in chunks: the memory locations that the keys
+        of a chunk will access are prefetched before inserting them, and
+        a possibly pending resize is checked for once per chunk, instead of
+        once per key.
+
+        If an exception is raised, the items that came before the offending
+        one have been inserted.
+
+        :param chunk_size: subdivide the items in `batch` in smaller chunks of size `chunk_size` to prevent
+        memory over-prefetching.
+        """
+
+    def batch_delitem(self, keys: Iterable[Key], chunk_size: int = 128) -> int:
+        """Batch many deletions together for efficient memory access.
+
+        Equivalent to calling `del self[key]` for each key in `keys`, except
+        that keys which are not present are ignored.
+
+        The keys are processed in chunks, like in
+        [`batch_setitem`][cereggii._cereggii.AtomicDict.batch_setitem].
+
+        :param chunk_size: subdivide `keys` in smaller chunks of size `chunk_size` to prevent
+        memory over-prefetching.
+        :returns: the number of keys that were deleted.
+        """
+
+    def pop_many(self, keys: Iterable[Key], default: Value = NOT_FOUND, chunk_size: int = 128) -> list[Value]:
+        """Like [`batch_delitem`][cereggii._cereggii.AtomicDict.batch_delitem],
+        but returns the values of the deleted keys, in the same order as `keys`,
+        or `default` for the keys that were not present.
+
+        :param chunk_size: subdivide `keys` in smaller chunks of size `chunk_size` to prevent
+        memory over-prefetching.
+        """
+
     def reduce(
         self,
-        iterable: Iterable[tuple[Key, Value]],
-        aggregate: Callable[[Key, Value, Value], Value],
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        aggregate: Callable[[Key, Value, Value], Value] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -482,6 +909,10 @@ class AtomicDict[Key, Value]:
         - [`reduce_min`][cereggii._cereggii.AtomicDict.reduce_min]
         - [`reduce_list`][cereggii._cereggii.AtomicDict.reduce_list]
         - [`reduce_count`][cereggii._cereggii.AtomicDict.reduce_count]
+        - [`reduce_mean`][cereggii._cereggii.AtomicDict.reduce_mean]
+        - [`reduce_topk`][cereggii._cereggii.AtomicDict.reduce_topk]
+        - [`reduce_set`][cereggii._cereggii.AtomicDict.reduce_set]
+        - [`reduce_hll`][cereggii._cereggii.AtomicDict.reduce_hll]
 
         !!! note
 
@@ -519,11 +950,78 @@ class AtomicDict[Key, Value]:
 
             First, an intermediate result is aggregated into a thread-local dictionary and then applied to the shared
             `AtomicDict`. This can greatly reduce contention when the keys in the input are repeated.
+
+        !!! info "Parallel reduce"
+
+            When `threads` is given, `iterable` must be a sequence of chunks,
+            each of which is an iterable of key-value pairs. The chunks are
+            reduced concurrently by up to `threads` workers, including the
+            calling thread: each chunk is aggregated into its own thread-local
+            dictionary, which is then applied to this `AtomicDict`.
+
+            ```python
+            d.reduce([chunk_0, chunk_1, chunk_2], count, threads=3)
+            ```
+
+            The first exception raised by any worker is re-raised.
+            Parallelism is only achieved with free-threaded Python builds.
+
+        !!! info "Column-oriented reduce"
+
+            Instead of `iterable`, two sequences of the same length can be given
+            with `keys` and `values`: the `i`-th key is aggregated with the
+            `i`-th value. No tuple needs to be created for each pair, as with
+            `zip(keys, values)`.
+
+            ```python
+            d.reduce(keys=["red", "green", "red"], values=[1, 42, 5], aggregate=count)
+            ```
+
+            With `threads`, the sequences are split into contiguous ranges, which
+            are reduced concurrently.
+
+        !!! info "Streaming reduce"
+
+            By default, the thread-local dictionary holds every distinct key found
+            in `iterable`, and nothing is applied to this `AtomicDict` until
+            `iterable` is exhausted.
+            When `iterable` is a long-running stream, `max_buffered_keys` and
+            `flush_interval` bound the thread-local dictionary: it is applied to
+            this `AtomicDict` and emptied whenever it holds `max_buffered_keys`
+            keys, or `flush_interval` seconds have elapsed since it was last
+            applied. This bounds memory usage and makes partial results visible
+            while `iterable` is still being consumed.
+
+            ```python
+            d.reduce(consumer, count, max_buffered_keys=10_000, flush_interval=1.0)
+            ```
+
+            These bounds are checked each time an item is taken from `iterable`:
+            no flush happens while waiting for the next item.
+            Smaller bounds mean more contention on this `AtomicDict`.
+
+        !!! tip "Sizing the thread-local dictionary"
+
+            The thread-local dictionary grows as new keys are found. Its growth is
+            incremental, so that no single item pays for moving every key already
+            buffered, but it still costs some time and allocations.
+            When the number of distinct keys in `iterable` is roughly known, pass
+            it as `size_hint`, and the thread-local dictionary is allocated for
+            that many keys up front. With `max_buffered_keys`, it is never
+            allocated for more than `max_buffered_keys` keys.
+            With `threads`, each thread allocates its own.
         """
 
     def reduce_sum(
         self,
-        iterable: Iterable[tuple[Key, Value]],
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -554,11 +1052,30 @@ class AtomicDict[Key, Value]:
 
             The implementation of this operation is internally optimized. It is recommended to use this method
             instead of calling `reduce` with a custom function.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
         """
 
     def reduce_and(
         self,
-        iterable: Iterable[tuple[Key, Value]],
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -589,11 +1106,30 @@ class AtomicDict[Key, Value]:
 
             The implementation of this operation is internally optimized. It is recommended to use this method
             instead of calling `reduce` with a custom function.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
         """
 
     def reduce_or(
         self,
-        iterable: Iterable[tuple[Key, Value]],
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -624,11 +1160,30 @@ class AtomicDict[Key, Value]:
 
             The implementation of this operation is internally optimized. It is recommended to use this method
             instead of calling `reduce` with a custom function.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
         """
 
     def reduce_max(
         self,
-        iterable: Iterable[tuple[Key, Value]],
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -659,11 +1214,30 @@ class AtomicDict[Key, Value]:
 
             The implementation of this operation is internally optimized. It is recommended to use this method
             instead of calling `reduce` with a custom function.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
         """
 
     def reduce_min(
         self,
-        iterable: Iterable[tuple[Key, Value]],
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -694,11 +1268,30 @@ class AtomicDict[Key, Value]:
 
             The implementation of this operation is internally optimized. It is recommended to use this method
             instead of calling `reduce` with a custom function.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
         """
 
     def reduce_list(
         self,
-        iterable: Iterable[tuple[Key, Value]],
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -739,11 +1332,29 @@ class AtomicDict[Key, Value]:
 
             The implementation of this operation is internally optimized. It is recommended to use this method
             instead of calling `reduce` with a custom function.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
         """
 
     def reduce_count(
         self,
-        iterable: Iterable[Key] | dict[Any, int],
+        iterable: Iterable[Key] | dict[Any, int] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
     ) -> None:
         """
         Aggregate the values in this dictionary with those found in `iterable`,
@@ -795,6 +1406,320 @@ class AtomicDict[Key, Value]:
 
             The implementation of this operation is internally optimized. It is recommended to use this method
             instead of calling `reduce` with a custom function.
+
+        :param keys: A sequence of keys, used instead of `iterable`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        """
+
+    def reduce_mean(
+        self,
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
+    ) -> None:
+        """
+        Aggregate the values in this dictionary with those found in `iterable`,
+        keeping the running total and count of the values of each key.
+
+        The value stored for each key is a `(total, count)` tuple, from which the
+        mean can be computed:
+
+        ```python
+        d.reduce_mean([("spam", 1), ("spam", 2), ("eggs", 3), ("spam", 3)])
+        total, count = d["spam"]
+        assert (total, count) == (6, 3)
+        assert total / count == 2
+        ```
+
+        Behaves exactly as if [`reduce`][cereggii._cereggii.AtomicDict.reduce] had been called like this:
+
+        ```python
+        def to_mean(value):
+            if type(value) is tuple and len(value) == 2:
+                return value
+            return value, 1
+
+        def mean_fn(key, current, new):
+            new = to_mean(new)
+            if current is cereggii.NOT_FOUND:
+                return new
+            current = to_mean(current)
+            return current[0] + new[0], current[1] + new[1]
+
+        d.reduce(..., mean_fn)
+        ```
+
+        !!! warning
+
+            Any value that is exactly a `tuple` of two items is interpreted as a
+            `(total, count)` pair, both in `iterable` and in this dictionary:
+            the values to be averaged must not be 2-tuples. This allows
+            merging pairs computed elsewhere, e.g. `d.reduce_mean([("spam", (10, 2))])`.
+            Any other value, including one already stored in this dictionary,
+            counts as a single value.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        """
+
+    def reduce_topk(
+        self,
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        k: int | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
+    ) -> None:
+        """
+        Aggregate the values in this dictionary with those found in `iterable`,
+        keeping the `k` largest values of each key.
+
+        The value stored for each key is a list of at most `k` values, in
+        descending order. Equal values are kept in the order they were found.
+
+        ```python
+        d.reduce_topk([("spam", 1), ("spam", 5), ("spam", 3), ("spam", 2)], k=3)
+        assert d["spam"] == [5, 3, 2]
+        ```
+
+        !!! note
+
+            Similarly to [`reduce_list`][cereggii._cereggii.AtomicDict.reduce_list],
+            a value that is a list is interpreted as a collection of values.
+
+        !!! warning
+
+            The list stored in the dictionary should not be modified. A new list is
+            stored whenever it changes.
+
+        :param k: The maximum number of values to keep for each key.
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        """
+
+    def reduce_set(
+        self,
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
+    ) -> None:
+        """
+        Aggregate the values in this dictionary with those found in `iterable`,
+        keeping the set of distinct values of each key.
+
+        ```python
+        d.reduce_set([("spam", 1), ("spam", 2), ("spam", 1)])
+        assert d["spam"] == {1, 2}
+        ```
+
+        The values must be hashable. A value that is a `set` is interpreted as a
+        collection of values.
+
+        !!! warning
+
+            The set stored in the dictionary should not be modified. A new set is
+            stored whenever it changes.
+
+        !!! tip
+
+            To approximately count the distinct values of each key using a small
+            and constant amount of memory, see
+            [`reduce_hll`][cereggii._cereggii.AtomicDict.reduce_hll].
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        """
+
+    def reduce_hll(
+        self,
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        precision: int = 12,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
+    ) -> None:
+        """
+        Aggregate the values in this dictionary with those found in `iterable`,
+        keeping a [HyperLogLog](https://en.wikipedia.org/wiki/HyperLogLog) sketch
+        of the distinct values of each key.
+
+        The value stored for each key is a `bytearray` of `2 ** precision`
+        registers. The approximate number of distinct values is computed with
+        [`hll_estimate`][cereggii._cereggii.AtomicDict.hll_estimate]:
+
+        ```python
+        d.reduce_hll(("spam", _) for _ in range(100_000))
+        assert abs(AtomicDict.hll_estimate(d["spam"]) - 100_000) < 5_000
+        ```
+
+        The relative standard error of the estimate is about `1.04 / sqrt(2 ** precision)`,
+        i.e. 1.6% with the default precision.
+
+        !!! warning
+
+            The values are hashed with Python's `hash()`, and `str` and `bytes`
+            hashes are randomized for each Python process: sketches of such values
+            cannot be merged across processes.
+            The sketch stored in the dictionary should not be modified.
+
+        :param precision: Between 4 and 16: a higher precision uses more memory
+            and gives a more accurate estimate.
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        """
+
+    @staticmethod
+    def hll_estimate(sketch: bytearray) -> float:
+        """
+        Estimate the number of distinct values in a sketch computed by
+        [`reduce_hll`][cereggii._cereggii.AtomicDict.reduce_hll].
+        """
+
+    def reduce_batched(
+        self,
+        iterable: Iterable[tuple[Key, Value]] | None = None,
+        aggregate_many: Callable[[Key, Value, list[Value]], Value] | None = None,
+        *,
+        keys: Sequence[Key] | None = None,
+        values: Sequence[Value] | None = None,
+        threads: int | None = None,
+        max_buffered_keys: int | None = None,
+        flush_interval: float | None = None,
+        size_hint: int | None = None,
+    ) -> None:
+        """
+        Like [`reduce`][cereggii._cereggii.AtomicDict.reduce], but instead of
+        calling `aggregate` once for each item in `iterable`, the values of the
+        same key are first collected into a list, and `aggregate_many` is called
+        with the key, the value currently stored in the dictionary, and the list
+        of all the new values of that key.
+
+        This greatly reduces the number of calls to a Python function when the
+        keys in the input are repeated.
+
+        !!! example
+            **Top 3**
+
+            ```python
+            def top_3(key, current, values):
+                if current is cereggii.NOT_FOUND:
+                    current = ()
+                return tuple(sorted([*current, *values], reverse=True)[:3])
+
+            d.reduce_batched([("spam", 1), ("spam", 5), ("spam", 3), ("spam", 2)], top_3)
+            assert d["spam"] == (5, 3, 2)
+            ```
+
+        !!! note
+
+            `aggregate_many` is called at least once for each distinct key in
+            `iterable`: it is called again with the same values if the value in
+            the dictionary was concurrently changed. It should be state-less.
+            Each call receives a new list, which `aggregate_many` may modify.
+
+            When the thread-local dictionary is flushed early, because of
+            `max_buffered_keys` or `flush_interval`, `aggregate_many` may be
+            called more than once for the same key, each time with a part of
+            its values.
+
+        :param keys: Used together with `values` instead of `iterable`, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param values: The values corresponding to `keys`.
+        :param threads: Reduce a sequence of chunks concurrently, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param max_buffered_keys: Flush the thread-local dictionary whenever it holds
+            this many keys, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param flush_interval: Flush the thread-local dictionary whenever this many
+            seconds have elapsed, see [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        :param size_hint: The expected number of distinct keys, see
+            [`reduce`][cereggii._cereggii.AtomicDict.reduce].
+        """
+
+    def reduce_sum_buffer(self, keys: Buffer, values: Buffer) -> None:
+        """
+        Like [`reduce_sum`][cereggii._cereggii.AtomicDict.reduce_sum] called with
+        `keys=` and `values=`, for keys and values that are 64-bit signed integers
+        stored in two contiguous buffers of the same length, like `array.array("q")`
+        or a NumPy `int64` array.
+
+        ```python
+        keys = array.array("q", [1, 2, 1])
+        values = array.array("q", [10, 20, 30])
+        d.reduce_sum_buffer(keys, values)
+        assert d[1] == 40
+        assert d[2] == 20
+        ```
+
+        !!! tip
+
+            The sums are computed directly on the raw integers, without the GIL,
+            and a Python `int` is created only once for each distinct key and for
+            its sum. The result is exact even if a sum does not fit in 64 bits.
+
+        :raises TypeError: If `keys` or `values` is not a 1-dimensional contiguous
+            buffer of 64-bit signed integers.
+        :raises ValueError: If `keys` and `values` have different lengths.
         """
 
     def get_handle(self) -> ThreadHandle[Self]:
@@ -966,6 +1891,23 @@ class AtomicInt64(int):
         value that was stored before applying this operation.
         """
 
+    def fetch_add(self, /, amount: int = 1) -> int:
+        """
+        Atomically add `amount` to this `AtomicInt64` and return the value that
+        was stored before, with a single hardware fetch-and-add instruction.
+
+        Unlike [`get_and_increment`][cereggii._cereggii.AtomicInt64.get_and_increment],
+        this never retries when other threads concurrently change this
+        `AtomicInt64`.
+
+        !!! warning
+
+            The result is not checked for overflow: it wraps around, as
+            64-bit signed integers do in C.
+
+        :raises OverflowError: If `amount` doesn't fit in 64 bits.
+        """
+
     def decrement_and_get(self, /, amount: int = 1) -> int:
         """
         Atomically decrement this `AtomicInt64` by `amount` and return the
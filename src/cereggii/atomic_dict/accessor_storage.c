@@ -190,6 +190,17 @@ accessor_tombstones_inc(AtomicDict *Py_UNUSED(self), AtomicDictAccessorStorage *
     atomic_store_explicit((_Atomic (int64_t) *) &storage->local_tombstones, new, memory_order_release);
 }
 
+void
+accessor_writes_inc(AtomicDictAccessorStorage *storage)
+{
+    // only the owner thread writes this counter, while holding self_mutex
+    const int64_t current = atomic_load_explicit((_Atomic (int64_t) *) &storage->local_writes, memory_order_relaxed);
+    atomic_store_explicit((_Atomic (int64_t) *) &storage->local_writes, current + 1, memory_order_relaxed);
+    // order the increment before the stores of the write operation that follows:
+    // a reader that sees any of them also sees the increment
+    atomic_thread_fence(memory_order_release);
+}
+
 int
 lock_accessor_storage_or_help_resize(AtomicDict *self, AtomicDictAccessorStorage *storage, AtomicDictMeta *meta)
 {
@@ -201,5 +212,6 @@ lock_accessor_storage_or_help_resize(AtomicDict *self, AtomicDictAccessorStorage
         }
         PyMutex_Lock(&storage->self_mutex);
     }
+    accessor_writes_inc(storage);
     return maybe_help_resize(self, meta, &storage->self_mutex);
 }
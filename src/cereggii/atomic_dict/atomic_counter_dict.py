@@ -0,0 +1,195 @@
+from __future__ import annotations
+
+from collections import Counter
+from collections.abc import Iterable, Iterator
+from typing import Any, Generic, TypeVar
+
+from . import AtomicDict
+from ..atomic_int import AtomicInt64
+from ..constants import NOT_FOUND
+
+
+K = TypeVar("K")
+
+# Deleting a key sets its cell to _DEAD. An increment that reaches the cell
+# afterwards sees it in the value returned by fetch_add, takes its amount
+# back, and retries on the live key. Counters and amounts are kept within
+# [-_LIMIT, _LIMIT), so that they can't be mistaken for a deleted cell.
+_LIMIT = 2**62
+_DEAD = -(2**63)
+
+
+def _is_live(value: int) -> bool:
+    return -_LIMIT <= value < _LIMIT
+
+
+def _check_range(value: int):
+    if not _is_live(value):
+        raise OverflowError(f"counter value out of range [-2**62, 2**62): {value}")
+
+
+class AtomicCounterDict(Generic[K]):
+    """
+    Thread-safe mapping of keys to 64-bit integer counters, based on
+    [AtomicDict][cereggii._cereggii.AtomicDict].
+
+    Each value is kept in an [`AtomicInt64`][cereggii._cereggii.AtomicInt64]
+    cell, which is created once per key. Incrementing a key that is already
+    present is a single hardware fetch-and-add on its cell, which never
+    retries under contention: there is no need to allocate a new `int` and
+    to compare-and-set it into the dictionary, as with
+    [`AtomicDict.reduce_sum`][cereggii._cereggii.AtomicDict.reduce_sum].
+
+    An increment that is concurrent with the deletion of the same key is
+    never lost: it is either counted in the deleted value, or applied to the
+    key after its deletion.
+
+    Counters must stay within `[-2**62, 2**62)`.
+
+    !!! example
+
+        ```python
+        from cereggii import AtomicCounterDict
+
+        counts = AtomicCounterDict()
+        counts.increment("spam")
+        counts.increment("spam", 2)
+        counts.reduce_count(["spam", "eggs", "eggs"])
+        assert counts["spam"] == 4
+        assert counts["eggs"] == 2
+        ```
+    """
+
+    def __init__(self, initial: dict[K, int] | Iterable[tuple[K, int]] = (), **kwargs):
+        """
+        :param initial: The initial counters.
+        :param kwargs: Passed on to the underlying
+            [`AtomicDict`][cereggii._cereggii.AtomicDict.__init__].
+        :raises OverflowError: If a counter is out of range.
+        """
+        if isinstance(initial, dict):
+            initial = initial.items()
+        self._counters = AtomicDict[K, AtomicInt64].from_items(
+            ((key, self._new_counter(value)) for key, value in initial), **kwargs
+        )
+
+    @staticmethod
+    def _new_counter(value: int) -> AtomicInt64:
+        counter = AtomicInt64(value)
+        _check_range(value)
+        return counter
+
+    def increment(self, key: K, amount: int = 1):
+        """
+        Atomically add `amount` to the counter of `key`. A missing counter
+        starts from 0.
+
+        :raises OverflowError: If the counter would go out of range.
+        """
+        new = None
+        while True:
+            counter = self._counters.get(key, NOT_FOUND)
+            if counter is NOT_FOUND:
+                if new is None:
+                    new = self._new_counter(amount)
+                counter = self._counters.setdefault(key, new)
+                if counter is new:
+                    return
+            else:
+                _check_range(amount)
+
+            previous = counter.fetch_add(amount)
+            if _is_live(previous):
+                if _is_live(previous + amount):
+                    return
+                counter.fetch_add(-amount)
+                raise OverflowError(f"counter value out of range [-2**62, 2**62): {previous + amount}")
+            # the key was deleted concurrently (or another increment is
+            # about to fail): take the amount back, and look up the key again
+            counter.fetch_add(-amount)
+
+    def __getitem__(self, key: K) -> int:
+        """
+        :raises KeyError: If `key` is not found.
+        """
+        value = self._counters[key].get()
+        if not _is_live(value):  # deleted concurrently
+            raise KeyError(key)
+        return value
+
+    def get(self, key: K, default: Any = None) -> int | Any:
+        """
+        Just like Python's [`dict.get`](https://docs.python.org/3/library/stdtypes.html#dict.get).
+        """
+        counter = self._counters.get(key, NOT_FOUND)
+        if counter is NOT_FOUND:
+            return default
+        value = counter.get()
+        if not _is_live(value):
+            return default
+        return value
+
+    def __setitem__(self, key: K, value: int):
+        """
+        :raises OverflowError: If `value` is out of range.
+        """
+        new = self._new_counter(value)
+        while True:
+            counter = self._counters.get(key, NOT_FOUND)
+            if counter is NOT_FOUND:
+                counter = self._counters.setdefault(key, new)
+                if counter is new:
+                    return
+            current = counter.get()
+            if _is_live(current) and counter.compare_and_set(current, value):
+                return
+
+    def __delitem__(self, key: K):
+        # the cell is detached first: increments that still reach it
+        # afterwards are either counted before it is set to _DEAD, or retried
+        self._counters.pop(key).set(_DEAD)
+
+    def pop(self, key: K, default: Any = NOT_FOUND) -> int | Any:
+        """
+        Just like Python's [`dict.pop`](https://docs.python.org/3/library/stdtypes.html#dict.pop).
+        """
+        counter = self._counters.pop(key, NOT_FOUND)
+        if counter is NOT_FOUND:
+            if default is NOT_FOUND:
+                raise KeyError(key)
+            return default
+        return counter.get_and_set(_DEAD)
+
+    def __len__(self) -> int:
+        return len(self._counters)
+
+    def reduce_sum(self, iterable: Iterable[tuple[K, int]]):
+        """
+        Add the amounts found in `iterable` to the counters of their keys.
+
+        The amounts of the same key are first summed locally, so that each
+        counter is incremented once per call.
+        """
+        totals = Counter()
+        for key, amount in iterable:
+            totals[key] += amount
+        for key, amount in totals.items():
+            self.increment(key, amount)
+
+    def reduce_count(self, iterable: Iterable[K] | dict[Any, int]):
+        """
+        Count the occurrences of each key in `iterable`, like
+        [`AtomicDict.reduce_count`][cereggii._cereggii.AtomicDict.reduce_count].
+        """
+        for key, amount in Counter(iterable).items():
+            self.increment(key, amount)
+
+    def fast_iter(self, partitions: int = 1, this_partition: int = 0) -> Iterator[tuple[K, int]]:
+        """
+        Like [`AtomicDict.fast_iter`][cereggii._cereggii.AtomicDict.fast_iter],
+        yielding the current value of each counter.
+        """
+        for key, counter in self._counters.fast_iter(partitions, this_partition):
+            value = counter.get()
+            if _is_live(value):
+                yield key, value
@@ -92,11 +92,13 @@ AtomicDict_init(AtomicDict *self, PyObject *args, PyObject *kwargs)
     PyObject *initial = NULL;
     PyObject *min_size_arg = NULL;
     PyObject *buffer_size_arg = NULL;
+    const char *layout = NULL;
+    uint8_t log_entry_size = ATOMIC_DICT_LOG_PADDED_ENTRY_SIZE;
     AtomicDictMeta *meta = NULL;
 
-    char *kw_list[] = {"initial", "min_size", "buffer_size", NULL};
+    char *kw_list[] = {"initial", "min_size", "buffer_size", "layout", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OOO", kw_list, &initial, &min_size_arg, &buffer_size_arg)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OOOs", kw_list, &initial, &min_size_arg, &buffer_size_arg, &layout)) {
         goto fail;
     }
     if (initial != NULL) {
@@ -131,6 +133,14 @@ AtomicDict_init(AtomicDict *self, PyObject *args, PyObject *kwargs)
             return -1;
         }
     }
+    if (layout != NULL) {
+        if (strcmp(layout, "compact") == 0) {
+            log_entry_size = ATOMIC_DICT_LOG_COMPACT_ENTRY_SIZE;
+        } else if (strcmp(layout, "padded") != 0) {
+            PyErr_SetString(PyExc_ValueError, "layout not in ('padded', 'compact')");
+            return -1;
+        }
+    }
 
     if (initial != NULL) {
         init_dict_size = PyDict_Size(initial) * 2;
@@ -181,7 +191,7 @@ AtomicDict_init(AtomicDict *self, PyObject *args, PyObject *kwargs)
 
     create:
     meta = NULL;
-    meta = AtomicDictMeta_New(log_size);
+    meta = AtomicDictMeta_New(log_size, log_entry_size);
     if (meta == NULL)
         goto fail;
     meta_clear_index(meta);
@@ -192,7 +202,7 @@ AtomicDict_init(AtomicDict *self, PyObject *args, PyObject *kwargs)
     int64_t i;
     for (i = 0; i < init_dict_size / ATOMIC_DICT_ENTRIES_IN_PAGE; i++) {
         // allocate pages
-        page = AtomicDictPage_New();
+        page = AtomicDictPage_New(log_entry_size);
         if (page == NULL)
             goto fail;
         meta->pages[i] = page;
@@ -203,7 +213,7 @@ AtomicDict_init(AtomicDict *self, PyObject *args, PyObject *kwargs)
     }
     if (init_dict_size % ATOMIC_DICT_ENTRIES_IN_PAGE > 0) {
         // allocate additional page
-        page = AtomicDictPage_New();
+        page = AtomicDictPage_New(log_entry_size);
         if (page == NULL)
             goto fail;
         meta->pages[i] = page;
@@ -213,7 +223,7 @@ AtomicDict_init(AtomicDict *self, PyObject *args, PyObject *kwargs)
         meta->greatest_allocated_page++;
     }
     if (meta->greatest_allocated_page == -1) {
-        page = AtomicDictPage_New();
+        page = AtomicDictPage_New(log_entry_size);
         if (page == NULL)
             goto fail;
         meta->pages[0] = page;
@@ -436,6 +446,17 @@ approx_inserted(AtomicDict *self)
     return inserted;
 }
 
+int64_t
+approx_tombstones(AtomicDict *self)
+{
+    int64_t tombstones = 0;
+    AtomicDictAccessorStorage *storage;
+    FOR_EACH_ACCESSOR(self, storage) {
+        tombstones += atomic_load_explicit((_Atomic (int64_t) *) &storage->local_tombstones, memory_order_acquire);
+    }
+    return tombstones;
+}
+
 PyObject *
 AtomicDict_ApproxLen(AtomicDict *self)
 {
@@ -529,8 +550,9 @@ AtomicDict_Debug(AtomicDict *self)
     PyObject *page_info = NULL;
 
     meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
-    metadata = Py_BuildValue("{sOsO}",
+    metadata = Py_BuildValue("{sOsOsO}",
                              "log_size\0", Py_BuildValue("B", meta->log_size),
+                             "log_entry_size\0", Py_BuildValue("B", meta->log_entry_size),
                              "greatest_allocated_page\0", Py_BuildValue("L", meta->greatest_allocated_page));
     if (metadata == NULL)
         goto fail;
@@ -567,15 +589,16 @@ AtomicDict_Debug(AtomicDict *self)
             goto fail;
 
         for (int j = 0; j < ATOMIC_DICT_ENTRIES_IN_PAGE; j++) {
-            PyObject *key = page->entries[j].entry.key;
-            PyObject *value = page->entries[j].entry.value;
+            AtomicDictEntry *entry = PAGE_ENTRY_AT(page, j);
+            PyObject *key = entry->key;
+            PyObject *value = entry->value;
             if (value != NULL) {
                 assert(key != NULL);
                 uint64_t entry_ix = (i << ATOMIC_DICT_LOG_ENTRIES_IN_PAGE) + j;
                 entry_tuple = Py_BuildValue("(KBnOO)",
                                             entry_ix,
-                                            page->entries[j].entry.flags,
-                                            page->entries[j].entry.hash,
+                                            entry->flags,
+                                            entry->hash,
                                             key,
                                             value);
                 if (entry_tuple == NULL)
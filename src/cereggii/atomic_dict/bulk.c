@@ -0,0 +1,1337 @@
+// SPDX-FileCopyrightText: 2023-present dpdani <git@danieleparmeggiani.me>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdatomic.h>
+#include <cereggii/atomic_dict.h>
+#include <cereggii/atomic_ref.h>
+#include <cereggii/internal/atomic_dict.h>
+#include <cereggii/internal/py_core.h>
+#include <cereggii/vendor/pythoncapi_compat/pythoncapi_compat.h>
+
+
+// bulk loading.
+//
+// a new meta is built privately by the loading thread: entries are written
+// sequentially into the pages, and the index is populated with unsafe_insert.
+// no atomic operation is needed until the meta is published, at the very end.
+//
+// items are hashed in chunks, and the index slots they will probe are
+// prefetched before inserting the chunk.
+
+#define ATOMIC_DICT_BULK_CHUNK 64
+
+typedef struct AtomicDictBulkLoad {
+    AtomicDictMeta *meta;
+    uint64_t location;  // of the last written entry
+    int unique;  // keys are known to be distinct: skip the lookups
+
+    int chunk_len;
+    Py_hash_t hashes[ATOMIC_DICT_BULK_CHUNK];
+    PyObject *keys[ATOMIC_DICT_BULK_CHUNK];
+    PyObject *values[ATOMIC_DICT_BULK_CHUNK];
+} AtomicDictBulkLoad;
+
+
+static AtomicDictMeta *
+bulk_meta_new(uint8_t log_size, uint8_t log_entry_size)
+{
+    AtomicDictMeta *meta = NULL;
+    AtomicDictPage *page = NULL;
+
+    meta = AtomicDictMeta_New(log_size, log_entry_size);
+    if (meta == NULL)
+        goto fail;
+    meta_clear_index(meta);
+    if (meta_init_pages(meta) < 0)
+        goto fail;
+
+    page = AtomicDictPage_New(log_entry_size);
+    if (page == NULL)
+        goto fail;
+    meta->pages[0] = page;
+    meta->greatest_allocated_page = 0;
+    if ((SIZE_OF(meta) >> ATOMIC_DICT_LOG_ENTRIES_IN_PAGE) > 1) {
+        meta->pages[1] = NULL;
+    }
+    PAGE_ENTRY_AT(page, 0)->flags = ENTRY_FLAGS_RESERVED;
+    // entry 0 must always be reserved: tombstones are pointers
+    // to entry 0, so it must always be empty.
+
+    return meta;
+    fail:
+    Py_XDECREF(meta);
+    return NULL;
+}
+
+static int
+bulk_grow(AtomicDictBulkLoad *bl)
+{
+    // there are no deleted entries during a bulk load:
+    // compacting into a larger meta simply re-builds the index.
+    AtomicDictMeta *new_meta = NULL;
+
+    if (bl->meta->log_size + 1 > ATOMIC_DICT_MAX_LOG_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "can hold at most 2^56 items.");
+        goto fail;
+    }
+
+    new_meta = AtomicDictMeta_New(bl->meta->log_size + 1, bl->meta->log_entry_size);
+    if (new_meta == NULL)
+        goto fail;
+    meta_clear_index(new_meta);
+
+    int64_t compacted = meta_compact_pages(bl->meta, new_meta);
+    if (compacted < 0)
+        goto fail;
+    assert((uint64_t) compacted == bl->location);
+
+    Py_DECREF(bl->meta);
+    bl->meta = new_meta;
+    return 0;
+    fail:
+    Py_XDECREF(new_meta);
+    return -1;
+}
+
+static int
+bulk_insert(AtomicDictBulkLoad *bl, PyObject *key, Py_hash_t hash, PyObject *value)
+{
+    if (!bl->unique) {
+        AtomicDictSearchResult result;
+        result.found = 0;
+        lookup(bl->meta, key, hash, &result);
+        if (result.error)
+            return -1;
+
+        if (result.found) {
+            // later items take precedence, as with dict(iterable)
+            _Py_SetWeakrefAndIncref(value);
+            result.entry_p->value = value;
+            Py_DECREF(result.entry.value);
+            return 0;
+        }
+    }
+
+    if ((bl->location + 2) * 2 > (uint64_t) SIZE_OF(bl->meta)) {
+        if (bulk_grow(bl) < 0)
+            return -1;
+    }
+
+    AtomicDictMeta *meta = bl->meta;
+    uint64_t location = bl->location + 1;
+
+    if (page_of(location) > (uint64_t) meta->greatest_allocated_page) {
+        AtomicDictPage *page = AtomicDictPage_New(meta->log_entry_size);
+        if (page == NULL)
+            return -1;
+        meta->greatest_allocated_page++;
+        meta->pages[meta->greatest_allocated_page] = page;
+        if ((uint64_t) meta->greatest_allocated_page + 1 < (uint64_t) SIZE_OF(meta) >> ATOMIC_DICT_LOG_ENTRIES_IN_PAGE) {
+            meta->pages[meta->greatest_allocated_page + 1] = NULL;
+        }
+    }
+
+    AtomicDictEntry *entry_p = get_entry_at(location, meta);
+    _Py_SetWeakrefAndIncref(key);
+    _Py_SetWeakrefAndIncref(value);
+    entry_p->flags = ENTRY_FLAGS_RESERVED;
+    entry_p->hash = hash;
+    entry_p->key = key;
+    entry_p->value = value;
+
+    if (unsafe_insert(meta, hash, location) < 0) {
+        // the index is never more than half full
+        PyErr_SetString(PyExc_RuntimeError, "bulk loaded AtomicDict is too small.");
+        return -1;
+    }
+
+    bl->location = location;
+    return 0;
+}
+
+static int
+bulk_flush(AtomicDictBulkLoad *bl)
+{
+    int i, ok = 0;
+
+    for (i = 0; i < bl->chunk_len; i++) {
+        if (bulk_insert(bl, bl->keys[i], bl->hashes[i], bl->values[i]) < 0) {
+            ok = -1;
+            break;
+        }
+    }
+
+    for (i = 0; i < bl->chunk_len; i++) {
+        Py_DECREF(bl->keys[i]);
+        Py_DECREF(bl->values[i]);
+    }
+    bl->chunk_len = 0;
+
+    return ok;
+}
+
+static int
+bulk_push_hashed(AtomicDictBulkLoad *bl, PyObject *key, Py_hash_t hash, PyObject *value)
+{
+    bl->hashes[bl->chunk_len] = hash;
+    bl->keys[bl->chunk_len] = Py_NewRef(key);
+    bl->values[bl->chunk_len] = Py_NewRef(value);
+    bl->chunk_len++;
+
+    cereggii_prefetch(&bl->meta->index[distance0_of(hash, bl->meta)]);
+
+    if (bl->chunk_len == ATOMIC_DICT_BULK_CHUNK)
+        return bulk_flush(bl);
+
+    return 0;
+}
+
+static int
+bulk_push(AtomicDictBulkLoad *bl, PyObject *key, PyObject *value)
+{
+    Py_hash_t hash = PyObject_Hash(key);
+    if (hash == -1)
+        return -1;
+
+    return bulk_push_hashed(bl, key, hash, value);
+}
+
+int
+unpack_item(PyObject *item, PyObject **key, PyObject **value)
+{
+    // returns new references to the key and the value of a (key, value) pair
+    if (PyTuple_CheckExact(item) && PyTuple_GET_SIZE(item) == 2) {
+        *key = Py_NewRef(PyTuple_GET_ITEM(item, 0));
+        *value = Py_NewRef(PyTuple_GET_ITEM(item, 1));
+        return 0;
+    }
+
+    PyObject *seq = PySequence_Fast(item, "cannot convert AtomicDict update sequence element to a sequence");
+    if (seq == NULL)
+        return -1;
+
+    if (PySequence_Fast_GET_SIZE(seq) != 2) {
+        PyErr_Format(PyExc_ValueError, "AtomicDict update sequence element has length %zd; 2 is required",
+                     PySequence_Fast_GET_SIZE(seq));
+        Py_DECREF(seq);
+        return -1;
+    }
+
+    *key = Py_NewRef(PySequence_Fast_GET_ITEM(seq, 0));
+    *value = Py_NewRef(PySequence_Fast_GET_ITEM(seq, 1));
+    Py_DECREF(seq);
+    return 0;
+}
+
+static int
+bulk_push_item(AtomicDictBulkLoad *bl, PyObject *item)
+{
+    PyObject *key, *value;
+
+    if (unpack_item(item, &key, &value) < 0)
+        return -1;
+
+    int ok = bulk_push(bl, key, value);
+    Py_DECREF(key);
+    Py_DECREF(value);
+    return ok;
+}
+
+static int
+bulk_push_atomic_dict(AtomicDictBulkLoad *bl, AtomicDict *source)
+{
+    AtomicDictMeta *meta = NULL;
+
+    AtomicDictAccessorStorage *storage = get_or_create_accessor_storage(source);
+    if (storage == NULL)
+        goto fail;
+
+    meta = get_meta(source, storage);
+    Py_INCREF(meta);
+
+    int64_t greatest_allocated_page = atomic_load_explicit((_Atomic (int64_t) *) &meta->greatest_allocated_page, memory_order_acquire);
+
+    for (int64_t page_i = 0; page_i <= greatest_allocated_page; ++page_i) {
+        AtomicDictPage *page = atomic_load_explicit((_Atomic (AtomicDictPage *) *) &meta->pages[page_i], memory_order_acquire);
+
+        for (int j = 0; j < ATOMIC_DICT_ENTRIES_IN_PAGE; j++) {
+            AtomicDictEntry entry;
+            read_entry(PAGE_ENTRY_AT(page, j), &entry);
+            if (entry.value == NULL)
+                continue;
+
+            if (bulk_push(bl, entry.key, entry.value) < 0)
+                goto fail;
+        }
+    }
+
+    Py_DECREF(meta);
+    return 0;
+    fail:
+    Py_XDECREF(meta);
+    return -1;
+}
+
+static void
+bulk_publish(AtomicDict *self, AtomicDictBulkLoad *bl)
+{
+    AtomicDictAccessorStorage *storage = get_accessor_storage(self->accessor_key);
+    assert(storage != NULL);
+
+    begin_synchronous_operation(self);
+
+    AtomicDictMeta *current_meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
+
+    // reservations point to entries of the previous meta
+    AtomicDictAccessorStorage *accessor;
+    FOR_EACH_ACCESSOR(self, accessor) {
+        accessor->reservation_buffer = (AtomicDictReservationBuffer) {0};
+        atomic_store_explicit((_Atomic (int64_t) *) &accessor->local_len, 0, memory_order_release);
+        atomic_store_explicit((_Atomic (int64_t) *) &accessor->local_inserted, 0, memory_order_release);
+        atomic_store_explicit((_Atomic (int64_t) *) &accessor->local_tombstones, 0, memory_order_release);
+    }
+
+    uint64_t location = bl->location + 1;
+    if (location % self->reservation_buffer_size != 0) {
+        // the remainder of the last reservation run can be used by this thread
+        reservation_buffer_put(&storage->reservation_buffer, location,
+                               self->reservation_buffer_size - (uint8_t) (location % self->reservation_buffer_size),
+                               bl->meta);
+    }
+
+    atomic_store_explicit((_Atomic (int64_t) *) &storage->local_inserted, (int64_t) bl->location, memory_order_release);
+    self->len = (Py_ssize_t) bl->location;
+
+    int swapped = AtomicRef_CompareAndSet(self->metadata, (PyObject *) current_meta, (PyObject *) bl->meta);
+    assert(swapped);
+    cereggii_unused_in_release_build(swapped);
+    Py_DECREF(current_meta);
+    Py_CLEAR(bl->meta);  // the only reference is now held by self->metadata
+
+    end_synchronous_operation(self);
+}
+
+static void
+bulk_free(AtomicDictBulkLoad *bl)
+{
+    for (int i = 0; i < bl->chunk_len; i++) {
+        Py_DECREF(bl->keys[i]);
+        Py_DECREF(bl->values[i]);
+    }
+    Py_XDECREF(bl->meta);
+    PyMem_RawFree(bl);
+}
+
+static AtomicDictBulkLoad *
+bulk_new(AtomicDict *self, Py_ssize_t size_hint)
+{
+    AtomicDictBulkLoad *bl = NULL;
+
+    AtomicDictAccessorStorage *storage = get_or_create_accessor_storage(self);
+    if (storage == NULL)
+        goto fail;
+    AtomicDictMeta *current_meta = get_meta(self, storage);
+
+    uint8_t log_size = current_meta->log_size;
+    while ((1ull << log_size) < 2 * ((uint64_t) size_hint + 1) && log_size < ATOMIC_DICT_MAX_LOG_SIZE) {
+        log_size++;
+    }
+
+    bl = PyMem_RawMalloc(sizeof(AtomicDictBulkLoad));
+    if (bl == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    bl->location = 0;
+    bl->chunk_len = 0;
+    bl->unique = 0;
+    bl->meta = bulk_meta_new(log_size, current_meta->log_entry_size);
+    if (bl->meta == NULL)
+        goto fail;
+
+    return bl;
+    fail:
+    if (bl != NULL) {
+        bulk_free(bl);
+    }
+    return NULL;
+}
+
+static int
+bulk_finish(AtomicDict *self, AtomicDictBulkLoad *bl)
+{
+    // on success, bl is freed
+    if (bulk_flush(bl) < 0)
+        return -1;
+
+    bulk_publish(self, bl);
+    PyMem_RawFree(bl);
+    return 0;
+}
+
+static int
+bulk_load(AtomicDict *self, PyObject *iterable, Py_ssize_t size_hint)
+{
+    AtomicDictBulkLoad *bl = NULL;
+    PyObject *iterator = NULL;
+    PyObject *item = NULL;
+
+    bl = bulk_new(self, size_hint);
+    if (bl == NULL)
+        goto fail;
+
+    if (PyDict_CheckExact(iterable)) {
+        PyObject *key, *value;
+        Py_ssize_t pos = 0;
+
+        int ok = 0;
+        bl->unique = 1;
+
+        Py_BEGIN_CRITICAL_SECTION(iterable);
+        while (PyDict_Next(iterable, &pos, &key, &value)) {
+            ok = bulk_push(bl, key, value);
+            if (ok < 0)
+                break;
+        }
+        Py_END_CRITICAL_SECTION();
+
+        if (ok < 0)
+            goto fail;
+    } else if (PyObject_TypeCheck(iterable, &AtomicDict_Type)) {
+        if ((AtomicDict *) iterable == self) {
+            PyErr_SetString(PyExc_ValueError, "cannot bulk load an AtomicDict into itself.");
+            goto fail;
+        }
+        if (bulk_push_atomic_dict(bl, (AtomicDict *) iterable) < 0)
+            goto fail;
+    } else {
+        iterator = PyObject_GetIter(iterable);
+        if (iterator == NULL)
+            goto fail;
+
+        while (PyIter_NextItem(iterator, &item) == 1) {
+            if (bulk_push_item(bl, item) < 0)
+                goto fail;
+            Py_CLEAR(item);
+        }
+        if (PyErr_Occurred())
+            goto fail;
+        Py_CLEAR(iterator);
+    }
+
+    if (bulk_finish(self, bl) < 0)
+        goto fail;
+
+    return 0;
+
+    fail:
+    Py_XDECREF(item);
+    Py_XDECREF(iterator);
+    if (bl != NULL) {
+        bulk_free(bl);
+    }
+    return -1;
+}
+
+static int
+pop_non_negative_kwarg(PyObject *kwargs, const char *name, Py_ssize_t *out)
+{
+    // leaves *out untouched when the argument is missing or None
+    PyObject *arg = NULL;
+    if (PyDict_PopString(kwargs, name, &arg) < 0)
+        return -1;
+    if (arg == NULL)
+        return 0;
+    if (arg == Py_None) {
+        Py_DECREF(arg);
+        return 0;
+    }
+
+    Py_ssize_t value = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    Py_DECREF(arg);
+    if (value == -1 && PyErr_Occurred())
+        return -1;
+    if (value < 0) {
+        PyErr_Format(PyExc_ValueError, "%s < 0", name);
+        return -1;
+    }
+
+    *out = value;
+    return 0;
+}
+
+static AtomicDict *
+construct(PyObject *cls, PyObject *init_kwargs)
+{
+    PyObject *init_args = NULL;
+    PyObject *self = NULL;
+
+    init_args = PyTuple_New(0);
+    if (init_args == NULL)
+        goto fail;
+
+    self = PyObject_Call(cls, init_args, init_kwargs);
+    if (self == NULL)
+        goto fail;
+
+    if (!PyObject_TypeCheck(self, &AtomicDict_Type)) {
+        PyErr_SetString(PyExc_TypeError, "type(cls()) is not AtomicDict");
+        goto fail;
+    }
+
+    Py_DECREF(init_args);
+    return (AtomicDict *) self;
+    fail:
+    Py_XDECREF(init_args);
+    Py_XDECREF(self);
+    return NULL;
+}
+
+PyObject *
+AtomicDict_FromItems(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    PyObject *iterable = NULL;
+    PyObject *init_kwargs = NULL;
+    AtomicDict *self = NULL;
+    Py_ssize_t size_hint = -1;
+
+    if (!PyArg_ParseTuple(args, "O", &iterable))
+        goto fail;
+
+    if (kwargs != NULL) {
+        // all other keyword arguments are passed on to the constructor
+        init_kwargs = PyDict_Copy(kwargs);
+        if (init_kwargs == NULL)
+            goto fail;
+        if (pop_non_negative_kwarg(init_kwargs, "size_hint", &size_hint) < 0)
+            goto fail;
+    }
+
+    if (size_hint < 0) {
+        size_hint = PyObject_LengthHint(iterable, 0);
+        if (size_hint < 0)
+            goto fail;
+    }
+
+    self = construct(cls, init_kwargs);
+    if (self == NULL)
+        goto fail;
+
+    if (bulk_load(self, iterable, size_hint) < 0)
+        goto fail;
+
+    Py_XDECREF(init_kwargs);
+    return (PyObject *) self;
+
+    fail:
+    Py_XDECREF(init_kwargs);
+    Py_XDECREF(self);
+    return NULL;
+}
+
+
+// parallel loading.
+//
+// the index is sized up-front for all of the partitions, so that the
+// workers never need to grow it. then, the workers concurrently insert the
+// items of one partition at a time, with the usual insertion path:
+// each worker takes entries from its own reservation buffer.
+
+static int
+parallel_load_partition(AtomicDictParallel *parallel, PyObject *partition)
+{
+    PyObject *iterator = NULL;
+    PyObject *item = NULL;
+    PyObject *key = NULL, *value = NULL;
+
+    if (PyDict_CheckExact(partition)) {
+        Py_ssize_t pos = 0;
+        int ok = 0;
+
+        Py_BEGIN_CRITICAL_SECTION(partition);
+        while (PyDict_Next(partition, &pos, &key, &value)) {
+            ok = AtomicDict_SetItem(parallel->self, key, value);
+            if (ok < 0)
+                break;
+            if (parallel_failed(parallel))
+                break;
+        }
+        Py_END_CRITICAL_SECTION();
+
+        return ok;
+    }
+
+    iterator = PyObject_GetIter(partition);
+    if (iterator == NULL)
+        goto fail;
+
+    while (PyIter_NextItem(iterator, &item) == 1) {
+        if (unpack_item(item, &key, &value) < 0)
+            goto fail;
+        if (AtomicDict_SetItem(parallel->self, key, value) < 0)
+            goto fail;
+        Py_CLEAR(key);
+        Py_CLEAR(value);
+        Py_CLEAR(item);
+
+        if (parallel_failed(parallel))
+            break;
+    }
+    if (PyErr_Occurred())
+        goto fail;
+
+    Py_DECREF(iterator);
+    return 0;
+    fail:
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    Py_XDECREF(item);
+    Py_XDECREF(iterator);
+    return -1;
+}
+
+PyObject *
+AtomicDict_ParallelLoad(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    PyObject *partitions = NULL;
+    PyObject *init_kwargs = NULL;
+    PyObject *empty = NULL;
+    AtomicDict *self = NULL;
+    Py_ssize_t size_hint = -1;
+    Py_ssize_t threads = -1;
+    AtomicDictParallel parallel = {0};
+
+    if (!PyArg_ParseTuple(args, "O", &partitions))
+        goto fail;
+
+    parallel.tasks = PySequence_List(partitions);
+    if (parallel.tasks == NULL)
+        goto fail;
+
+    if (kwargs != NULL) {
+        // all other keyword arguments are passed on to the constructor
+        init_kwargs = PyDict_Copy(kwargs);
+        if (init_kwargs == NULL)
+            goto fail;
+        if (pop_non_negative_kwarg(init_kwargs, "size_hint", &size_hint) < 0)
+            goto fail;
+        if (pop_non_negative_kwarg(init_kwargs, "threads", &threads) < 0)
+            goto fail;
+        if (threads == 0) {
+            PyErr_SetString(PyExc_ValueError, "threads == 0");
+            goto fail;
+        }
+    }
+
+    const Py_ssize_t partitions_count = PyList_GET_SIZE(parallel.tasks);
+    if (threads < 0 || threads > partitions_count) {
+        threads = partitions_count;
+    }
+
+    if (size_hint < 0) {
+        size_hint = 0;
+        for (Py_ssize_t i = 0; i < partitions_count; i++) {
+            Py_ssize_t hint = PyObject_LengthHint(PyList_GET_ITEM(parallel.tasks, i), 0);
+            if (hint < 0)
+                goto fail;
+            size_hint += hint;
+        }
+    }
+
+    self = construct(cls, init_kwargs);
+    if (self == NULL)
+        goto fail;
+    parallel.self = self;
+    parallel.run = parallel_load_partition;
+
+    // an empty bulk load publishes a meta that is large enough for all the
+    // items, plus the entries that may be left unused in the reservation
+    // buffers of each worker.
+    empty = PyTuple_New(0);
+    if (empty == NULL)
+        goto fail;
+    if (bulk_load(self, empty, size_hint + threads * self->reservation_buffer_size) < 0)
+        goto fail;
+
+    if (partitions_count > 0 && parallel_run(&parallel, threads) < 0)
+        goto fail;
+
+    Py_DECREF(parallel.tasks);
+    Py_DECREF(empty);
+    Py_XDECREF(init_kwargs);
+    return (PyObject *) self;
+
+    fail:
+    Py_XDECREF(parallel.tasks);
+    Py_XDECREF(empty);
+    Py_XDECREF(init_kwargs);
+    Py_XDECREF(self);
+    return NULL;
+}
+
+
+// serialization.
+//
+// a dump is a header, followed by one record for each page of entries, and
+// by an empty record. the keys and values of a record are pickled together
+// with protocol 5: the out-of-band buffers follow the pickle, so that large
+// buffers are written to the file as they are.
+// the hashes of the keys are stored in the record, and loading a dump is a
+// bulk load that doesn't need to hash the keys again. still, the hashes of
+// str and bytes depend on PYTHONHASHSEED: the header has a fingerprint of the
+// hash function, and the keys are hashed again if it doesn't match.
+// a stored hash is only ever used for keys of the builtin types that are
+// hashed by value: any other key (e.g. one hashed by its identity, which an
+// unpickled copy doesn't share) is always hashed again.
+//
+// all integers are 64-bit, little-endian:
+//     header: magic, version, fingerprint, size hint
+//     record: count, hashes[count], pickle size, buffers count,
+//             buffer sizes[buffers count], pickle, buffers
+
+#define ATOMIC_DICT_DUMP_MAGIC "CRGDICT\n"
+#define ATOMIC_DICT_DUMP_VERSION 1
+#define ATOMIC_DICT_DUMP_HEADER_SIZE 32
+
+static inline void
+store_le64(char *p, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (char) (value >> (8 * i));
+    }
+}
+
+static inline uint64_t
+load_le64(const char *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t) (unsigned char) p[i] << (8 * i);
+    }
+    return value;
+}
+
+static int
+dump_fingerprint(Py_hash_t *fingerprint)
+{
+    PyObject *members = NULL;
+    PyObject *set = NULL;
+    PyObject *sample = NULL;
+
+    members = Py_BuildValue("(ii)", 1, 2);
+    if (members == NULL)
+        goto fail;
+    set = PyFrozenSet_New(members);
+    if (set == NULL)
+        goto fail;
+    sample = Py_BuildValue("(sy#LdO)", "cereggii", "cereggii", (Py_ssize_t) 8, 1ll << 62, 1.5, set);
+    if (sample == NULL)
+        goto fail;
+
+    *fingerprint = PyObject_Hash(sample);
+    if (*fingerprint == -1)
+        goto fail;
+
+    Py_DECREF(members);
+    Py_DECREF(set);
+    Py_DECREF(sample);
+    return 0;
+    fail:
+    Py_XDECREF(members);
+    Py_XDECREF(set);
+    Py_XDECREF(sample);
+    return -1;
+}
+
+#define ATOMIC_DICT_DUMP_MAX_HASH_DEPTH 8
+
+/**
+ * Returns 1 if the hash of key only depends on its value, and on the hash
+ * function that the fingerprint samples: str, bytes, int, float, and tuples
+ * or frozensets of those. Returns 0 otherwise, and -1 on error.
+ **/
+static int
+load_hash_is_portable(PyObject *key, int depth)
+{
+    if (PyUnicode_CheckExact(key) || PyBytes_CheckExact(key) || PyLong_CheckExact(key)
+        || PyBool_Check(key) || PyFloat_CheckExact(key))
+        return 1;
+
+    if (depth == ATOMIC_DICT_DUMP_MAX_HASH_DEPTH)
+        return 0;
+
+    if (PyTuple_CheckExact(key)) {
+        for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(key); i++) {
+            int portable = load_hash_is_portable(PyTuple_GET_ITEM(key, i), depth + 1);
+            if (portable != 1)
+                return portable;
+        }
+        return 1;
+    }
+
+    if (PyFrozenSet_CheckExact(key)) {
+        PyObject *iterator = PyObject_GetIter(key);
+        if (iterator == NULL)
+            return -1;
+
+        int portable = 1;
+        PyObject *member;
+        while (portable == 1 && (member = PyIter_Next(iterator)) != NULL) {
+            portable = load_hash_is_portable(member, depth + 1);
+            Py_DECREF(member);
+        }
+        Py_DECREF(iterator);
+        if (PyErr_Occurred())
+            return -1;
+        return portable;
+    }
+
+    return 0;
+}
+
+static int
+dump_write(PyObject *write, PyObject *data)
+{
+    // raw (unbuffered) files may write fewer bytes than requested
+    PyObject *view = NULL;
+    PyObject *chunk = NULL;
+    PyObject *written = NULL;
+
+    view = PyMemoryView_FromObject(data);
+    if (view == NULL)
+        goto fail;
+    const Py_ssize_t size = PyMemoryView_GET_BUFFER(view)->len;
+
+    Py_ssize_t offset = 0;
+    while (offset < size) {
+        chunk = offset == 0 ? Py_NewRef(view) : PySequence_GetSlice(view, offset, size);
+        if (chunk == NULL)
+            goto fail;
+        written = PyObject_CallOneArg(write, chunk);
+        if (written == NULL)
+            goto fail;
+        Py_CLEAR(chunk);
+
+        if (written == Py_None)
+            break;
+        Py_ssize_t n = PyNumber_AsSsize_t(written, PyExc_OverflowError);
+        if (n == -1 && PyErr_Occurred())
+            goto fail;
+        if (n <= 0) {
+            PyErr_SetString(PyExc_OSError, "could not write AtomicDict dump.");
+            goto fail;
+        }
+        Py_CLEAR(written);
+        offset += n;
+    }
+
+    Py_XDECREF(written);
+    Py_DECREF(view);
+    return 0;
+    fail:
+    Py_XDECREF(written);
+    Py_XDECREF(chunk);
+    Py_XDECREF(view);
+    return -1;
+}
+
+static int
+dump_record(PyObject *write, PyObject *dumps, PyObject *dumps_kwargs, PyObject *buffers,
+            Py_hash_t *hashes, PyObject *keys, PyObject *values)
+{
+    PyObject *items = NULL;
+    PyObject *dumps_args = NULL;
+    PyObject *pickled = NULL;
+    PyObject *header = NULL;
+    PyObject *raw = NULL;
+
+    const Py_ssize_t count = PyList_GET_SIZE(keys);
+
+    items = PyTuple_Pack(2, keys, values);
+    if (items == NULL)
+        goto fail;
+    dumps_args = PyTuple_Pack(1, items);
+    if (dumps_args == NULL)
+        goto fail;
+    pickled = PyObject_Call(dumps, dumps_args, dumps_kwargs);  // out-of-band buffers are appended to buffers
+    Py_CLEAR(dumps_args);
+    Py_CLEAR(items);
+    if (pickled == NULL)
+        goto fail;
+    if (!PyBytes_Check(pickled)) {
+        PyErr_SetString(PyExc_TypeError, "pickle.dumps() did not return bytes.");
+        goto fail;
+    }
+
+    const Py_ssize_t buffers_count = PyList_GET_SIZE(buffers);
+    header = PyBytes_FromStringAndSize(NULL, 8 * (count + 3 + buffers_count));
+    if (header == NULL)
+        goto fail;
+    char *p = PyBytes_AS_STRING(header);
+
+    store_le64(p, (uint64_t) count);
+    p += 8;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        store_le64(p, (uint64_t) hashes[i]);
+        p += 8;
+    }
+    store_le64(p, (uint64_t) PyBytes_GET_SIZE(pickled));
+    p += 8;
+    store_le64(p, (uint64_t) buffers_count);
+    p += 8;
+    for (Py_ssize_t i = 0; i < buffers_count; i++) {
+        // raw() is a contiguous memoryview of bytes, or it raises BufferError
+        raw = PyObject_CallMethod(PyList_GET_ITEM(buffers, i), "raw", NULL);
+        if (raw == NULL)
+            goto fail;
+        if (!PyMemoryView_Check(raw)) {
+            PyErr_SetString(PyExc_TypeError, "PickleBuffer.raw() did not return a memoryview.");
+            goto fail;
+        }
+        store_le64(p, (uint64_t) PyMemoryView_GET_BUFFER(raw)->len);
+        p += 8;
+        if (PyList_SetItem(buffers, i, raw) < 0) {  // steals raw
+            raw = NULL;
+            goto fail;
+        }
+        raw = NULL;
+    }
+
+    if (dump_write(write, header) < 0)
+        goto fail;
+    if (dump_write(write, pickled) < 0)
+        goto fail;
+    for (Py_ssize_t i = 0; i < buffers_count; i++) {
+        if (dump_write(write, PyList_GET_ITEM(buffers, i)) < 0)
+            goto fail;
+    }
+
+    if (PyList_SetSlice(buffers, 0, PY_SSIZE_T_MAX, NULL) < 0)
+        goto fail;
+
+    Py_DECREF(pickled);
+    Py_DECREF(header);
+    return 0;
+    fail:
+    Py_XDECREF(items);
+    Py_XDECREF(dumps_args);
+    Py_XDECREF(pickled);
+    Py_XDECREF(header);
+    Py_XDECREF(raw);
+    return -1;
+}
+
+PyObject *
+AtomicDict_Dump(AtomicDict *self, PyObject *fileobj)
+{
+    PyObject *write = NULL;
+    PyObject *pickle = NULL;
+    PyObject *dumps = NULL;
+    PyObject *dumps_kwargs = NULL;
+    PyObject *buffers = NULL;
+    PyObject *buffers_append = NULL;
+    PyObject *approx_len = NULL;
+    PyObject *header = NULL;
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
+    AtomicDictMeta *meta = NULL;
+    Py_hash_t hashes[ATOMIC_DICT_ENTRIES_IN_PAGE];
+
+    write = PyObject_GetAttrString(fileobj, "write");
+    if (write == NULL)
+        goto fail;
+
+    pickle = PyImport_ImportModule("pickle");
+    if (pickle == NULL)
+        goto fail;
+    dumps = PyObject_GetAttrString(pickle, "dumps");
+    if (dumps == NULL)
+        goto fail;
+    buffers = PyList_New(0);
+    if (buffers == NULL)
+        goto fail;
+    buffers_append = PyObject_GetAttrString(buffers, "append");
+    if (buffers_append == NULL)
+        goto fail;
+    dumps_kwargs = Py_BuildValue("{s:i,s:O}", "protocol", 5, "buffer_callback", buffers_append);
+    if (dumps_kwargs == NULL)
+        goto fail;
+
+    Py_hash_t fingerprint;
+    if (dump_fingerprint(&fingerprint) < 0)
+        goto fail;
+    approx_len = AtomicDict_ApproxLen(self);
+    if (approx_len == NULL)
+        goto fail;
+    Py_ssize_t size_hint = PyLong_AsSsize_t(approx_len);
+    if (size_hint == -1 && PyErr_Occurred())
+        goto fail;
+    if (size_hint < 0) {
+        size_hint = 0;
+    }
+
+    header = PyBytes_FromStringAndSize(NULL, ATOMIC_DICT_DUMP_HEADER_SIZE);
+    if (header == NULL)
+        goto fail;
+    memcpy(PyBytes_AS_STRING(header), ATOMIC_DICT_DUMP_MAGIC, 8);
+    store_le64(PyBytes_AS_STRING(header) + 8, ATOMIC_DICT_DUMP_VERSION);
+    store_le64(PyBytes_AS_STRING(header) + 16, (uint64_t) fingerprint);
+    store_le64(PyBytes_AS_STRING(header) + 24, (uint64_t) size_hint);
+    if (dump_write(write, header) < 0)
+        goto fail;
+
+    keys = PyList_New(0);
+    if (keys == NULL)
+        goto fail;
+    values = PyList_New(0);
+    if (values == NULL)
+        goto fail;
+
+    AtomicDictAccessorStorage *storage = get_or_create_accessor_storage(self);
+    if (storage == NULL)
+        goto fail;
+    meta = get_meta(self, storage);
+    Py_INCREF(meta);
+
+    int64_t greatest_allocated_page = atomic_load_explicit((_Atomic (int64_t) *) &meta->greatest_allocated_page, memory_order_acquire);
+
+    for (int64_t page_i = 0; page_i <= greatest_allocated_page; ++page_i) {
+        Py_ssize_t count = 0;
+
+        for (uint64_t ix = (uint64_t) page_i << ATOMIC_DICT_LOG_ENTRIES_IN_PAGE; page_of(ix) == (uint64_t) page_i; ix++) {
+            AtomicDictEntry entry;
+            AtomicDictSearchResult result;
+
+            read_entry(get_entry_at(ix, meta), &entry);
+            if (entry.value == NULL || entry.key == NULL)
+                continue;
+
+            // skip entries that are being inserted
+            lookup_entry(meta, ix, entry.hash, &result);
+            if (!result.found)
+                continue;
+
+            if (!_Py_TryIncref(entry.key))
+                continue;
+            if (!_Py_TryIncref(entry.value)) {
+                Py_DECREF(entry.key);
+                continue;
+            }
+            int appended = PyList_Append(keys, entry.key) == 0 && PyList_Append(values, entry.value) == 0;
+            Py_DECREF(entry.key);
+            Py_DECREF(entry.value);
+            if (!appended)
+                goto fail;
+            hashes[count++] = entry.hash;
+        }
+
+        if (count == 0)
+            continue;
+
+        if (dump_record(write, dumps, dumps_kwargs, buffers, hashes, keys, values) < 0)
+            goto fail;
+        if (PyList_SetSlice(keys, 0, PY_SSIZE_T_MAX, NULL) < 0)
+            goto fail;
+        if (PyList_SetSlice(values, 0, PY_SSIZE_T_MAX, NULL) < 0)
+            goto fail;
+    }
+
+    // the empty record
+    Py_SETREF(header, PyBytes_FromStringAndSize("\0\0\0\0\0\0\0\0", 8));
+    if (header == NULL)
+        goto fail;
+    if (dump_write(write, header) < 0)
+        goto fail;
+
+    Py_DECREF(write);
+    Py_DECREF(pickle);
+    Py_DECREF(dumps);
+    Py_DECREF(dumps_kwargs);
+    Py_DECREF(buffers);
+    Py_DECREF(buffers_append);
+    Py_DECREF(approx_len);
+    Py_DECREF(header);
+    Py_DECREF(keys);
+    Py_DECREF(values);
+    Py_DECREF(meta);
+    Py_RETURN_NONE;
+    fail:
+    Py_XDECREF(write);
+    Py_XDECREF(pickle);
+    Py_XDECREF(dumps);
+    Py_XDECREF(dumps_kwargs);
+    Py_XDECREF(buffers);
+    Py_XDECREF(buffers_append);
+    Py_XDECREF(approx_len);
+    Py_XDECREF(header);
+    Py_XDECREF(keys);
+    Py_XDECREF(values);
+    Py_XDECREF(meta);
+    return NULL;
+}
+
+static PyObject *
+load_read(PyObject *readinto, uint64_t size)
+{
+    // returns a new bytearray of exactly size bytes
+    PyObject *buffer = NULL;
+    PyObject *view = NULL;
+    PyObject *chunk = NULL;
+    PyObject *read = NULL;
+
+    if (size > (uint64_t) PY_SSIZE_T_MAX) {
+        PyErr_SetString(PyExc_ValueError, "AtomicDict dump is corrupted.");
+        goto fail;
+    }
+
+    buffer = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t) size);
+    if (buffer == NULL)
+        goto fail;
+    view = PyMemoryView_FromObject(buffer);
+    if (view == NULL)
+        goto fail;
+
+    Py_ssize_t offset = 0;
+    while (offset < (Py_ssize_t) size) {
+        chunk = PySequence_GetSlice(view, offset, (Py_ssize_t) size);
+        if (chunk == NULL)
+            goto fail;
+        read = PyObject_CallOneArg(readinto, chunk);
+        if (read == NULL)
+            goto fail;
+        Py_CLEAR(chunk);
+
+        if (read == Py_None) {
+            PyErr_SetString(PyExc_BlockingIOError, "could not read AtomicDict dump from a non-blocking file.");
+            goto fail;
+        }
+        Py_ssize_t n = PyNumber_AsSsize_t(read, PyExc_OverflowError);
+        if (n == -1 && PyErr_Occurred())
+            goto fail;
+        if (n <= 0) {
+            PyErr_SetString(PyExc_EOFError, "AtomicDict dump is truncated.");
+            goto fail;
+        }
+        Py_CLEAR(read);
+        offset += n;
+    }
+
+    Py_DECREF(view);
+    return buffer;
+    fail:
+    Py_XDECREF(read);
+    Py_XDECREF(chunk);
+    Py_XDECREF(view);
+    Py_XDECREF(buffer);
+    return NULL;
+}
+
+static int
+load_record(AtomicDictBulkLoad *bl, PyObject *readinto, PyObject *loads, uint64_t count, int rehash)
+{
+    PyObject *metadata = NULL;
+    PyObject *sizes = NULL;
+    PyObject *pickled = NULL;
+    PyObject *buffers = NULL;
+    PyObject *buffer = NULL;
+    PyObject *loads_args = NULL;
+    PyObject *loads_kwargs = NULL;
+    PyObject *items = NULL;
+
+    if (count > ATOMIC_DICT_ENTRIES_IN_PAGE) {
+        PyErr_SetString(PyExc_ValueError, "AtomicDict dump is corrupted.");
+        goto fail;
+    }
+
+    // hashes, pickle size, and buffers count
+    metadata = load_read(readinto, 8 * (count + 2));
+    if (metadata == NULL)
+        goto fail;
+    const char *hashes = PyByteArray_AS_STRING(metadata);
+    const uint64_t pickle_size = load_le64(hashes + 8 * count);
+    const uint64_t buffers_count = load_le64(hashes + 8 * (count + 1));
+
+    if (buffers_count > (uint64_t) PY_SSIZE_T_MAX / 8) {
+        PyErr_SetString(PyExc_ValueError, "AtomicDict dump is corrupted.");
+        goto fail;
+    }
+    sizes = load_read(readinto, 8 * buffers_count);
+    if (sizes == NULL)
+        goto fail;
+    pickled = load_read(readinto, pickle_size);
+    if (pickled == NULL)
+        goto fail;
+
+    buffers = PyList_New((Py_ssize_t) buffers_count);
+    if (buffers == NULL)
+        goto fail;
+    for (uint64_t i = 0; i < buffers_count; i++) {
+        buffer = load_read(readinto, load_le64(PyByteArray_AS_STRING(sizes) + 8 * i));
+        if (buffer == NULL)
+            goto fail;
+        PyList_SET_ITEM(buffers, (Py_ssize_t) i, buffer);
+        buffer = NULL;
+    }
+
+    loads_args = PyTuple_Pack(1, pickled);
+    if (loads_args == NULL)
+        goto fail;
+    loads_kwargs = Py_BuildValue("{s:O}", "buffers", buffers);
+    if (loads_kwargs == NULL)
+        goto fail;
+    items = PyObject_Call(loads, loads_args, loads_kwargs);
+    if (items == NULL)
+        goto fail;
+
+    if (!PyTuple_CheckExact(items) || PyTuple_GET_SIZE(items) != 2
+        || !PyList_CheckExact(PyTuple_GET_ITEM(items, 0)) || !PyList_CheckExact(PyTuple_GET_ITEM(items, 1))
+        || (uint64_t) PyList_GET_SIZE(PyTuple_GET_ITEM(items, 0)) != count
+        || (uint64_t) PyList_GET_SIZE(PyTuple_GET_ITEM(items, 1)) != count) {
+        PyErr_SetString(PyExc_ValueError, "AtomicDict dump is corrupted.");
+        goto fail;
+    }
+    PyObject *keys = PyTuple_GET_ITEM(items, 0);
+    PyObject *values = PyTuple_GET_ITEM(items, 1);
+
+    for (Py_ssize_t i = 0; i < (Py_ssize_t) count; i++) {
+        PyObject *key = PyList_GET_ITEM(keys, i);
+        Py_hash_t hash;
+
+        int portable = rehash ? 0 : load_hash_is_portable(key, 0);
+        if (portable < 0)
+            goto fail;
+
+        if (!portable) {
+            hash = PyObject_Hash(key);
+            if (hash == -1)
+                goto fail;
+        } else {
+            hash = (Py_hash_t) load_le64(hashes + 8 * i);
+            if (hash == -1) {
+                PyErr_SetString(PyExc_ValueError, "AtomicDict dump is corrupted.");
+                goto fail;
+            }
+        }
+
+        if (bulk_push_hashed(bl, key, hash, PyList_GET_ITEM(values, i)) < 0)
+            goto fail;
+    }
+
+    Py_DECREF(metadata);
+    Py_DECREF(sizes);
+    Py_DECREF(pickled);
+    Py_DECREF(buffers);
+    Py_DECREF(loads_args);
+    Py_DECREF(loads_kwargs);
+    Py_DECREF(items);
+    return 0;
+    fail:
+    Py_XDECREF(metadata);
+    Py_XDECREF(sizes);
+    Py_XDECREF(pickled);
+    Py_XDECREF(buffers);
+    Py_XDECREF(buffer);
+    Py_XDECREF(loads_args);
+    Py_XDECREF(loads_kwargs);
+    Py_XDECREF(items);
+    return -1;
+}
+
+PyObject *
+AtomicDict_Load(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    PyObject *fileobj = NULL;
+    PyObject *readinto = NULL;
+    PyObject *pickle = NULL;
+    PyObject *loads = NULL;
+    PyObject *header = NULL;
+    PyObject *record = NULL;
+    AtomicDict *self = NULL;
+    AtomicDictBulkLoad *bl = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &fileobj))
+        goto fail;
+
+    readinto = PyObject_GetAttrString(fileobj, "readinto");
+    if (readinto == NULL)
+        goto fail;
+
+    pickle = PyImport_ImportModule("pickle");
+    if (pickle == NULL)
+        goto fail;
+    loads = PyObject_GetAttrString(pickle, "loads");
+    if (loads == NULL)
+        goto fail;
+
+    header = load_read(readinto, ATOMIC_DICT_DUMP_HEADER_SIZE);
+    if (header == NULL)
+        goto fail;
+    const char *h = PyByteArray_AS_STRING(header);
+    if (memcmp(h, ATOMIC_DICT_DUMP_MAGIC, 8) != 0) {
+        PyErr_SetString(PyExc_ValueError, "not an AtomicDict dump.");
+        goto fail;
+    }
+    if (load_le64(h + 8) != ATOMIC_DICT_DUMP_VERSION) {
+        PyErr_Format(PyExc_ValueError, "unsupported AtomicDict dump version: %llu.",
+                     (unsigned long long) load_le64(h + 8));
+        goto fail;
+    }
+
+    Py_hash_t fingerprint;
+    if (dump_fingerprint(&fingerprint) < 0)
+        goto fail;
+    const int rehash = (Py_hash_t) load_le64(h + 16) != fingerprint;
+
+    uint64_t size_hint = load_le64(h + 24);
+    if (size_hint > 1ull << ATOMIC_DICT_MAX_LOG_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "AtomicDict dump is corrupted.");
+        goto fail;
+    }
+
+    // all keyword arguments are passed on to the constructor
+    self = construct(cls, kwargs);
+    if (self == NULL)
+        goto fail;
+
+    bl = bulk_new(self, (Py_ssize_t) size_hint);
+    if (bl == NULL)
+        goto fail;
+
+    for (;;) {
+        record = load_read(readinto, 8);
+        if (record == NULL)
+            goto fail;
+        const uint64_t count = load_le64(PyByteArray_AS_STRING(record));
+        Py_CLEAR(record);
+        if (count == 0)
+            break;
+
+        if (load_record(bl, readinto, loads, count, rehash) < 0)
+            goto fail;
+    }
+
+    if (bulk_finish(self, bl) < 0)
+        goto fail;
+    bl = NULL;
+
+    Py_DECREF(readinto);
+    Py_DECREF(pickle);
+    Py_DECREF(loads);
+    Py_DECREF(header);
+    return (PyObject *) self;
+
+    fail:
+    if (bl != NULL) {
+        bulk_free(bl);
+    }
+    Py_XDECREF(readinto);
+    Py_XDECREF(pickle);
+    Py_XDECREF(loads);
+    Py_XDECREF(header);
+    Py_XDECREF(record);
+    Py_XDECREF(self);
+    return NULL;
+}
@@ -3,7 +3,9 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <stdatomic.h>
+#include <cereggii/constants.h>
 #include <cereggii/internal/atomic_dict.h>
+#include <cereggii/vendor/pythoncapi_compat/pythoncapi_compat.h>
 
 
 void
@@ -43,8 +45,14 @@ delete_(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash, AtomicDictSearchRes
     cereggii_unused_in_release_build(ok);
 }
 
-int
-AtomicDict_DelItem(AtomicDict *self, PyObject *key)
+/**
+ * Remove key from the dictionary.
+ * Returns 1 if it was removed, 0 if it was not found, or -1 on error.
+ * When popped is not NULL, the reference to the removed value is handed
+ * over to the caller through it.
+ **/
+static int
+delete_item(AtomicDict *self, PyObject *key, PyObject **popped)
 {
     assert(key != NULL);
 
@@ -75,21 +83,310 @@ AtomicDict_DelItem(AtomicDict *self, PyObject *key)
     }
     if (!result.found) {
         PyMutex_Unlock(&storage->self_mutex);
-        PyObject *error = PyObject_CallOneArg(PyExc_KeyError, key);
-        if (error != NULL) {
-            PyErr_SetObject(PyExc_KeyError, error);
-            Py_DECREF(error);
-        }
-        goto fail;
+        return 0;
     }
     accessor_len_inc(self, storage, -1);
     accessor_tombstones_inc(self, storage, 1);
+    int tombstones_increased_significantly = storage->local_tombstones % meta->log_size == 0;
     PyMutex_Unlock(&storage->self_mutex);
     Py_DECREF(result.entry.key);
-    Py_DECREF(result.entry.value);
+    if (popped != NULL) {
+        *popped = result.entry.value;
+    } else {
+        Py_DECREF(result.entry.value);
+    }
+
+    if (tombstones_increased_significantly) {
+        if (should_shrink(self, meta)) {
+            if (compact(self) < 0)
+                goto fail_popped;
+        } else if (should_purge(self, meta)) {
+            if (purge(self) < 0)
+                goto fail_popped;
+        }
+    }
+
+    return 1;
+
+    fail_popped:
+    if (popped != NULL) {
+        Py_CLEAR(*popped);
+    }
+    fail:
+    return -1;
+}
 
+static void
+set_key_error(PyObject *key)
+{
+    PyObject *error = PyObject_CallOneArg(PyExc_KeyError, key);
+    if (error != NULL) {
+        PyErr_SetObject(PyExc_KeyError, error);
+        Py_DECREF(error);
+    }
+}
+
+int
+AtomicDict_DelItem(AtomicDict *self, PyObject *key)
+{
+    int deleted = delete_item(self, key, NULL);
+    if (deleted < 0)
+        return -1;
+    if (!deleted) {
+        set_key_error(key);
+        return -1;
+    }
+    return 0;
+}
+
+PyObject *
+AtomicDict_Pop(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *key = NULL;
+    PyObject *default_value = NULL;
+    PyObject *popped = NULL;
+
+    char *kw_list[] = {"key", "default", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kw_list, &key, &default_value))
+        return NULL;
+
+    int deleted = delete_item(self, key, &popped);
+    if (deleted < 0)
+        return NULL;
+    if (deleted)
+        return popped;
+
+    if (default_value == NULL) {
+        set_key_error(key);
+        return NULL;
+    }
+    return Py_NewRef(default_value);
+}
+
+
+// batched deletions.
+//
+// keys are collected in chunks: for each chunk, the index slots and then the
+// entries that the keys will probe are prefetched, like in AtomicDict_BatchGetItem.
+// then all the keys of the chunk are deleted while holding the accessor's
+// lock, and the counters are updated once per chunk.
+
+typedef struct AtomicDictDeleteBatch {
+    Py_ssize_t len;
+    Py_ssize_t chunk_size;
+    Py_hash_t *hashes;
+    PyObject **keys;
+    PyObject **deleted_keys;  // the keys that were stored in the entries
+    PyObject **deleted_values;
+} AtomicDictDeleteBatch;
+
+static int
+batch_delete_chunk(AtomicDict *self, AtomicDictAccessorStorage *storage, AtomicDictDeleteBatch *batch, int32_t *deleted)
+{
+    AtomicDictMeta *meta = NULL;
+    AtomicDictSearchResult result;
+    *deleted = 0;
+
+    for (Py_ssize_t i = 0; i < batch->len; ++i) {
+        batch->deleted_keys[i] = NULL;
+        batch->deleted_values[i] = NULL;
+    }
+
+    beginning:
+    meta = get_meta(self, storage);
+    if (meta == NULL)
+        return -1;
+
+    for (Py_ssize_t i = 0; i < batch->len; ++i) {
+        cereggii_prefetch(&meta->index[distance0_of(batch->hashes[i], meta)]);
+    }
+    prefetch_entries(meta, batch->hashes, batch->len);
+
+    if (lock_accessor_storage_or_help_resize(self, storage, meta))
+        goto beginning;
+
+    int ok = 0;
+    for (Py_ssize_t i = 0; i < batch->len; ++i) {
+        delete_(meta, batch->keys[i], batch->hashes[i], &result);
+        if (result.error) {
+            ok = -1;
+            break;
+        }
+        if (result.found) {
+            batch->deleted_keys[i] = result.entry.key;
+            batch->deleted_values[i] = result.entry.value;
+            (*deleted)++;
+        }
+    }
+
+    int tombstones_increased_significantly = 0;
+    if (*deleted > 0) {
+        int64_t before = storage->local_tombstones;
+        accessor_len_inc(self, storage, -*deleted);
+        accessor_tombstones_inc(self, storage, *deleted);
+        tombstones_increased_significantly = before / meta->log_size != storage->local_tombstones / meta->log_size;
+    }
+    PyMutex_Unlock(&storage->self_mutex);
+
+    if (ok < 0)
+        return -1;
+
+    if (tombstones_increased_significantly) {
+        if (should_shrink(self, meta)) {
+            if (compact(self) < 0)
+                return -1;
+        } else if (should_purge(self, meta)) {
+            if (purge(self) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+batch_delete_flush(AtomicDict *self, AtomicDictAccessorStorage *storage, AtomicDictDeleteBatch *batch,
+                   PyObject *popped, PyObject *default_value, Py_ssize_t *deleted)
+{
+    int32_t chunk_deleted = 0;
+    int ok = batch_delete_chunk(self, storage, batch, &chunk_deleted);
+    *deleted += chunk_deleted;
+
+    // references are released after having unlocked the accessor storage:
+    // destructors may run arbitrary code.
+    for (Py_ssize_t i = 0; i < batch->len; ++i) {
+        if (ok == 0 && popped != NULL) {
+            PyObject *value = batch->deleted_values[i] != NULL ? batch->deleted_values[i] : default_value;
+            if (PyList_Append(popped, value) < 0) {
+                ok = -1;
+            }
+        }
+        Py_XDECREF(batch->deleted_keys[i]);
+        Py_XDECREF(batch->deleted_values[i]);
+        Py_DECREF(batch->keys[i]);
+    }
+    batch->len = 0;
+
+    return ok;
+}
+
+static int
+batch_delete(AtomicDict *self, PyObject *keys, Py_ssize_t chunk_size, PyObject *popped, PyObject *default_value,
+             Py_ssize_t *deleted)
+{
+    PyObject *iterator = NULL;
+    PyObject *key = NULL;
+    AtomicDictDeleteBatch batch = {
+        .len = 0,
+        .chunk_size = chunk_size,
+    };
+    *deleted = 0;
+
+    AtomicDictAccessorStorage *storage = get_or_create_accessor_storage(self);
+    if (storage == NULL)
+        goto fail;
+
+    batch.hashes = PyMem_RawMalloc(chunk_size * sizeof(Py_hash_t));
+    batch.keys = PyMem_RawMalloc(chunk_size * sizeof(PyObject *));
+    batch.deleted_keys = PyMem_RawMalloc(chunk_size * sizeof(PyObject *));
+    batch.deleted_values = PyMem_RawMalloc(chunk_size * sizeof(PyObject *));
+    if (batch.hashes == NULL || batch.keys == NULL || batch.deleted_keys == NULL || batch.deleted_values == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    iterator = PyObject_GetIter(keys);
+    if (iterator == NULL)
+        goto fail;
+
+    while (PyIter_NextItem(iterator, &key) == 1) {
+        Py_hash_t hash = PyObject_Hash(key);
+        if (hash == -1)
+            goto fail;
+
+        batch.hashes[batch.len] = hash;
+        batch.keys[batch.len] = key;  // steals the reference
+        key = NULL;
+        batch.len++;
+
+        if (batch.len == batch.chunk_size) {
+            if (batch_delete_flush(self, storage, &batch, popped, default_value, deleted) < 0)
+                goto fail;
+        }
+    }
+    if (PyErr_Occurred())
+        goto fail;
+
+    if (batch_delete_flush(self, storage, &batch, popped, default_value, deleted) < 0)
+        goto fail;
+
+    Py_DECREF(iterator);
+    PyMem_RawFree(batch.hashes);
+    PyMem_RawFree(batch.keys);
+    PyMem_RawFree(batch.deleted_keys);
+    PyMem_RawFree(batch.deleted_values);
     return 0;
 
     fail:
+    for (Py_ssize_t i = 0; i < batch.len; ++i) {
+        Py_DECREF(batch.keys[i]);
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(iterator);
+    PyMem_RawFree(batch.hashes);
+    PyMem_RawFree(batch.keys);
+    PyMem_RawFree(batch.deleted_keys);
+    PyMem_RawFree(batch.deleted_values);
     return -1;
 }
+
+PyObject *
+AtomicDict_BatchDelItem(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *keys = NULL;
+    Py_ssize_t chunk_size = 128;
+    Py_ssize_t deleted = 0;
+
+    char *kw_list[] = {"keys", "chunk_size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", kw_list, &keys, &chunk_size))
+        return NULL;
+
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size <= 0");
+        return NULL;
+    }
+
+    if (batch_delete(self, keys, chunk_size, NULL, NULL, &deleted) < 0)
+        return NULL;
+
+    return PyLong_FromSsize_t(deleted);
+}
+
+PyObject *
+AtomicDict_PopMany(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *keys = NULL;
+    PyObject *default_value = NOT_FOUND;
+    Py_ssize_t chunk_size = 128;
+    Py_ssize_t deleted = 0;
+
+    char *kw_list[] = {"keys", "default", "chunk_size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|On", kw_list, &keys, &default_value, &chunk_size))
+        return NULL;
+
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size <= 0");
+        return NULL;
+    }
+
+    PyObject *popped = PyList_New(0);
+    if (popped == NULL)
+        return NULL;
+
+    if (batch_delete(self, keys, chunk_size, popped, default_value, &deleted) < 0) {
+        Py_DECREF(popped);
+        return NULL;
+    }
+
+    return popped;
+}
@@ -4,6 +4,7 @@
 
 #define PY_SSIZE_T_CLEAN
 
+#include <math.h>
 #include <stdatomic.h>
 #include <cereggii/constants.h>
 #include <cereggii/internal/atomic_dict.h>
@@ -38,6 +39,7 @@ expected_update_entry(AtomicDictMeta *meta, uint64_t entry_ix,
 
     if (expected == NOT_FOUND) {
         assert(entry.value != NULL);
+        *current = entry.value;
         *done = 1;
         *expectation = 0;
         return 1;
@@ -70,11 +72,15 @@ expected_update_entry(AtomicDictMeta *meta, uint64_t entry_ix,
 }
 
 
-PyObject *
-expected_insert_or_update(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash,
-                                  PyObject *expected, PyObject *desired,
-                                  AtomicDictEntryLoc *entry_loc, int *must_grow,
-                                  int skip_entry_check)
+/**
+ * Like expected_insert_or_update, but when expected == NOT_FOUND and the key
+ * is already present, *found is set to its current value (borrowed).
+ **/
+static PyObject *
+insert_or_update(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash,
+                 PyObject *expected, PyObject *desired,
+                 AtomicDictEntryLoc *entry_loc, int *must_grow,
+                 int skip_entry_check, PyObject **found)
 {
     assert(meta != NULL);
     assert(key != NULL);
@@ -167,6 +173,10 @@ expected_insert_or_update(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash,
         //   - should decref because it has just been removed from the dict
         return current;
     }
+    if (found != NULL && expected == NOT_FOUND) {
+        assert(current != NULL);
+        *found = current;
+    }
     Py_INCREF(EXPECTATION_FAILED);
     return EXPECTATION_FAILED;
 
@@ -174,6 +184,15 @@ fail:
     return NULL;
 }
 
+PyObject *
+expected_insert_or_update(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash,
+                                  PyObject *expected, PyObject *desired,
+                                  AtomicDictEntryLoc *entry_loc, int *must_grow,
+                                  int skip_entry_check)
+{
+    return insert_or_update(meta, key, hash, expected, desired, entry_loc, must_grow, skip_entry_check, NULL);
+}
+
 PyObject *
 AtomicDict_CompareAndSet(AtomicDict *self, PyObject *key, PyObject *expected, PyObject *desired)
 {
@@ -236,7 +255,7 @@ AtomicDict_CompareAndSet(AtomicDict *self, PyObject *key, PyObject *expected, Py
         }
         if (got_entry == 0) {  // => must grow
             PyMutex_Unlock(&storage->self_mutex);
-            resized = grow(self);
+            resized = grow_or_compact(self);
 
             if (resized < 0)
                 goto fail;
@@ -272,6 +291,9 @@ AtomicDict_CompareAndSet(AtomicDict *self, PyObject *key, PyObject *expected, Py
             Py_DECREF(key);  // for the previous _Py_SetWeakrefAndIncref
         }
         // on exception, key will be decref'ed in fail: block
+    } else if (entry_loc.location == 0 && result != NULL) {
+        // no entry was reserved: the key is never stored
+        Py_DECREF(key);
     }
 
     int inserted_increased_significantly = 0;
@@ -294,7 +316,7 @@ AtomicDict_CompareAndSet(AtomicDict *self, PyObject *key, PyObject *expected, Py
         max_fill_ratio_approx_reached = approx_inserted(self) >= SIZE_OF(meta) * 2 / 3;
     }
     if (must_grow || max_fill_ratio_approx_reached) {
-        resized = grow(self);
+        resized = grow_or_compact(self);
         if (resized < 0)
             goto fail;
         if (must_grow) {  // insertion didn't happen
@@ -302,6 +324,9 @@ AtomicDict_CompareAndSet(AtomicDict *self, PyObject *key, PyObject *expected, Py
         }
     }
 
+    if (result == EXPECTATION_FAILED) {
+        Py_DECREF(desired);  // it wasn't stored
+    }
     return result;
     fail:
     Py_DECREF(key);
@@ -367,228 +392,1795 @@ AtomicDict_SetItem(AtomicDict *self, PyObject *key, PyObject *value)
     return -1;
 }
 
-
-static inline int
-flush_one(AtomicDict *self, PyObject *key, PyObject *expected, PyObject *new, PyObject *aggregate, PyObject *(*specialized)(PyObject *, PyObject *, PyObject *), int is_specialized)
+/**
+ * Insert value for key, unless key is already in the dictionary.
+ * Returns a new reference to the value associated with key: either value
+ * itself, or the one that was already present.
+ * Both the insertion and the retrieval happen in the same probe.
+ **/
+static PyObject *
+insert_or_get(AtomicDict *self, PyObject *key, PyObject *value)
 {
-    assert(key != NULL);
-    assert(expected != NULL);
-    assert(new != NULL);
-    assert(expected == NOT_FOUND);
+    assert(key != NOT_FOUND && key != ANY && key != EXPECTATION_FAILED);
+    assert(value != NOT_FOUND && value != ANY && value != EXPECTATION_FAILED);
 
-    Py_INCREF(key);
-    Py_INCREF(expected);
-    Py_INCREF(new);
+    PyObject *found = NULL;
+    _Py_SetWeakrefAndIncref(key);
+    _Py_SetWeakrefAndIncref(value);
 
-    PyObject *previous = NULL;
-    PyObject *current = NULL;
-    PyObject *desired = new;
-    PyObject *new_desired = NULL;
+    AtomicDictMeta *meta = NULL;
 
-    while (1) {
-        current = AtomicDict_GetItemOrDefault(self, key, NOT_FOUND);
-        if (current == NULL)  // the lookup raised (e.g. a colliding key's __eq__)
+    Py_hash_t hash = PyObject_Hash(key);
+    if (hash == -1)
+        goto fail;
+    AtomicDictAccessorStorage *storage = NULL;
+    storage = get_or_create_accessor_storage(self);
+    if (storage == NULL)
+        goto fail;
+
+    beginning:
+    meta = get_meta(self, storage);
+    if (meta == NULL)
+        goto fail;
+    int resized = lock_accessor_storage_or_help_resize(self, storage, meta);
+    if (resized) {
+        goto beginning;
+    }
+
+    AtomicDictEntryLoc entry_loc = {
+        .entry = NULL,
+        .location = 0,
+    };
+    int got_entry = get_empty_entry(self, meta, &storage->reservation_buffer, &entry_loc, hash);
+    if (got_entry == -1) {
+        PyMutex_Unlock(&storage->self_mutex);
+        goto fail;
+    }
+    if (got_entry == 0) {  // => must grow
+        PyMutex_Unlock(&storage->self_mutex);
+        resized = grow_or_compact(self);
+
+        if (resized < 0)
             goto fail;
 
-        if (current == expected) {
-            previous = AtomicDict_CompareAndSet(self, key, expected, desired);
-            if (previous == NULL)
-                goto fail;
-            if (previous != EXPECTATION_FAILED) {
-                break;
-            }
-        }
+        goto beginning;
+    }
 
-        // the aggregate function must always be called with `new`, not `desired`
-        new_desired = NULL;
-        if (is_specialized) {
-            new_desired = specialized(key, current, new);
-        } else {
-            new_desired = PyObject_CallFunctionObjArgs(aggregate, key, current, new, NULL);
+    atomic_store_explicit((_Atomic(PyObject *) *) &entry_loc.entry->key, key, memory_order_release);
+    atomic_store_explicit((_Atomic(Py_hash_t) *) &entry_loc.entry->hash, hash, memory_order_release);
+    atomic_store_explicit((_Atomic(PyObject *) *) &entry_loc.entry->value, value, memory_order_release);
+
+    int must_grow;
+    found = NULL;
+    PyObject *result = insert_or_update(meta, key, hash, NOT_FOUND, value, &entry_loc, &must_grow, 0, &found);
+
+    if (result != NOT_FOUND) {  // the key was already present (or exception occurred)
+        uint8_t flags = atomic_load_explicit((_Atomic (uint8_t) *) &entry_loc.entry->flags, memory_order_acquire);
+        atomic_store_explicit((_Atomic (uint8_t) *) &entry_loc.entry->flags, flags & ENTRY_FLAGS_RESERVED, memory_order_release);
+        atomic_store_explicit((_Atomic (PyObject *) *) &entry_loc.entry->key, NULL, memory_order_release);
+        atomic_store_explicit((_Atomic (PyObject *) *) &entry_loc.entry->value, NULL, memory_order_release);
+        atomic_store_explicit((_Atomic (Py_hash_t) *) &entry_loc.entry->hash, 0, memory_order_release);
+        reservation_buffer_put_back_one(&storage->reservation_buffer);
+    }
+
+    int inserted_increased_significantly = 0;
+    if (result == NOT_FOUND) {
+        accessor_len_inc(self, storage, 1);
+        accessor_inserted_inc(self, storage, 1);
+        if (storage->local_inserted % meta->log_size == 0) {
+            inserted_increased_significantly = 1;
         }
-        if (new_desired == NULL)
-            goto fail;
+        // the dictionary owns the reference taken above, this one is for the caller
+        Py_INCREF(value);
+        found = value;
+    } else if (result == EXPECTATION_FAILED) {
+        if (!_Py_TryIncref(found)) {
+            found = NULL;  // it's being removed concurrently
+        }
+    }
+    PyMutex_Unlock(&storage->self_mutex);
 
-        Py_DECREF(expected);
-        expected = current;
-        current = NULL;
-        Py_DECREF(desired);
-        desired = new_desired;
-        new_desired = NULL;
+    if (result == NULL && !must_grow)
+        goto fail;
+
+    if (result == EXPECTATION_FAILED) {
+        Py_DECREF(result);
+        if (found == NULL)
+            goto beginning;
+        Py_DECREF(key);
+        Py_DECREF(value);
+        return found;
     }
-    Py_XDECREF(previous);
-    Py_XDECREF(key);
-    if (current != expected) {
-        Py_XDECREF(current);
+
+    int max_fill_ratio_approx_reached = 0;
+    if (inserted_increased_significantly) {
+        max_fill_ratio_approx_reached = approx_inserted(self) >= SIZE_OF(meta) * 2 / 3;
     }
-    Py_XDECREF(expected);
-    if (desired != new) {
-        Py_DECREF(desired);
+    if (must_grow || max_fill_ratio_approx_reached) {
+        resized = grow_or_compact(self);
+        if (resized < 0) {
+            if (must_grow)
+                goto fail;
+            // the item was inserted: key and value belong to the dictionary
+            Py_XDECREF(result);
+            Py_DECREF(found);
+            return NULL;
+        }
+        if (must_grow) {  // insertion didn't happen
+            goto beginning;
+        }
     }
-    Py_XDECREF(new);
-    return 0;
+
+    Py_DECREF(result);
+    return found;
     fail:
-    return -1;
+    Py_DECREF(key);
+    Py_DECREF(value);
+    return NULL;
 }
 
+PyObject *
+AtomicDict_SetDefault(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *key = NULL;
+    PyObject *default_value = NULL;
+
+    char *kw_list[] = {"key", "default", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kw_list, &key, &default_value))
+        return NULL;
 
-static inline int
-reduce_flush(AtomicDict *self, ReduceTable *local_buffer, PyObject *aggregate, PyObject *(*specialized)(PyObject *, PyObject *, PyObject *), int is_specialized)
+    if (default_value == NULL) {
+        default_value = Py_None;
+    }
+    if (key == NOT_FOUND || key == ANY || key == EXPECTATION_FAILED) {
+        PyErr_SetString(PyExc_ValueError, "key in (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+        return NULL;
+    }
+    if (default_value == NOT_FOUND || default_value == ANY || default_value == EXPECTATION_FAILED) {
+        PyErr_SetString(PyExc_ValueError, "default in (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+        return NULL;
+    }
+
+    return insert_or_get(self, key, default_value);
+}
+
+PyObject *
+AtomicDict_GetOrInsert(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
-    if (local_buffer->used == 0)
-        return 0;
+    PyObject *key = NULL;
+    PyObject *factory = NULL;
+    PyObject *value = NULL;
+    PyObject *result = NULL;
 
-    uint64_t start = REHASH(_Py_ThreadId()) % local_buffer->used;
-    // start is a pseudo random number, distinct per thread.
-    // this can help reduce contention when multiple threads
-    // are flushing a large-enough set of distinct keys.
-    for (uint64_t i = 0; i < local_buffer->used; i++) {
-        uint64_t index = (start + i) % local_buffer->used;
-        ReduceTableEntry *entry = &local_buffer->entries[index];
-        int result = flush_one(self, entry->key, entry->expected, entry->desired, aggregate, specialized, is_specialized);
-        if (result < 0) {
-            return -1;
-        }
+    char *kw_list[] = {"key", "factory", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", kw_list, &key, &factory))
+        goto fail;
+
+    if (key == NOT_FOUND || key == ANY || key == EXPECTATION_FAILED) {
+        PyErr_SetString(PyExc_ValueError, "key in (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+        goto fail;
     }
-    return 0;
+    if (!PyCallable_Check(factory)) {
+        PyErr_Format(PyExc_TypeError, "factory=%R is not callable", factory);
+        goto fail;
+    }
+
+    // the factory is only called when the key is missing: it can't be
+    // called while holding this thread's accessor lock, because it may
+    // access this same dictionary.
+    result = AtomicDict_GetItemOrDefault(self, key, NOT_FOUND);
+    if (result == NULL)
+        goto fail;
+    if (result != NOT_FOUND)
+        return result;
+    Py_CLEAR(result);
+
+    value = PyObject_CallNoArgs(factory);
+    if (value == NULL)
+        goto fail;
+    if (value == NOT_FOUND || value == ANY || value == EXPECTATION_FAILED) {
+        PyErr_SetString(PyExc_ValueError, "factory() in (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+        goto fail;
+    }
+
+    // another thread may have inserted key in the meantime, then its value is returned
+    result = insert_or_get(self, key, value);
+    Py_DECREF(value);
+    return result;
+
+    fail:
+    Py_XDECREF(value);
+    return NULL;
 }
 
+
+/**
+ * Atomically replace the value of key with fn(value), where value is the
+ * current value of key, or default_value if key is missing.
+ * On success, *previous and *updated are set to new references to the
+ * values before and after the update.
+ *
+ * fn is called without holding this thread's accessor lock, because it may
+ * access this same dictionary. The new value is then set with a CAS on the
+ * entry found by the first lookup, so that retrying after a conflicting
+ * update does not probe the index again, unless a migration happened.
+ **/
 static int
-AtomicDict_Reduce_impl(AtomicDict *self, PyObject *iterable, PyObject *aggregate,
-    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *), const int is_specialized)
+update_by_callable(AtomicDict *self, PyObject *key, PyObject *fn, PyObject *default_value,
+                   PyObject **previous, PyObject **updated)
 {
-    // is_specialized => specialized != NULL
-    assert(!is_specialized || specialized != NULL);
-    // !is_specialized => aggregate != NULL
-    assert(is_specialized || aggregate != NULL);
+    assert(key != NULL);
+    assert(fn != NULL);
 
-    PyObject *item = NULL;
-    PyObject *key = NULL;
-    PyObject *value = NULL;
     PyObject *current = NULL;
-    PyObject *expected = NULL;
     PyObject *desired = NULL;
-    ReduceTable *local_buffer = NULL;
-    PyObject *iterator = NULL;
-    Py_hash_t hash = -1;
+    AtomicDictMeta *meta = NULL;
+    AtomicDictAccessorStorage *storage = NULL;
+    AtomicDictSearchResult result;
+    *previous = NULL;
+    *updated = NULL;
 
-    if (!is_specialized) {
-        if (!PyCallable_Check(aggregate)) {
-            PyErr_Format(PyExc_TypeError, "%R is not callable.", aggregate);
-            goto fail;
-        }
+    if (key == NOT_FOUND || key == ANY || key == EXPECTATION_FAILED) {
+        PyErr_SetString(PyExc_ValueError, "key in (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+        goto fail;
+    }
+    if (!PyCallable_Check(fn)) {
+        PyErr_Format(PyExc_TypeError, "%R is not callable.", fn);
+        goto fail;
     }
 
-    local_buffer = reduce_table_new(REDUCE_TABLE_INITIAL_LOG_SIZE);
-    if (local_buffer == NULL)
+    Py_hash_t hash = PyObject_Hash(key);
+    if (hash == -1)
+        goto fail;
+    storage = get_or_create_accessor_storage(self);
+    if (storage == NULL)
         goto fail;
 
-    iterator = PyObject_GetIter(iterable);
-    if (iterator == NULL) {
-        PyErr_Format(PyExc_TypeError, "%R is not iterable.", iterable);
+    beginning:
+    meta = get_meta(self, storage);
+    if (meta == NULL)
         goto fail;
-    }
-    if (iterable == iterator) {
-        // if iterable is already an iterator, then PyObject_GetIter returns
-        // its argument, without creating a new object.
-        // since there are calls to Py_DECREF(iterator) next, we need to ensure
-        // that we don't destroy the iterable, whose reference is borrowed.
-        Py_INCREF(iterable);
-    }
 
-    while (PyIter_NextItem(iterator, &item) == 1) {
-        if (!PyTuple_CheckExact(item)) {
-            PyErr_Format(PyExc_TypeError, "type(%R) != tuple", item);
+    result.entry.value = NULL;
+    lookup(meta, key, hash, &result);
+    if (result.error)
+        goto fail;
+
+    if (result.entry_p == NULL || result.entry.value == NULL) {
+        if (default_value == NOT_FOUND) {
+            PyObject *error = PyObject_CallOneArg(PyExc_KeyError, key);
+            if (error != NULL) {
+                PyErr_SetObject(PyExc_KeyError, error);
+                Py_DECREF(error);
+            }
             goto fail;
         }
 
-        if (PyTuple_Size(item) != 2) {
-            PyErr_Format(PyExc_TypeError, "len(%R) != 2", item);
+        current = Py_NewRef(default_value);
+        desired = PyObject_CallOneArg(fn, current);
+        if (desired == NULL)
+            goto fail;
+        if (desired == NOT_FOUND || desired == ANY || desired == EXPECTATION_FAILED) {
+            PyErr_SetString(PyExc_ValueError, "fn() returned one of (NOT_FOUND, ANY, EXPECTATION_FAILED)");
             goto fail;
         }
 
-        key = PyTuple_GetItem(item, 0);
-        Py_INCREF(key);
-        value = PyTuple_GetItem(item, 1);
-        Py_INCREF(value);
-
-        hash = PyObject_Hash(key);
-        if (hash == -1)
+        PyObject *inserted = AtomicDict_CompareAndSet(self, key, NOT_FOUND, desired);
+        if (inserted == NULL)
             goto fail;
+        if (inserted == EXPECTATION_FAILED) {
+            // the key was inserted concurrently
+            Py_DECREF(inserted);
+            Py_CLEAR(current);
+            Py_CLEAR(desired);
+            goto beginning;
+        }
+        assert(inserted == NOT_FOUND);
+        Py_DECREF(inserted);
+        goto success;
+    }
 
-        int found = reduce_table_get(local_buffer, key, hash, &expected, &current);
-        if (found < 0)
-            goto fail;
+    if (!_Py_TryIncref(result.entry.value))
+        goto beginning;
+    current = result.entry.value;
 
-        if (!found) {
-            expected = NOT_FOUND;
-            current = NOT_FOUND;
+    while (1) {
+        desired = PyObject_CallOneArg(fn, current);
+        if (desired == NULL)
+            goto fail;
+        if (desired == NOT_FOUND || desired == ANY || desired == EXPECTATION_FAILED) {
+            PyErr_SetString(PyExc_ValueError, "fn() returned one of (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+            goto fail;
         }
 
-        if (is_specialized) {
-            desired = specialized(key, current, value);
-        } else {
-            desired = PyObject_CallFunctionObjArgs(aggregate, key, current, value, NULL);
+        int resized = lock_accessor_storage_or_help_resize(self, storage, meta);
+        if (resized || self->metadata->reference != (PyObject *) meta) {
+            // the entry may have been moved: look it up again
+            if (!resized) {
+                PyMutex_Unlock(&storage->self_mutex);
+            }
+            Py_CLEAR(current);
+            Py_CLEAR(desired);
+            goto beginning;
         }
-        if (desired == NULL)
-            goto fail;
 
-        if (reduce_table_set(local_buffer, key, hash, expected, desired) < 0) {
-            goto fail;
+        _Py_SetWeakrefAndIncref(desired);
+        PyObject *expected = current;
+        int done = atomic_compare_exchange_strong_explicit((_Atomic (PyObject *) *) &result.entry_p->value,
+                                                           &expected, desired,
+                                                           memory_order_acq_rel, memory_order_acquire);
+        PyObject *witnessed = NULL;
+        if (!done && expected != NULL && _Py_TryIncref(expected)) {
+            witnessed = expected;
         }
-        Py_DECREF(item);
-    }
+        PyMutex_Unlock(&storage->self_mutex);
 
-    if (PyErr_Occurred())
-        goto fail;
+        if (done) {
+            Py_DECREF(current);  // the dictionary's reference
+            break;
+        }
 
-    int error = reduce_flush(self, local_buffer, aggregate, specialized, is_specialized);
-    if (error) {
-        goto fail;
+        Py_DECREF(desired);  // the dictionary's reference, taken above
+        Py_CLEAR(desired);
+        Py_CLEAR(current);
+        if (witnessed == NULL)  // the key was deleted concurrently
+            goto beginning;
+        current = witnessed;
     }
-    Py_DECREF(iterator);
-    reduce_table_free(local_buffer);
+
+    success:
+    *previous = current;
+    *updated = desired;
     return 0;
 
     fail:
-    if (local_buffer != NULL)
-        reduce_table_free(local_buffer);
-    Py_XDECREF(iterator);
-    Py_XDECREF(item);
-    Py_XDECREF(key);
-    Py_XDECREF(value);
+    Py_XDECREF(current);
     Py_XDECREF(desired);
     return -1;
 }
 
-int
-AtomicDict_Reduce(AtomicDict *self, PyObject *iterable, PyObject *aggregate)
+static PyObject *
+update_callable(AtomicDict *self, PyObject *args, PyObject *kwargs, int return_updated)
 {
-    return AtomicDict_Reduce_impl(self, iterable, aggregate, NULL, 0);
-}
+    PyObject *key = NULL;
+    PyObject *fn = NULL;
+    PyObject *default_value = NOT_FOUND;
+    PyObject *previous = NULL;
+    PyObject *updated = NULL;
+
+    char *kw_list[] = {"key", "fn", "default", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", kw_list, &key, &fn, &default_value))
+        return NULL;
+
+    if (update_by_callable(self, key, fn, default_value, &previous, &updated) < 0)
+        return NULL;
+
+    if (return_updated) {
+        Py_DECREF(previous);
+        return updated;
+    }
+    Py_DECREF(updated);
+    return previous;
+}
+
+PyObject *
+AtomicDict_UpdateAndGet(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return update_callable(self, args, kwargs, 1);
+}
+
+PyObject *
+AtomicDict_GetAndUpdate(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return update_callable(self, args, kwargs, 0);
+}
+
+
+// batched insertions.
+//
+// items are collected in chunks: for each chunk, the index slots and then the
+// entries that the keys will probe are prefetched, like in AtomicDict_BatchGetItem.
+// then all the items of the chunk are inserted while holding the accessor's
+// lock, so that a pending resize is checked for once per chunk.
+
+typedef struct AtomicDictBatch {
+    AtomicDict *self;
+    AtomicDictAccessorStorage *storage;
+    Py_ssize_t len;
+    Py_ssize_t chunk_size;
+    Py_hash_t *hashes;
+    PyObject **keys;
+    PyObject **values;
+} AtomicDictBatch;
+
+static void
+batch_prefetch(AtomicDictBatch *batch, Py_ssize_t from, AtomicDictMeta *meta)
+{
+    for (Py_ssize_t i = from; i < batch->len; ++i) {
+        cereggii_prefetch(&meta->index[distance0_of(batch->hashes[i], meta)]);
+    }
+
+    prefetch_entries(meta, batch->hashes + from, batch->len - from);
+}
+
+static int
+batch_insert_chunk(AtomicDictBatch *batch)
+{
+    AtomicDict *self = batch->self;
+    AtomicDictAccessorStorage *storage = batch->storage;
+    AtomicDictMeta *meta = NULL;
+    Py_ssize_t i = 0;
+    int32_t inserted = 0;
+    int must_grow = 0;
+
+    beginning:
+    meta = get_meta(self, storage);
+    if (meta == NULL)
+        goto fail;
+
+    batch_prefetch(batch, i, meta);
+
+    if (lock_accessor_storage_or_help_resize(self, storage, meta))
+        goto beginning;
+
+    inserted = 0;
+    must_grow = 0;
+    for (; i < batch->len; ++i) {
+        PyObject *key = batch->keys[i];
+        PyObject *value = batch->values[i];
+        Py_hash_t hash = batch->hashes[i];
+
+        AtomicDictEntryLoc entry_loc = {
+            .entry = NULL,
+            .location = 0,
+        };
+        int got_entry = get_empty_entry(self, meta, &storage->reservation_buffer, &entry_loc, hash);
+        if (got_entry == -1)
+            goto fail_locked;
+        if (got_entry == 0) {
+            must_grow = 1;
+            break;
+        }
+
+        _Py_SetWeakrefAndIncref(key);
+        _Py_SetWeakrefAndIncref(value);
+        atomic_store_explicit((_Atomic(PyObject *) *) &entry_loc.entry->key, key, memory_order_release);
+        atomic_store_explicit((_Atomic(Py_hash_t) *) &entry_loc.entry->hash, hash, memory_order_release);
+        atomic_store_explicit((_Atomic(PyObject *) *) &entry_loc.entry->value, value, memory_order_release);
+
+        PyObject *result = expected_insert_or_update(meta, key, hash, ANY, value, &entry_loc, &must_grow, 0);
+
+        if (result == NOT_FOUND) {  // it was an insert
+            Py_DECREF(result);
+            inserted++;
+            continue;
+        }
+
+        // it was an update (or an exception occurred): the reserved entry is not needed
+        uint8_t flags = atomic_load_explicit((_Atomic (uint8_t) *) &entry_loc.entry->flags, memory_order_acquire);
+        atomic_store_explicit((_Atomic (uint8_t) *) &entry_loc.entry->flags, flags & ENTRY_FLAGS_RESERVED, memory_order_release);
+        atomic_store_explicit((_Atomic (PyObject *) *) &entry_loc.entry->key, NULL, memory_order_release);
+        atomic_store_explicit((_Atomic (PyObject *) *) &entry_loc.entry->value, NULL, memory_order_release);
+        atomic_store_explicit((_Atomic (Py_hash_t) *) &entry_loc.entry->hash, 0, memory_order_release);
+        reservation_buffer_put_back_one(&storage->reservation_buffer);
+        Py_DECREF(key);
+
+        if (result == NULL) {
+            Py_DECREF(value);
+            if (must_grow)
+                break;
+            goto fail_locked;
+        }
+
+        Py_DECREF(result);  // the previous value
+    }
+
+    if (inserted > 0) {
+        accessor_len_inc(self, storage, inserted);
+        accessor_inserted_inc(self, storage, inserted);
+    }
+    PyMutex_Unlock(&storage->self_mutex);
+
+    if (must_grow || approx_inserted(self) >= SIZE_OF(meta) * 2 / 3) {
+        if (grow_or_compact(self) < 0)
+            goto fail;
+    }
+    if (must_grow)  // the remaining items were not inserted
+        goto beginning;
+
+    return 0;
+
+    fail_locked:
+    if (inserted > 0) {
+        accessor_len_inc(self, storage, inserted);
+        accessor_inserted_inc(self, storage, inserted);
+    }
+    PyMutex_Unlock(&storage->self_mutex);
+    fail:
+    return -1;
+}
+
+static int
+batch_flush(AtomicDictBatch *batch)
+{
+    int ok = batch_insert_chunk(batch);
+
+    for (Py_ssize_t i = 0; i < batch->len; ++i) {
+        Py_DECREF(batch->keys[i]);
+        Py_DECREF(batch->values[i]);
+    }
+    batch->len = 0;
+
+    return ok;
+}
+
+static int
+batch_push(AtomicDictBatch *batch, PyObject *key, PyObject *value)
+{
+    if (key == NOT_FOUND || key == ANY || key == EXPECTATION_FAILED) {
+        PyErr_SetString(PyExc_ValueError, "key in (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+        return -1;
+    }
+    if (value == NOT_FOUND || value == ANY || value == EXPECTATION_FAILED) {
+        PyErr_SetString(PyExc_ValueError, "value in (NOT_FOUND, ANY, EXPECTATION_FAILED)");
+        return -1;
+    }
+
+    Py_hash_t hash = PyObject_Hash(key);
+    if (hash == -1)
+        return -1;
+
+    batch->hashes[batch->len] = hash;
+    batch->keys[batch->len] = Py_NewRef(key);
+    batch->values[batch->len] = Py_NewRef(value);
+    batch->len++;
+
+    if (batch->len == batch->chunk_size)
+        return batch_flush(batch);
+
+    return 0;
+}
+
+static int
+batch_push_mapping(AtomicDictBatch *batch, PyObject *mapping, PyObject *keys_method)
+{
+    PyObject *keys = NULL, *iterator = NULL, *key = NULL, *value = NULL;
+
+    keys = PyObject_CallNoArgs(keys_method);
+    if (keys == NULL)
+        goto fail;
+    iterator = PyObject_GetIter(keys);
+    if (iterator == NULL)
+        goto fail;
+
+    while (PyIter_NextItem(iterator, &key) == 1) {
+        value = PyObject_GetItem(mapping, key);
+        if (value == NULL)
+            goto fail;
+        if (batch_push(batch, key, value) < 0)
+            goto fail;
+        Py_CLEAR(key);
+        Py_CLEAR(value);
+    }
+    if (PyErr_Occurred())
+        goto fail;
+
+    Py_DECREF(iterator);
+    Py_DECREF(keys);
+    return 0;
+    fail:
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    Py_XDECREF(iterator);
+    Py_XDECREF(keys);
+    return -1;
+}
+
+static int
+batch_push_iterable(AtomicDictBatch *batch, PyObject *iterable)
+{
+    PyObject *iterator = NULL, *item = NULL, *key = NULL, *value = NULL;
+
+    iterator = PyObject_GetIter(iterable);
+    if (iterator == NULL)
+        goto fail;
+
+    while (PyIter_NextItem(iterator, &item) == 1) {
+        if (unpack_item(item, &key, &value) < 0)
+            goto fail;
+        if (batch_push(batch, key, value) < 0)
+            goto fail;
+        Py_CLEAR(key);
+        Py_CLEAR(value);
+        Py_CLEAR(item);
+    }
+    if (PyErr_Occurred())
+        goto fail;
+
+    Py_DECREF(iterator);
+    return 0;
+    fail:
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    Py_XDECREF(item);
+    Py_XDECREF(iterator);
+    return -1;
+}
+
+static int
+batch_push_dict(AtomicDictBatch *batch, PyObject *dict)
+{
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    int ok = 0;
+
+    Py_BEGIN_CRITICAL_SECTION(dict);
+    while (PyDict_Next(dict, &pos, &key, &value)) {
+        ok = batch_push(batch, key, value);
+        if (ok < 0)
+            break;
+    }
+    Py_END_CRITICAL_SECTION();
+
+    return ok;
+}
+
+static int
+batch_push_any(AtomicDictBatch *batch, PyObject *other)
+{
+    // same as dict.update(other)
+    if (PyDict_CheckExact(other))
+        return batch_push_dict(batch, other);
+
+    if (PyObject_TypeCheck(other, &AtomicDict_Type)) {
+        PyObject *args = PyTuple_New(0);
+        if (args == NULL)
+            return -1;
+        PyObject *items = AtomicDict_FastIter((AtomicDict *) other, args, NULL);
+        Py_DECREF(args);
+        if (items == NULL)
+            return -1;
+        int ok = batch_push_iterable(batch, items);
+        Py_DECREF(items);
+        return ok;
+    }
+
+    PyObject *keys_method = NULL;
+    if (PyObject_GetOptionalAttrString(other, "keys", &keys_method) < 0)
+        return -1;
+    if (keys_method != NULL) {
+        int ok = batch_push_mapping(batch, other, keys_method);
+        Py_DECREF(keys_method);
+        return ok;
+    }
+
+    return batch_push_iterable(batch, other);
+}
+
+static int
+batch_setitem(AtomicDict *self, PyObject *other, PyObject *kwargs, Py_ssize_t chunk_size)
+{
+    AtomicDictBatch batch = {
+        .self = self,
+        .len = 0,
+        .chunk_size = chunk_size,
+    };
+
+    batch.storage = get_or_create_accessor_storage(self);
+    if (batch.storage == NULL)
+        goto fail;
+
+    batch.hashes = PyMem_RawMalloc(chunk_size * sizeof(Py_hash_t));
+    batch.keys = PyMem_RawMalloc(chunk_size * sizeof(PyObject *));
+    batch.values = PyMem_RawMalloc(chunk_size * sizeof(PyObject *));
+    if (batch.hashes == NULL || batch.keys == NULL || batch.values == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    if (other != NULL && batch_push_any(&batch, other) < 0)
+        goto fail;
+    if (kwargs != NULL && batch_push_dict(&batch, kwargs) < 0)
+        goto fail;
+    if (batch_flush(&batch) < 0)
+        goto fail;
+
+    PyMem_RawFree(batch.hashes);
+    PyMem_RawFree(batch.keys);
+    PyMem_RawFree(batch.values);
+    return 0;
+
+    fail:
+    for (Py_ssize_t i = 0; i < batch.len; ++i) {
+        Py_DECREF(batch.keys[i]);
+        Py_DECREF(batch.values[i]);
+    }
+    PyMem_RawFree(batch.hashes);
+    PyMem_RawFree(batch.keys);
+    PyMem_RawFree(batch.values);
+    return -1;
+}
+
+PyObject *
+AtomicDict_BatchSetItem(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *batch = NULL;
+    Py_ssize_t chunk_size = 128;
+
+    char *kw_list[] = {"batch", "chunk_size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", kw_list, &batch, &chunk_size))
+        return NULL;
+
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size <= 0");
+        return NULL;
+    }
+
+    if (batch_setitem(self, batch, NULL, chunk_size) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+PyObject *
+AtomicDict_Update(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *other = NULL;
+
+    if (!PyArg_UnpackTuple(args, "update", 0, 1, &other))
+        return NULL;
+
+    if (batch_setitem(self, other, kwargs, 128) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+
+// specialized reducers receive `aggregate` as an extra argument, which is
+// NULL unless the reducer is parametrized (e.g. the k of reduce_topk).
+static inline PyObject *
+aggregate_one(PyObject *key, PyObject *current, PyObject *new, PyObject *aggregate,
+              PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), int is_specialized)
+{
+    if (is_specialized)
+        return specialized(key, current, new, aggregate);
+    return PyObject_CallFunctionObjArgs(aggregate, key, current, new, NULL);
+}
+
+static inline int
+flush_one(AtomicDict *self, PyObject *key, PyObject *expected, PyObject *new, PyObject *aggregate, PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), int is_specialized)
+{
+    // key, expected, and new are borrowed from the ReduceTable
+    assert(key != NULL);
+    assert(expected != NULL);
+    assert(new != NULL);
+    assert(expected == NOT_FOUND);
+
+    PyObject *previous = NULL;
+    PyObject *current = NULL;
+    PyObject *new_desired = NULL;
+    PyObject *desired = Py_NewRef(new);
+    expected = Py_NewRef(expected);
+
+    while (1) {
+        current = AtomicDict_GetItemOrDefault(self, key, NOT_FOUND);
+        if (current == NULL)  // the lookup raised (e.g. a colliding key's __eq__)
+            goto fail;
+
+        if (current == expected) {
+            previous = AtomicDict_CompareAndSet(self, key, expected, desired);
+            if (previous == NULL)
+                goto fail;
+            if (previous != EXPECTATION_FAILED) {
+                break;
+            }
+            Py_CLEAR(previous);
+        }
+
+        // the aggregate function must always be called with `new`, not `desired`
+        new_desired = aggregate_one(key, current, new, aggregate, specialized, is_specialized);
+        if (new_desired == NULL)
+            goto fail;
+
+        Py_SETREF(expected, current);
+        current = NULL;
+        Py_SETREF(desired, new_desired);
+        new_desired = NULL;
+    }
+    Py_DECREF(previous);
+    Py_DECREF(current);
+    Py_DECREF(expected);
+    Py_DECREF(desired);
+    return 0;
+    fail:
+    Py_XDECREF(current);
+    Py_XDECREF(expected);
+    Py_XDECREF(desired);
+    return -1;
+}
+
+
+// batched reduce.
+//
+// the values of each key are collected in a list in the ReduceTable, and
+// aggregate_many(key, current, values) is called once per key when the
+// table is flushed, instead of once per item. reduce_flush and
+// reduce_table_merge tell batched tables apart by their specialized function.
+
+static inline PyObject *
+reduce_collect_values(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
+{
+    assert(current != NULL);
+    assert(new != NULL);
+    if (current == NOT_FOUND) {
+        PyObject *values = PyList_New(1);
+        if (values == NULL)
+            return NULL;
+        PyList_SET_ITEM(values, 0, Py_NewRef(new));
+        return values;
+    }
+    // the list is private to the ReduceTable: it can be extended in place
+    assert(PyList_CheckExact(current));
+    if (PyList_Append(current, new) < 0)
+        return NULL;
+    return Py_NewRef(current);
+}
+
+static inline int
+reduce_is_batched(PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *))
+{
+    return specialized == reduce_collect_values;
+}
+
+static int
+reduce_batched_flush_one(AtomicDict *self, PyObject *key, PyObject *values, PyObject *aggregate_many)
+{
+    // key and values are borrowed from the ReduceTable
+    PyObject *current = NULL;
+    PyObject *batch = NULL;
+    PyObject *desired = NULL;
+    PyObject *previous = NULL;
+
+    current = AtomicDict_GetItemOrDefault(self, key, NOT_FOUND);
+    if (current == NULL)
+        goto fail;
+
+    while (1) {
+        // aggregate_many may modify the list it is given: each attempt gets a fresh copy
+        batch = PyList_GetSlice(values, 0, PY_SSIZE_T_MAX);
+        if (batch == NULL)
+            goto fail;
+
+        desired = PyObject_CallFunctionObjArgs(aggregate_many, key, current, batch, NULL);
+        Py_CLEAR(batch);
+        if (desired == NULL)
+            goto fail;
+
+        previous = AtomicDict_CompareAndSet(self, key, current, desired);
+        if (previous == NULL)
+            goto fail;
+        if (previous != EXPECTATION_FAILED)
+            break;
+
+        Py_CLEAR(previous);
+        Py_CLEAR(desired);
+        Py_SETREF(current, AtomicDict_GetItemOrDefault(self, key, NOT_FOUND));
+        if (current == NULL)
+            goto fail;
+    }
+
+    Py_DECREF(previous);
+    Py_DECREF(desired);
+    Py_DECREF(current);
+    return 0;
+
+    fail:
+    Py_XDECREF(desired);
+    Py_XDECREF(current);
+    return -1;
+}
+
+
+static inline int
+reduce_flush(AtomicDict *self, ReduceTable *local_buffer, PyObject *aggregate, PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), int is_specialized)
+{
+    if (local_buffer->used == 0)
+        return 0;
+
+    uint64_t start = REHASH(_Py_ThreadId()) % local_buffer->used;
+    // start is a pseudo random number, distinct per thread.
+    // this can help reduce contention when multiple threads
+    // are flushing a large-enough set of distinct keys.
+    for (uint64_t i = 0; i < local_buffer->used; i++) {
+        uint64_t index = (start + i) % local_buffer->used;
+        ReduceTableEntry *entry = REDUCE_TABLE_ENTRY(local_buffer, index);
+        int result;
+        if (reduce_is_batched(specialized)) {
+            result = reduce_batched_flush_one(self, entry->key, entry->desired, aggregate);
+        } else {
+            result = flush_one(self, entry->key, entry->expected, entry->desired, aggregate, specialized, is_specialized);
+        }
+        if (result < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// options of the reduce family of methods.
+//
+// by default, the local buffer of reduce holds every distinct key found in
+// the input, and it is flushed into the dictionary only once the input is
+// exhausted. for unbounded streams, it can instead be flushed whenever it
+// holds max_buffered_keys keys, or flush_interval has elapsed since the
+// previous flush: this bounds its memory, and makes partial results visible.
+//
+// size_hint is the expected number of distinct keys: the local buffer is
+// allocated for them up front, instead of growing while reducing.
+typedef struct AtomicDictReduceOptions {
+    Py_ssize_t threads;          // 0: reduce in the calling thread only
+    uint64_t max_buffered_keys;  // 0: unbounded
+    PyTime_t flush_interval;     // 0: flush at the end only
+    uint64_t size_hint;          // 0: no hint
+} AtomicDictReduceOptions;
+
+static int
+reduce_parse_options(PyObject *threads, PyObject *max_buffered_keys, PyObject *flush_interval, PyObject *size_hint,
+                     AtomicDictReduceOptions *options)
+{
+    // NULL or None means that the argument was not given
+    *options = (AtomicDictReduceOptions) {0};
+
+    if (parse_threads(threads, &options->threads) < 0)
+        return -1;
+
+    if (max_buffered_keys != NULL && max_buffered_keys != Py_None) {
+        Py_ssize_t keys = PyLong_AsSsize_t(max_buffered_keys);
+        if (keys == -1 && PyErr_Occurred())
+            return -1;
+        if (keys <= 0) {
+            PyErr_SetString(PyExc_ValueError, "max_buffered_keys <= 0");
+            return -1;
+        }
+        options->max_buffered_keys = (uint64_t) keys;
+    }
+
+    if (flush_interval != NULL && flush_interval != Py_None) {
+        double seconds = PyFloat_AsDouble(flush_interval);
+        if (seconds == -1.0 && PyErr_Occurred())
+            return -1;
+        if (!(seconds > 0)) {
+            PyErr_SetString(PyExc_ValueError, "flush_interval <= 0");
+            return -1;
+        }
+        if (seconds * 1e9 >= (double) PyTime_MAX) {
+            PyErr_SetString(PyExc_OverflowError, "flush_interval too large");
+            return -1;
+        }
+        options->flush_interval = (PyTime_t) (seconds * 1e9);
+        if (options->flush_interval == 0) {
+            options->flush_interval = 1;
+        }
+    }
+
+    if (size_hint != NULL && size_hint != Py_None) {
+        Py_ssize_t hint = PyLong_AsSsize_t(size_hint);
+        if (hint == -1 && PyErr_Occurred())
+            return -1;
+        if (hint < 0) {
+            PyErr_SetString(PyExc_ValueError, "size_hint < 0");
+            return -1;
+        }
+        options->size_hint = (uint64_t) hint;
+    }
+
+    return 0;
+}
+
+/**
+ * Create a local buffer for reduce, sized according to `options`.
+ * The buffer is flushed when it holds max_buffered_keys keys, so it never
+ * needs more room than that.
+ **/
+static inline ReduceTable *
+reduce_table_new_for(const AtomicDictReduceOptions *options)
+{
+    uint64_t size_hint = 0;
+    if (options != NULL) {
+        size_hint = options->size_hint;
+        if (options->max_buffered_keys > 0 && options->max_buffered_keys < size_hint) {
+            size_hint = options->max_buffered_keys;
+        }
+    }
+    return reduce_table_new(reduce_table_log_size_for(size_hint));
+}
+
+/**
+ * If `options` bound the local buffer and a bound was reached, flush it into
+ * `self` and empty it. Updates *last_flush accordingly.
+ **/
+static inline int
+reduce_flush_early(AtomicDict *self, ReduceTable *local_buffer, const AtomicDictReduceOptions *options,
+                   PyTime_t *last_flush, PyObject *aggregate,
+                   PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), const int is_specialized)
+{
+    if (options == NULL || (options->max_buffered_keys == 0 && options->flush_interval == 0))
+        return 0;
+
+    PyTime_t now = 0;
+    if (options->flush_interval > 0 && PyTime_Monotonic(&now) < 0)
+        return -1;
+
+    int flush = (options->max_buffered_keys > 0 && local_buffer->used >= options->max_buffered_keys)
+        || (options->flush_interval > 0 && now - *last_flush >= options->flush_interval);
+    if (!flush)
+        return 0;
+
+    if (reduce_flush(self, local_buffer, aggregate, specialized, is_specialized) < 0)
+        return -1;
+    reduce_table_clear(local_buffer);
+    *last_flush = now;
+    return 0;
+}
+
+static inline int
+reduce_flush_timer_start(const AtomicDictReduceOptions *options, PyTime_t *last_flush)
+{
+    *last_flush = 0;
+    if (options != NULL && options->flush_interval > 0)
+        return PyTime_Monotonic(last_flush);
+    return 0;
+}
+
+/**
+ * Aggregate a single key-value pair into `local_buffer`.
+ * Both `key` and `value` are borrowed.
+ **/
+static inline int
+reduce_aggregate_item(ReduceTable *local_buffer, PyObject *key, PyObject *value, PyObject *aggregate,
+    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), const int is_specialized)
+{
+    PyObject *current = NULL;
+    PyObject *expected = NULL;
+    PyObject *desired = NULL;
+
+    Py_hash_t hash = PyObject_Hash(key);
+    if (hash == -1)
+        return -1;
+
+    int found = reduce_table_get(local_buffer, key, hash, &expected, &current);
+    if (found < 0)
+        return -1;
+
+    if (!found) {
+        expected = NOT_FOUND;
+        current = NOT_FOUND;
+    }
+
+    desired = aggregate_one(key, current, value, aggregate, specialized, is_specialized);
+    if (desired == NULL)
+        return -1;
+
+    Py_INCREF(key);
+    Py_INCREF(expected);
+    if (reduce_table_set(local_buffer, key, hash, expected, desired) < 0) {
+        Py_DECREF(key);
+        Py_DECREF(expected);
+        Py_DECREF(desired);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Aggregate the items of `iterable` into `local_buffer`.
+ *
+ * If `options` bound the local buffer, it is flushed into `self` and
+ * emptied whenever a bound is reached.
+ **/
+static int
+reduce_aggregate(AtomicDict *self, ReduceTable *local_buffer, PyObject *iterable, PyObject *aggregate,
+    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), const int is_specialized,
+    const AtomicDictReduceOptions *options)
+{
+    PyObject *item = NULL;
+    PyObject *iterator = NULL;
+    PyTime_t last_flush;
+
+    if (reduce_flush_timer_start(options, &last_flush) < 0)
+        goto fail;
+
+    iterator = PyObject_GetIter(iterable);
+    if (iterator == NULL) {
+        PyErr_Format(PyExc_TypeError, "%R is not iterable.", iterable);
+        goto fail;
+    }
+
+    while (PyIter_NextItem(iterator, &item) == 1) {
+        if (!PyTuple_CheckExact(item)) {
+            PyErr_Format(PyExc_TypeError, "type(%R) != tuple", item);
+            goto fail;
+        }
+
+        if (PyTuple_Size(item) != 2) {
+            PyErr_Format(PyExc_TypeError, "len(%R) != 2", item);
+            goto fail;
+        }
+
+        // item keeps its key and value alive
+        if (reduce_aggregate_item(local_buffer, PyTuple_GET_ITEM(item, 0), PyTuple_GET_ITEM(item, 1),
+                                  aggregate, specialized, is_specialized) < 0)
+            goto fail;
+        Py_CLEAR(item);
+
+        if (reduce_flush_early(self, local_buffer, options, &last_flush, aggregate, specialized, is_specialized) < 0)
+            goto fail;
+    }
+
+    if (PyErr_Occurred())
+        goto fail;
+
+    local_buffer->chunks++;
+    Py_DECREF(iterator);
+    return 0;
+
+    fail:
+    Py_XDECREF(iterator);
+    Py_XDECREF(item);
+    return -1;
+}
+
+/**
+ * Aggregate the pairs (keys[i], values[i]) for i in [start, stop) into
+ * `local_buffer`, like reduce_aggregate.
+ *
+ * `keys` and `values` must have been obtained with PySequence_Fast, so that
+ * no tuple needs to be created for each pair.
+ * If `values` is NULL, every value is 1, as in reduce_count.
+ **/
+static int
+reduce_aggregate_columns(AtomicDict *self, ReduceTable *local_buffer, PyObject *keys, PyObject *values,
+    Py_ssize_t start, Py_ssize_t stop, PyObject *aggregate,
+    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), const int is_specialized,
+    const AtomicDictReduceOptions *options)
+{
+    PyObject *key = NULL;
+    PyObject *value = NULL;
+    PyObject *one = NULL;
+    PyTime_t last_flush;
+
+    if (reduce_flush_timer_start(options, &last_flush) < 0)
+        goto fail;
+
+    if (values == NULL) {
+        one = PyLong_FromLong(1);
+        if (one == NULL)
+            goto fail;
+    }
+
+    for (Py_ssize_t i = start; i < stop; i++) {
+        // aggregate may mutate the sequences
+        if (i >= PySequence_Fast_GET_SIZE(keys) || (values != NULL && i >= PySequence_Fast_GET_SIZE(values))) {
+            PyErr_SetString(PyExc_RuntimeError, "keys or values changed size during reduce");
+            goto fail;
+        }
+
+        key = Py_NewRef(PySequence_Fast_GET_ITEM(keys, i));
+        value = Py_NewRef(values == NULL ? one : PySequence_Fast_GET_ITEM(values, i));
+
+        if (reduce_aggregate_item(local_buffer, key, value, aggregate, specialized, is_specialized) < 0)
+            goto fail;
+        Py_CLEAR(key);
+        Py_CLEAR(value);
+
+        if (reduce_flush_early(self, local_buffer, options, &last_flush, aggregate, specialized, is_specialized) < 0)
+            goto fail;
+    }
+
+    local_buffer->chunks++;
+    Py_XDECREF(one);
+    return 0;
+
+    fail:
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    Py_XDECREF(one);
+    return -1;
+}
+
+static int
+AtomicDict_Reduce_impl(AtomicDict *self, PyObject *iterable, PyObject *aggregate,
+    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), const int is_specialized,
+    const AtomicDictReduceOptions *options)
+{
+    // is_specialized => specialized != NULL
+    assert(!is_specialized || specialized != NULL);
+    // !is_specialized => aggregate != NULL
+    assert(is_specialized || aggregate != NULL);
+
+    ReduceTable *local_buffer = NULL;
+
+    if (!is_specialized) {
+        if (!PyCallable_Check(aggregate)) {
+            PyErr_Format(PyExc_TypeError, "%R is not callable.", aggregate);
+            goto fail;
+        }
+    }
+
+    local_buffer = reduce_table_new_for(options);
+    if (local_buffer == NULL)
+        goto fail;
+
+    if (reduce_aggregate(self, local_buffer, iterable, aggregate, specialized, is_specialized, options) < 0)
+        goto fail;
+
+    if (reduce_flush(self, local_buffer, aggregate, specialized, is_specialized) < 0)
+        goto fail;
+
+    reduce_table_free(local_buffer);
+    return 0;
+
+    fail:
+    reduce_table_free(local_buffer);
+    return -1;
+}
+
+int
+AtomicDict_Reduce(AtomicDict *self, PyObject *iterable, PyObject *aggregate)
+{
+    return AtomicDict_Reduce_impl(self, iterable, aggregate, NULL, 0, NULL);
+}
+
+/**
+ * Get the sequences of keys and values of a column-oriented reduce.
+ * `values` may be NULL, and then *values_fast is NULL too.
+ **/
+static int
+reduce_columns(PyObject *keys, PyObject *values, PyObject **keys_fast, PyObject **values_fast)
+{
+    *keys_fast = NULL;
+    *values_fast = NULL;
+
+    *keys_fast = PySequence_Fast(keys, "keys must be a sequence");
+    if (*keys_fast == NULL)
+        goto fail;
+
+    if (values != NULL) {
+        *values_fast = PySequence_Fast(values, "values must be a sequence");
+        if (*values_fast == NULL)
+            goto fail;
+
+        if (PySequence_Fast_GET_SIZE(*keys_fast) != PySequence_Fast_GET_SIZE(*values_fast)) {
+            PyErr_SetString(PyExc_ValueError, "len(keys) != len(values)");
+            goto fail;
+        }
+    }
+
+    return 0;
+    fail:
+    Py_CLEAR(*keys_fast);
+    Py_CLEAR(*values_fast);
+    return -1;
+}
+
+static int
+reduce_columns_impl(AtomicDict *self, PyObject *keys, PyObject *values, PyObject *aggregate,
+    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), const int is_specialized,
+    const AtomicDictReduceOptions *options)
+{
+    PyObject *keys_fast = NULL;
+    PyObject *values_fast = NULL;
+    ReduceTable *local_buffer = NULL;
+
+    if (!is_specialized && !PyCallable_Check(aggregate)) {
+        PyErr_Format(PyExc_TypeError, "%R is not callable.", aggregate);
+        goto fail;
+    }
+
+    if (reduce_columns(keys, values, &keys_fast, &values_fast) < 0)
+        goto fail;
+
+    local_buffer = reduce_table_new_for(options);
+    if (local_buffer == NULL)
+        goto fail;
+
+    if (reduce_aggregate_columns(self, local_buffer, keys_fast, values_fast, 0, PySequence_Fast_GET_SIZE(keys_fast),
+                                 aggregate, specialized, is_specialized, options) < 0)
+        goto fail;
+
+    if (reduce_flush(self, local_buffer, aggregate, specialized, is_specialized) < 0)
+        goto fail;
+
+    reduce_table_free(local_buffer);
+    Py_DECREF(keys_fast);
+    Py_XDECREF(values_fast);
+    return 0;
+
+    fail:
+    reduce_table_free(local_buffer);
+    Py_XDECREF(keys_fast);
+    Py_XDECREF(values_fast);
+    return -1;
+}
+
+/**
+ * Aggregate the entries of `from` into `into`, like a flush would do with
+ * the dictionary. Always frees `from`.
+ **/
+static int
+reduce_table_merge(ReduceTable *into, ReduceTable *from, PyObject *aggregate,
+    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), const int is_specialized)
+{
+    PyObject *expected = NULL;
+    PyObject *current = NULL;
+    PyObject *desired = NULL;
+
+    for (uint64_t i = 0; i < from->used; i++) {
+        ReduceTableEntry *entry = REDUCE_TABLE_ENTRY(from, i);
+
+        int found = reduce_table_get(into, entry->key, entry->hash, &expected, &current);
+        if (found < 0)
+            goto fail;
+
+        if (found && reduce_is_batched(specialized)) {
+            // both are lists of values: append those of `from` to those of `into`
+            if (PyList_SetSlice(current, PY_SSIZE_T_MAX, PY_SSIZE_T_MAX, entry->desired) < 0)
+                goto fail;
+            desired = Py_NewRef(current);
+        } else if (found) {
+            desired = aggregate_one(entry->key, current, entry->desired, aggregate, specialized, is_specialized);
+            if (desired == NULL)
+                goto fail;
+        } else {
+            expected = entry->expected;
+            desired = Py_NewRef(entry->desired);
+        }
+
+        Py_INCREF(entry->key);
+        Py_INCREF(expected);
+        if (reduce_table_set(into, entry->key, entry->hash, expected, desired) < 0) {
+            Py_DECREF(entry->key);
+            Py_DECREF(expected);
+            Py_DECREF(desired);
+            goto fail;
+        }
+    }
+
+    into->chunks += from->chunks;
+    reduce_table_free(from);
+    return 0;
+
+    fail:
+    reduce_table_free(from);
+    return -1;
+}
+
+
+// parallel reduce.
+//
+// with threads=N, the iterable is a sequence of chunks: each chunk is
+// consumed by one of the workers and pre-aggregated in its own ReduceTable.
+//
+// then, instead of flushing its table right away, a worker combines it with
+// the table that another worker may have left in the deposit slot, and
+// leaves the result there. only once a table has combined a round of N
+// chunks, it is flushed into the dictionary: the updates to a hot key then
+// cost one CAS per round, instead of one per chunk.
+// whatever is left in the deposit slot is flushed after all chunks have
+// been consumed.
+//
+// with keys= and values=, the columns are split into ranges of chunk_size
+// pairs instead, and each task is the index of a range.
+
+typedef struct AtomicDictParallelReduce {
+    PyObject *aggregate;
+    PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *);
+    int is_specialized;
+    int count_keys;  // chunks are iterables of keys, as in reduce_count
+    Py_ssize_t round;
+    const AtomicDictReduceOptions *options;
+    PyObject *keys;    // column-oriented input, or NULL
+    PyObject *values;  // NULL with keys means that every value is 1
+    Py_ssize_t chunk_size;
+    ReduceTable *deposit;
+} AtomicDictParallelReduce;
+
+static PyObject *reduce_count_items(PyObject *iterable);
+
+static int
+reduce_chunk(AtomicDictParallel *parallel, PyObject *chunk)
+{
+    AtomicDictParallelReduce *pr = parallel->arg;
+    PyObject *items = NULL;
+    ReduceTable *table = NULL;
+
+    table = reduce_table_new_for(pr->options);
+    if (table == NULL)
+        goto fail;
+
+    if (pr->keys != NULL) {
+        Py_ssize_t start = PyLong_AsSsize_t(chunk) * pr->chunk_size;
+        Py_ssize_t stop = Py_MIN(start + pr->chunk_size, PySequence_Fast_GET_SIZE(pr->keys));
+        if (reduce_aggregate_columns(parallel->self, table, pr->keys, pr->values, start, stop, pr->aggregate,
+                                     pr->specialized, pr->is_specialized, pr->options) < 0)
+            goto fail;
+    } else {
+        if (pr->count_keys) {
+            items = reduce_count_items(chunk);
+        } else {
+            items = Py_NewRef(chunk);
+        }
+        if (items == NULL)
+            goto fail;
+
+        if (reduce_aggregate(parallel->self, table, items, pr->aggregate, pr->specialized, pr->is_specialized,
+                             pr->options) < 0)
+            goto fail;
+        Py_CLEAR(items);
+    }
+
+    while (1) {
+        ReduceTable *other = atomic_exchange_explicit((_Atomic (ReduceTable *) *) &pr->deposit, NULL, memory_order_acq_rel);
+        if (other != NULL) {
+            if (reduce_table_merge(table, other, pr->aggregate, pr->specialized, pr->is_specialized) < 0)
+                goto fail;
+        }
+
+        if (table->chunks >= pr->round)
+            break;
+
+        ReduceTable *empty = NULL;
+        if (atomic_compare_exchange_strong_explicit((_Atomic (ReduceTable *) *) &pr->deposit, &empty, table,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            // another worker, or the caller at the end, will take it from here
+            return 0;
+        }
+        // another table was deposited in the meantime: combine it too
+    }
+
+    if (reduce_flush(parallel->self, table, pr->aggregate, pr->specialized, pr->is_specialized) < 0)
+        goto fail;
+
+    reduce_table_free(table);
+    return 0;
+
+    fail:
+    Py_XDECREF(items);
+    reduce_table_free(table);
+    return -1;
+}
+
+static int reduce_count_impl(AtomicDict *self, PyObject *iterable, const AtomicDictReduceOptions *options);
+
+/**
+ * Split the columns of a parallel reduce into ranges, so that each worker
+ * can take several of them.
+ **/
+static int
+reduce_columns_tasks(AtomicDictParallel *parallel, AtomicDictParallelReduce *pr, PyObject *keys, PyObject *values,
+                     Py_ssize_t threads)
+{
+    if (reduce_columns(keys, values, &pr->keys, &pr->values) < 0)
+        return -1;
+
+    Py_ssize_t size = PySequence_Fast_GET_SIZE(pr->keys);
+    Py_ssize_t chunks = Py_MIN(size, threads * 4);
+    pr->chunk_size = chunks > 0 ? (size + chunks - 1) / chunks : 1;
+    chunks = (size + pr->chunk_size - 1) / pr->chunk_size;
+
+    parallel->tasks = PyList_New(chunks);
+    if (parallel->tasks == NULL)
+        return -1;
+
+    for (Py_ssize_t i = 0; i < chunks; i++) {
+        PyObject *task = PyLong_FromSsize_t(i);
+        if (task == NULL)
+            return -1;
+        PyList_SET_ITEM(parallel->tasks, i, task);
+    }
+    return 0;
+}
+
+/**
+ * Reduce either `iterable`, or the columns `keys` and `values`.
+ * Exactly one of `iterable` and `keys` is not NULL.
+ **/
+static int
+reduce_maybe_parallel(AtomicDict *self, PyObject *iterable, PyObject *keys, PyObject *values, PyObject *aggregate,
+                      PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), int count_keys,
+                      const AtomicDictReduceOptions *options)
+{
+    const int is_specialized = specialized != NULL;
+    assert((iterable == NULL) != (keys == NULL));
+
+    if (options->threads == 0) {
+        if (keys != NULL)
+            return reduce_columns_impl(self, keys, values, aggregate, specialized, is_specialized, options);
+        if (count_keys)
+            return reduce_count_impl(self, iterable, options);
+        return AtomicDict_Reduce_impl(self, iterable, aggregate, specialized, is_specialized, options);
+    }
+
+    if (!is_specialized && !PyCallable_Check(aggregate)) {
+        PyErr_Format(PyExc_TypeError, "%R is not callable.", aggregate);
+        return -1;
+    }
+
+    AtomicDictParallelReduce pr = {
+        .aggregate = aggregate,
+        .specialized = specialized,
+        .is_specialized = is_specialized,
+        .count_keys = count_keys,
+        .round = options->threads,
+        .options = options,
+        .keys = NULL,
+        .values = NULL,
+        .deposit = NULL,
+    };
+    AtomicDictParallel parallel = {0};
+    parallel.self = self;
+    parallel.run = reduce_chunk;
+    parallel.arg = &pr;
+
+    int res = 0;
+    if (keys != NULL) {
+        res = reduce_columns_tasks(&parallel, &pr, keys, values, options->threads);
+    } else {
+        parallel.tasks = PySequence_List(iterable);
+        if (parallel.tasks == NULL)
+            res = -1;
+    }
+
+    if (res == 0 && PyList_GET_SIZE(parallel.tasks) > 0) {
+        res = parallel_run(&parallel, options->threads);
+    }
+    Py_XDECREF(parallel.tasks);
+    Py_XDECREF(pr.keys);
+    Py_XDECREF(pr.values);
+
+    if (pr.deposit != NULL) {
+        if (res == 0) {
+            res = reduce_flush(self, pr.deposit, aggregate, specialized, is_specialized);
+        }
+        reduce_table_free(pr.deposit);
+    }
+    return res;
+}
+
+/**
+ * Check that exactly one of `iterable` and `keys` was given, and that
+ * `values` was given together with `keys`, unless values_allowed < 0, in
+ * which case `values` must not be given at all (as in reduce_count).
+ * Arguments that were not given, or that are None, are set to NULL.
+ **/
+static int
+reduce_check_input(PyObject **iterable_p, PyObject **keys_p, PyObject **values_p, int values_allowed)
+{
+    if (*iterable_p == Py_None)
+        *iterable_p = NULL;
+    if (*keys_p == Py_None)
+        *keys_p = NULL;
+    if (*values_p == Py_None)
+        *values_p = NULL;
+
+    PyObject *iterable = *iterable_p;
+    PyObject *keys = *keys_p;
+    PyObject *values = *values_p;
+
+    if ((iterable == NULL) == (keys == NULL)) {
+        PyErr_SetString(PyExc_TypeError, "exactly one of iterable and keys must be given");
+        return -1;
+    }
+    if (values_allowed < 0 && values != NULL) {
+        PyErr_SetString(PyExc_TypeError, "values cannot be given");
+        return -1;
+    }
+    if (values_allowed > 0 && (keys == NULL) != (values == NULL)) {
+        PyErr_SetString(PyExc_TypeError, "keys and values must be given together");
+        return -1;
+    }
+    return 0;
+}
+
+PyObject *
+AtomicDict_Reduce_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *iterable = NULL;
+    PyObject *aggregate = NULL;
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
+    PyObject *threads = NULL;
+    PyObject *max_buffered_keys = NULL;
+    PyObject *flush_interval = NULL;
+    PyObject *size_hint = NULL;
+    AtomicDictReduceOptions options;
+
+    char *kw_list[] = {
+        "iterable", "aggregate", "keys", "values", "threads", "max_buffered_keys", "flush_interval", "size_hint", NULL,
+    };
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OO$OOOOOO", kw_list, &iterable, &aggregate, &keys, &values,
+                                     &threads, &max_buffered_keys, &flush_interval, &size_hint))
+        goto fail;
+
+    if (aggregate == NULL) {
+        PyErr_SetString(PyExc_TypeError, "reduce() missing required argument 'aggregate'");
+        goto fail;
+    }
+
+    if (reduce_check_input(&iterable, &keys, &values, 1) < 0)
+        goto fail;
+
+    if (reduce_parse_options(threads, max_buffered_keys, flush_interval, size_hint, &options) < 0)
+        goto fail;
+
+    int res = reduce_maybe_parallel(self, iterable, keys, values, aggregate, NULL, 0, &options);
+    if (res < 0)
+        goto fail;
+
+    Py_RETURN_NONE;
+
+    fail:
+    return NULL;
+}
+
+static PyObject *
+reduce_specialized_callable(AtomicDict *self, PyObject *args, PyObject *kwargs,
+                            PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *), int count_keys)
+{
+    PyObject *iterable = NULL;
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
+    PyObject *threads = NULL;
+    PyObject *max_buffered_keys = NULL;
+    PyObject *flush_interval = NULL;
+    PyObject *size_hint = NULL;
+    AtomicDictReduceOptions options;
+
+    char *kw_list[] = {
+        "iterable", "keys", "values", "threads", "max_buffered_keys", "flush_interval", "size_hint", NULL,
+    };
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O$OOOOOO", kw_list, &iterable, &keys, &values, &threads,
+                                     &max_buffered_keys, &flush_interval, &size_hint))
+        goto fail;
+
+    // reduce_count takes the keys only
+    if (reduce_check_input(&iterable, &keys, &values, count_keys ? -1 : 1) < 0)
+        goto fail;
+
+    if (reduce_parse_options(threads, max_buffered_keys, flush_interval, size_hint, &options) < 0)
+        goto fail;
+
+    int res = reduce_maybe_parallel(self, iterable, keys, values, NULL, specialized, count_keys, &options);
+    if (res < 0)
+        goto fail;
+
+    Py_RETURN_NONE;
+
+    fail:
+    return NULL;
+}
+
+static inline PyObject *
+reduce_specialized_sum(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
+{
+    assert(current != NULL);
+    assert(new != NULL);
+    if (current == NOT_FOUND) {
+        Py_INCREF(new);
+        return new;
+    }
+    return PyNumber_Add(current, new);
+}
+
+int
+AtomicDict_ReduceSum(AtomicDict *self, PyObject *iterable)
+{
+    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_sum, 1, NULL);
+}
+
+
+PyObject *
+AtomicDict_ReduceSum_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_sum, 0);
+}
+
+static inline PyObject *
+reduce_specialized_and(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
+{
+    assert(current != NULL);
+    assert(new != NULL);
+    if (current == NOT_FOUND) {
+        Py_INCREF(new);
+        return new;
+    }
+    if (PyObject_IsTrue(current) && PyObject_IsTrue(new)) {
+        Py_INCREF(Py_True);
+        return Py_True;
+    }
+    Py_INCREF(Py_False);
+    return Py_False;
+}
+
+int
+AtomicDict_ReduceAnd(AtomicDict *self, PyObject *iterable)
+{
+    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_and, 1, NULL);
+}
+
+PyObject *
+AtomicDict_ReduceAnd_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_and, 0);
+}
+
+static inline PyObject *
+reduce_specialized_or(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
+{
+    assert(current != NULL);
+    assert(new != NULL);
+    if (current == NOT_FOUND) {
+        Py_INCREF(new);
+        return new;
+    }
+    if (PyObject_IsTrue(current) || PyObject_IsTrue(new)) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
+int
+AtomicDict_ReduceOr(AtomicDict *self, PyObject *iterable)
+{
+    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_or, 1, NULL);
+}
+
+PyObject *
+AtomicDict_ReduceOr_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_or, 0);
+}
+
+static inline PyObject *
+reduce_specialized_max(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
+{
+    assert(current != NULL);
+    assert(new != NULL);
+    if (current == NOT_FOUND) {
+        Py_INCREF(new);
+        return new;
+    }
+    Py_INCREF(current);
+    Py_INCREF(new);
+    const int cmp = PyObject_RichCompareBool(current, new, Py_GE);
+    if (cmp < 0) {
+        Py_DECREF(current);
+        Py_DECREF(new);
+        return NULL;
+    }
+    if (cmp) {
+        Py_DECREF(new);
+        return current;
+    }
+    Py_DECREF(current);
+    return new;
+}
+
+int
+AtomicDict_ReduceMax(AtomicDict *self, PyObject *iterable)
+{
+    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_max, 1, NULL);
+}
 
 PyObject *
-AtomicDict_Reduce_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+AtomicDict_ReduceMax_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *iterable = NULL;
-    PyObject *aggregate = NULL;
-
-    char *kw_list[] = {"iterable", "aggregate", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", kw_list, &iterable, &aggregate))
-        goto fail;
-
-    int res = AtomicDict_Reduce(self, iterable, aggregate);
-    if (res < 0)
-        goto fail;
-
-    Py_RETURN_NONE;
-
-    fail:
-    return NULL;
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_max, 0);
 }
 
 static inline PyObject *
-reduce_specialized_sum(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new)
+reduce_specialized_min(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
 {
     assert(current != NULL);
     assert(new != NULL);
@@ -596,109 +2188,246 @@ reduce_specialized_sum(PyObject *Py_UNUSED(key), PyObject *current, PyObject *ne
         Py_INCREF(new);
         return new;
     }
-    return PyNumber_Add(current, new);
+    Py_INCREF(current);
+    Py_INCREF(new);
+    const int cmp = PyObject_RichCompareBool(current, new, Py_LE);
+    if (cmp < 0) {
+        Py_DECREF(current);
+        Py_DECREF(new);
+        return NULL;
+    }
+    if (cmp) {
+        Py_DECREF(new);
+        return current;
+    }
+    Py_DECREF(current);
+    return new;
 }
 
 int
-AtomicDict_ReduceSum(AtomicDict *self, PyObject *iterable)
+AtomicDict_ReduceMin(AtomicDict *self, PyObject *iterable)
 {
-    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_sum, 1);
+    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_min, 1, NULL);
 }
 
-
 PyObject *
-AtomicDict_ReduceSum_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+AtomicDict_ReduceMin_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *iterable = NULL;
-
-    char *kw_list[] = {"iterable", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kw_list, &iterable))
-        goto fail;
-
-    int res = AtomicDict_ReduceSum(self, iterable);
-    if (res < 0)
-        goto fail;
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_min, 0);
+}
 
-    Py_RETURN_NONE;
+static inline PyObject *
+to_list(PyObject *maybe_list)
+{
+    assert(maybe_list != NULL);
+    if (PyList_CheckExact(maybe_list)) {
+        Py_INCREF(maybe_list);
+        return maybe_list;
+    }
 
-    fail:
-    return NULL;
+    PyObject *list = NULL;
+    list = PyList_New(1);
+    if (list == NULL)
+        return NULL;
+    Py_INCREF(maybe_list); // not a list
+    if (PyList_SetItem(list, 0, maybe_list) < 0) {
+        Py_DECREF(list);
+        return NULL;
+    }
+    return list;
 }
 
 static inline PyObject *
-reduce_specialized_and(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new)
+reduce_specialized_list(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
 {
     assert(current != NULL);
     assert(new != NULL);
     if (current == NOT_FOUND) {
-        Py_INCREF(new);
-        return new;
+        return to_list(new);
     }
-    if (PyObject_IsTrue(current) && PyObject_IsTrue(new)) {
-        Py_INCREF(Py_True);
-        return Py_True;
+    PyObject *current_list = to_list(current);
+    if (current_list == NULL)
+        return NULL;
+    PyObject *new_list = to_list(new);
+    if (new_list == NULL) {
+        Py_DECREF(current_list);
+        return NULL;
     }
-    Py_INCREF(Py_False);
-    return Py_False;
+    PyObject *concat = PyNumber_Add(current_list, new_list);
+    Py_DECREF(current_list);
+    Py_DECREF(new_list);
+    if (concat == NULL) {
+        return NULL;
+    }
+    return concat;
 }
 
 int
-AtomicDict_ReduceAnd(AtomicDict *self, PyObject *iterable)
+AtomicDict_ReduceList(AtomicDict *self, PyObject *iterable)
 {
-    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_and, 1);
+    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_list, 1, NULL);
 }
 
 PyObject *
-AtomicDict_ReduceAnd_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+AtomicDict_ReduceList_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *iterable = NULL;
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_list, 0);
+}
 
-    char *kw_list[] = {"iterable", NULL};
+static inline PyObject *
+reduce_count_zip_iter_with_ones(PyObject *iterable)
+{
+    // we want to return `zip(iterable, itertools.repeat(1))`
+    PyObject *iterator = NULL;
+    PyObject *builtin_zip = NULL;
+    PyObject *itertools = NULL;
+    PyObject *itertools_namespace = NULL;
+    PyObject *itertools_repeat = NULL;
+    PyObject *one = NULL;
+    PyObject *repeat_one = NULL;
+    PyObject *zipped = NULL;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kw_list, &iterable))
+    iterator = PyObject_GetIter(iterable);
+    if (iterator == NULL) {
+        PyErr_Format(PyExc_TypeError, "%R is not iterable.", iterable);
         goto fail;
+    }
 
-    int res = AtomicDict_ReduceAnd(self, iterable);
-    if (res < 0)
+#if PY_VERSION_HEX >= 0x030D0000 // 3.13
+    PyObject *builtins = PyEval_GetFrameBuiltins();
+#else
+    PyObject *builtins = PyEval_GetBuiltins();
+#endif
+
+    if (PyDict_GetItemStringRef(builtins, "zip", &builtin_zip) < 0)
         goto fail;
 
-    Py_RETURN_NONE;
+#if PY_VERSION_HEX >= 0x030D0000 // 3.13
+    Py_DECREF(builtins);
+#endif
+
+    // the following lines implement this Python code:
+    //     import itertools
+    //     itertools.repeat(1)
+    itertools = PyImport_ImportModule("itertools");
+    if (itertools == NULL)
+        goto fail;
+    itertools_namespace = PyModule_GetDict(itertools);
+    if (itertools_namespace == NULL)
+        goto fail;
+    Py_INCREF(itertools_namespace);
+    if (PyDict_GetItemStringRef(itertools_namespace, "repeat", &itertools_repeat) < 0)
+        goto fail;
+    Py_CLEAR(itertools_namespace);
+    one = PyLong_FromLong(1);
+    if (one == NULL)
+        goto fail;
+    repeat_one = PyObject_CallFunctionObjArgs(itertools_repeat, one, NULL);
+    if (repeat_one == NULL)
+        goto fail;
+
+    zipped = PyObject_CallFunctionObjArgs(builtin_zip, iterator, repeat_one, NULL);
+    if (zipped == NULL)
+        goto fail;
 
+    Py_DECREF(iterator);
+    Py_DECREF(builtin_zip);
+    Py_DECREF(itertools);
+    Py_DECREF(itertools_repeat);
+    Py_DECREF(one);
+    Py_DECREF(repeat_one);
+    return zipped;
     fail:
+    Py_XDECREF(iterator);
+    Py_XDECREF(builtin_zip);
+    Py_XDECREF(itertools);
+    Py_XDECREF(itertools_namespace);
+    Py_XDECREF(itertools_repeat);
+    Py_XDECREF(one);
+    Py_XDECREF(repeat_one);
     return NULL;
 }
 
-static inline PyObject *
-reduce_specialized_or(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new)
+static PyObject *
+reduce_count_items(PyObject *iterable)
 {
-    assert(current != NULL);
-    assert(new != NULL);
-    if (current == NOT_FOUND) {
-        Py_INCREF(new);
-        return new;
+    // todo: extend to all mappings
+    //   the problem is that PyMapping_Check(iterable) returns 1 also when iterable is a list or tuple
+    if (PyDict_Check(iterable)) {  // cannot fail: no error check
+        return PyDict_Items(iterable);
     }
-    if (PyObject_IsTrue(current) || PyObject_IsTrue(new)) {
-        Py_RETURN_TRUE;
+    return reduce_count_zip_iter_with_ones(iterable);
+}
+
+static int
+reduce_count_impl(AtomicDict *self, PyObject *iterable, const AtomicDictReduceOptions *options)
+{
+    if (PyList_CheckExact(iterable) || PyTuple_CheckExact(iterable)) {
+        // no need to zip the keys with ones
+        return reduce_columns_impl(self, iterable, NULL, NULL, reduce_specialized_sum, 1, options);
     }
-    Py_RETURN_FALSE;
+
+    PyObject *it = reduce_count_items(iterable);
+    if (it == NULL)
+        goto fail;
+
+    const int res = AtomicDict_Reduce_impl(self, it, NULL, reduce_specialized_sum, 1, options);
+    if (res < 0)
+        goto fail;
+
+    Py_DECREF(it);
+    return 0;
+    fail:
+    Py_XDECREF(it);
+    return -1;
 }
 
 int
-AtomicDict_ReduceOr(AtomicDict *self, PyObject *iterable)
+AtomicDict_ReduceCount(AtomicDict *self, PyObject *iterable)
 {
-    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_or, 1);
+    return reduce_count_impl(self, iterable, NULL);
 }
 
 PyObject *
-AtomicDict_ReduceOr_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+AtomicDict_ReduceCount_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_sum, 1);
+}
+
+static PyObject *
+reduce_specialized_callable_with_arg(AtomicDict *self, PyObject *args, PyObject *kwargs,
+                                     PyObject *(*specialized)(PyObject *, PyObject *, PyObject *, PyObject *),
+                                     char *arg_name, PyObject *(*parse_arg)(PyObject *))
 {
     PyObject *iterable = NULL;
+    PyObject *arg = NULL;
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
+    PyObject *threads = NULL;
+    PyObject *max_buffered_keys = NULL;
+    PyObject *flush_interval = NULL;
+    PyObject *size_hint = NULL;
+    AtomicDictReduceOptions options;
+
+    char *kw_list[] = {
+        "iterable", arg_name, "keys", "values", "threads", "max_buffered_keys", "flush_interval", "size_hint", NULL,
+    };
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OO$OOOOOO", kw_list, &iterable, &arg, &keys, &values, &threads,
+                                     &max_buffered_keys, &flush_interval, &size_hint))
+        goto fail;
+
+    if (reduce_check_input(&iterable, &keys, &values, 1) < 0)
+        goto fail;
+
+    if (reduce_parse_options(threads, max_buffered_keys, flush_interval, size_hint, &options) < 0)
+        goto fail;
 
-    char *kw_list[] = {"iterable", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kw_list, &iterable))
+    arg = parse_arg(arg);  // new reference
+    if (arg == NULL)
         goto fail;
 
-    int res = AtomicDict_ReduceOr(self, iterable);
+    int res = reduce_maybe_parallel(self, iterable, keys, values, arg, specialized, 0, &options);
+    Py_DECREF(arg);
     if (res < 0)
         goto fail;
 
@@ -708,169 +2437,416 @@ AtomicDict_ReduceOr_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
     return NULL;
 }
 
+// reduce_mean keeps (total, count) tuples.
+//
+// the state is not a dedicated type, so that it can be read back as a plain
+// tuple: every exact 2-tuple is taken as a (total, count) pair, whether it is
+// a new value or the one in the dictionary. this is documented in the .pyi.
+
+static inline PyObject *
+to_mean(PyObject *maybe_mean)
+{
+    if (PyTuple_CheckExact(maybe_mean) && PyTuple_GET_SIZE(maybe_mean) == 2)
+        return Py_NewRef(maybe_mean);
+
+    PyObject *one = PyLong_FromLong(1);
+    if (one == NULL)
+        return NULL;
+    PyObject *mean = PyTuple_Pack(2, maybe_mean, one);
+    Py_DECREF(one);
+    return mean;
+}
+
 static inline PyObject *
-reduce_specialized_max(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new)
+reduce_specialized_mean(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
 {
     assert(current != NULL);
     assert(new != NULL);
-    if (current == NOT_FOUND) {
-        Py_INCREF(new);
-        return new;
-    }
-    Py_INCREF(current);
-    Py_INCREF(new);
-    const int cmp = PyObject_RichCompareBool(current, new, Py_GE);
-    if (cmp < 0) {
-        Py_DECREF(current);
-        Py_DECREF(new);
+    PyObject *current_mean = NULL;
+    PyObject *new_mean = NULL;
+    PyObject *total = NULL;
+    PyObject *count = NULL;
+    PyObject *mean = NULL;
+
+    new_mean = to_mean(new);
+    if (new_mean == NULL)
+        goto fail;
+
+    if (current == NOT_FOUND)
+        return new_mean;
+
+    current_mean = to_mean(current);
+    if (current_mean == NULL)
+        goto fail;
+
+    total = PyNumber_Add(PyTuple_GET_ITEM(current_mean, 0), PyTuple_GET_ITEM(new_mean, 0));
+    if (total == NULL)
+        goto fail;
+
+    count = PyNumber_Add(PyTuple_GET_ITEM(current_mean, 1), PyTuple_GET_ITEM(new_mean, 1));
+    if (count == NULL)
+        goto fail;
+
+    mean = PyTuple_Pack(2, total, count);
+
+    fail:
+    Py_XDECREF(current_mean);
+    Py_XDECREF(new_mean);
+    Py_XDECREF(total);
+    Py_XDECREF(count);
+    return mean;
+}
+
+PyObject *
+AtomicDict_ReduceMean_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_mean, 0);
+}
+
+// stateful specialized reducers (reduce_topk, reduce_set, reduce_hll).
+//
+// their state is a mutable object, that is modified in place while it is
+// only referenced by a ReduceTable: when `new` is a single value, `current`
+// comes from the thread's own ReduceTable.
+// when `new` is itself a state, it is being merged either into another
+// ReduceTable, or into the dictionary: then `current` may be visible to
+// other threads, and a new state is always returned instead. the same
+// happens when `current` is NOT_FOUND, because `new` could also be a
+// collection given as input, which must not be modified later.
+// once a state is stored in the dictionary, it is never modified again.
+//
+// the type of the state is chosen so that it can be told apart from a
+// single value: sets and bytearrays are not hashable, and lists are only
+// accepted as values by reduce_topk as collections of values, just like
+// reduce_list does.
+
+static PyObject *
+reduce_topk_parse_k(PyObject *k)
+{
+    if (k == NULL) {
+        PyErr_SetString(PyExc_TypeError, "reduce_topk() missing required argument 'k'");
         return NULL;
     }
-    if (cmp) {
-        Py_DECREF(new);
-        return current;
+    Py_ssize_t k_value = PyLong_AsSsize_t(k);
+    if (k_value == -1 && PyErr_Occurred())
+        return NULL;
+    if (k_value <= 0) {
+        PyErr_SetString(PyExc_ValueError, "k <= 0");
+        return NULL;
     }
-    Py_DECREF(current);
-    return new;
+    return Py_NewRef(k);
 }
 
-int
-AtomicDict_ReduceMax(AtomicDict *self, PyObject *iterable)
-{
-    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_max, 1);
+/**
+ * Insert `value` into the list `top`, sorted in descending order, keeping
+ * at most k items. Equal values keep their insertion order.
+ **/
+static int
+topk_insert(PyObject *top, PyObject *value, Py_ssize_t k)
+{
+    Py_ssize_t lo = 0, hi = PyList_GET_SIZE(top);
+
+    while (lo < hi) {
+        Py_ssize_t mid = lo + (hi - lo) / 2;
+        int gt = PyObject_RichCompareBool(value, PyList_GET_ITEM(top, mid), Py_GT);
+        if (gt < 0)
+            return -1;
+        if (gt) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    if (lo >= k)
+        return 0;
+
+    if (PyList_Insert(top, lo, value) < 0)
+        return -1;
+    if (PyList_GET_SIZE(top) > k)
+        return PyList_SetSlice(top, k, PyList_GET_SIZE(top), NULL);
+    return 0;
 }
 
-PyObject *
-AtomicDict_ReduceMax_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+static inline PyObject *
+reduce_specialized_topk(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *arg)
 {
-    PyObject *iterable = NULL;
-
-    char *kw_list[] = {"iterable", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kw_list, &iterable))
-        goto fail;
+    assert(current != NULL);
+    assert(new != NULL);
+    const Py_ssize_t k = PyLong_AsSsize_t(arg);
+    PyObject *top = NULL;
 
-    int res = AtomicDict_ReduceMax(self, iterable);
-    if (res < 0)
+    if (current == NOT_FOUND) {
+        top = PyList_New(0);
+    } else if (PyList_CheckExact(current) && !PyList_CheckExact(new)) {
+        top = Py_NewRef(current);
+    } else {
+        top = PySequence_List(current);
+    }
+    if (top == NULL)
         goto fail;
 
-    Py_RETURN_NONE;
+    if (PyList_CheckExact(new)) {
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(new); i++) {
+            if (topk_insert(top, PyList_GET_ITEM(new, i), k) < 0)
+                goto fail;
+        }
+    } else {
+        if (topk_insert(top, new, k) < 0)
+            goto fail;
+    }
+    return top;
 
     fail:
+    Py_XDECREF(top);
     return NULL;
 }
 
+PyObject *
+AtomicDict_ReduceTopK_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return reduce_specialized_callable_with_arg(self, args, kwargs, reduce_specialized_topk, "k",
+                                                reduce_topk_parse_k);
+}
+
 static inline PyObject *
-reduce_specialized_min(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new)
+reduce_specialized_set(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *Py_UNUSED(arg))
 {
     assert(current != NULL);
     assert(new != NULL);
+    PyObject *result = NULL;
+
     if (current == NOT_FOUND) {
-        Py_INCREF(new);
-        return new;
+        result = PySet_New(NULL);
+    } else if (PySet_CheckExact(current) && !PySet_CheckExact(new)) {
+        result = Py_NewRef(current);
+    } else {
+        result = PySet_New(current);
     }
-    Py_INCREF(current);
-    Py_INCREF(new);
-    const int cmp = PyObject_RichCompareBool(current, new, Py_LE);
-    if (cmp < 0) {
-        Py_DECREF(current);
-        Py_DECREF(new);
+    if (result == NULL)
         return NULL;
+
+    if (PySet_CheckExact(new)) {
+        PyObject *union_ = PyNumber_InPlaceOr(result, new);
+        Py_DECREF(result);
+        return union_;
     }
-    if (cmp) {
-        Py_DECREF(new);
-        return current;
-    }
-    Py_DECREF(current);
-    return new;
-}
 
-int
-AtomicDict_ReduceMin(AtomicDict *self, PyObject *iterable)
-{
-    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_min, 1);
+    if (PySet_Add(result, new) < 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
 }
 
 PyObject *
-AtomicDict_ReduceMin_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+AtomicDict_ReduceSet_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *iterable = NULL;
+    return reduce_specialized_callable(self, args, kwargs, reduce_specialized_set, 0);
+}
 
-    char *kw_list[] = {"iterable", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kw_list, &iterable))
-        goto fail;
+// reduce_hll keeps HyperLogLog sketches of 2 ** precision one-byte
+// registers in bytearrays.
 
-    int res = AtomicDict_ReduceMin(self, iterable);
-    if (res < 0)
-        goto fail;
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 16
+#define HLL_DEFAULT_PRECISION 12
 
-    Py_RETURN_NONE;
+static PyObject *
+reduce_hll_parse_precision(PyObject *precision)
+{
+    if (precision == NULL || precision == Py_None)
+        return PyLong_FromLong(HLL_DEFAULT_PRECISION);
 
-    fail:
-    return NULL;
+    long p = PyLong_AsLong(precision);
+    if (p == -1 && PyErr_Occurred())
+        return NULL;
+    if (p < HLL_MIN_PRECISION || p > HLL_MAX_PRECISION) {
+        PyErr_Format(PyExc_ValueError, "precision must be between %d and %d", HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+        return NULL;
+    }
+    return Py_NewRef(precision);
 }
 
-static inline PyObject *
-to_list(PyObject *maybe_list)
+static int
+hll_add(uint8_t *registers, int precision, PyObject *item)
 {
-    assert(maybe_list != NULL);
-    if (PyList_CheckExact(maybe_list)) {
-        Py_INCREF(maybe_list);
-        return maybe_list;
+    Py_hash_t hash = PyObject_Hash(item);
+    if (hash == -1)
+        return -1;
+
+    // Python's hash of small ints is the identity: mix it
+    uint64_t x = reduce_table_int64_hash((int64_t) hash);
+    uint64_t index = x >> (64 - precision);
+    uint64_t w = x << precision;
+    uint8_t rank = 1;
+    while (rank <= 64 - precision && !(w & (1ULL << 63))) {
+        w <<= 1;
+        rank++;
     }
 
-    PyObject *list = NULL;
-    list = PyList_New(1);
-    if (list == NULL)
-        return NULL;
-    Py_INCREF(maybe_list); // not a list
-    if (PyList_SetItem(list, 0, maybe_list) < 0) {
-        Py_DECREF(list);
-        return NULL;
+    if (registers[index] < rank) {
+        registers[index] = rank;
     }
-    return list;
+    return 0;
+}
+
+static int
+hll_check_sketch(PyObject *sketch, Py_ssize_t size)
+{
+    if (!PyByteArray_CheckExact(sketch)) {
+        PyErr_Format(PyExc_TypeError, "%R is not a HyperLogLog sketch", sketch);
+        return -1;
+    }
+    if (PyByteArray_GET_SIZE(sketch) != size) {
+        PyErr_Format(PyExc_ValueError, "expected a sketch of %zd registers, got %zd", size,
+                     PyByteArray_GET_SIZE(sketch));
+        return -1;
+    }
+    return 0;
 }
 
 static inline PyObject *
-reduce_specialized_list(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new)
+reduce_specialized_hll(PyObject *Py_UNUSED(key), PyObject *current, PyObject *new, PyObject *arg)
 {
     assert(current != NULL);
     assert(new != NULL);
+    const int precision = (int) PyLong_AsLong(arg);
+    const Py_ssize_t size = (Py_ssize_t) 1 << precision;
+    PyObject *result = NULL;
+
+    if (PyByteArray_CheckExact(new) && hll_check_sketch(new, size) < 0)
+        return NULL;
+
     if (current == NOT_FOUND) {
-        return to_list(new);
+        result = PyByteArray_FromStringAndSize(NULL, size);
+        if (result == NULL)
+            return NULL;
+        memset(PyByteArray_AS_STRING(result), 0, size);
+    } else {
+        if (hll_check_sketch(current, size) < 0)
+            return NULL;
+        if (PyByteArray_CheckExact(new)) {
+            result = PyByteArray_FromObject(current);
+            if (result == NULL)
+                return NULL;
+        } else {
+            result = Py_NewRef(current);
+        }
     }
-    PyObject *current_list = to_list(current);
-    if (current_list == NULL)
-        return NULL;
-    PyObject *new_list = to_list(new);
-    if (new_list == NULL) {
-        Py_DECREF(current_list);
+
+    uint8_t *registers = (uint8_t *) PyByteArray_AS_STRING(result);
+    if (PyByteArray_CheckExact(new)) {
+        const uint8_t *new_registers = (const uint8_t *) PyByteArray_AS_STRING(new);
+        for (Py_ssize_t i = 0; i < size; i++) {
+            if (registers[i] < new_registers[i]) {
+                registers[i] = new_registers[i];
+            }
+        }
+    } else {
+        if (hll_add(registers, precision, new) < 0) {
+            Py_DECREF(result);
+            return NULL;
+        }
+    }
+    return result;
+}
+
+PyObject *
+AtomicDict_ReduceHLL_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    return reduce_specialized_callable_with_arg(self, args, kwargs, reduce_specialized_hll, "precision",
+                                                reduce_hll_parse_precision);
+}
+
+PyObject *
+AtomicDict_HLLEstimate(PyObject *Py_UNUSED(cls), PyObject *sketch)
+{
+    if (!PyByteArray_CheckExact(sketch)) {
+        PyErr_Format(PyExc_TypeError, "%R is not a HyperLogLog sketch", sketch);
         return NULL;
     }
-    PyObject *concat = PyNumber_Add(current_list, new_list);
-    Py_DECREF(current_list);
-    Py_DECREF(new_list);
-    if (concat == NULL) {
+
+    Py_ssize_t m = PyByteArray_GET_SIZE(sketch);
+    int precision = HLL_MIN_PRECISION;
+    while (precision <= HLL_MAX_PRECISION && ((Py_ssize_t) 1 << precision) != m) {
+        precision++;
+    }
+    if (precision > HLL_MAX_PRECISION) {
+        PyErr_Format(PyExc_ValueError, "%zd is not a valid number of registers", m);
         return NULL;
     }
-    return concat;
-}
 
-int
-AtomicDict_ReduceList(AtomicDict *self, PyObject *iterable)
-{
-    return AtomicDict_Reduce_impl(self, iterable, NULL, reduce_specialized_list, 1);
+    const uint8_t *registers = (const uint8_t *) PyByteArray_AS_STRING(sketch);
+    double sum = 0;
+    Py_ssize_t zeros = 0;
+    for (Py_ssize_t i = 0; i < m; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        if (registers[i] == 0) {
+            zeros++;
+        }
+    }
+
+    double alpha;
+    if (m == 16) {
+        alpha = 0.673;
+    } else if (m == 32) {
+        alpha = 0.697;
+    } else if (m == 64) {
+        alpha = 0.709;
+    } else {
+        alpha = 0.7213 / (1 + 1.079 / (double) m);
+    }
+
+    double estimate = alpha * (double) m * (double) m / sum;
+    if (estimate <= 2.5 * (double) m && zeros > 0) {
+        // small range correction (linear counting)
+        estimate = (double) m * log((double) m / (double) zeros);
+    }
+
+    return PyFloat_FromDouble(estimate);
 }
 
 PyObject *
-AtomicDict_ReduceList_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+AtomicDict_ReduceBatched_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
     PyObject *iterable = NULL;
+    PyObject *aggregate_many = NULL;
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
+    PyObject *threads = NULL;
+    PyObject *max_buffered_keys = NULL;
+    PyObject *flush_interval = NULL;
+    PyObject *size_hint = NULL;
+    AtomicDictReduceOptions options;
+
+    char *kw_list[] = {
+        "iterable", "aggregate_many", "keys", "values", "threads", "max_buffered_keys", "flush_interval", "size_hint",
+        NULL,
+    };
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OO$OOOOOO", kw_list, &iterable, &aggregate_many, &keys, &values,
+                                     &threads, &max_buffered_keys, &flush_interval, &size_hint))
+        goto fail;
+
+    if (aggregate_many == NULL) {
+        PyErr_SetString(PyExc_TypeError, "reduce_batched() missing required argument 'aggregate_many'");
+        goto fail;
+    }
 
-    char *kw_list[] = {"iterable", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kw_list, &iterable))
+    if (!PyCallable_Check(aggregate_many)) {
+        PyErr_Format(PyExc_TypeError, "%R is not callable.", aggregate_many);
         goto fail;
+    }
 
-    int res = AtomicDict_ReduceList(self, iterable);
-    if (res < 0)
+    if (reduce_check_input(&iterable, &keys, &values, 1) < 0)
+        goto fail;
+
+    if (reduce_parse_options(threads, max_buffered_keys, flush_interval, size_hint, &options) < 0)
+        goto fail;
+
+    // aggregate_many is passed along as the aggregate: reduce_collect_values
+    // ignores it, and the flush of a batched table calls it
+    if (reduce_maybe_parallel(self, iterable, keys, values, aggregate_many, reduce_collect_values, 0, &options) < 0)
         goto fail;
 
     Py_RETURN_NONE;
@@ -879,117 +2855,159 @@ AtomicDict_ReduceList_callable(AtomicDict *self, PyObject *args, PyObject *kwarg
     return NULL;
 }
 
-static inline PyObject *
-reduce_count_zip_iter_with_ones(AtomicDict *Py_UNUSED(self), PyObject *iterable)
+static int
+reduce_get_int64_buffer(PyObject *obj, Py_buffer *view, const char *name)
 {
-    // we want to return `zip(iterable, itertools.repeat(1))`
-    PyObject *iterator = NULL;
-    PyObject *builtin_zip = NULL;
-    PyObject *itertools = NULL;
-    PyObject *itertools_namespace = NULL;
-    PyObject *itertools_repeat = NULL;
-    PyObject *one = NULL;
-    PyObject *repeat_one = NULL;
-    PyObject *zipped = NULL;
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+        return -1;
 
-    iterator = PyObject_GetIter(iterable);
-    if (iterator == NULL) {
-        PyErr_Format(PyExc_TypeError, "%R is not iterable.", iterable);
-        goto fail;
+    const char *format = view->format == NULL ? "B" : view->format;
+    if (*format == '@' || *format == '=') {
+        format++;
+    }
+    if (view->ndim != 1 || view->itemsize != 8 || (strcmp(format, "q") != 0 && strcmp(format, "l") != 0)) {
+        PyErr_Format(PyExc_TypeError, "%s must be a 1-dimensional buffer of int64 (format 'q')", name);
+        PyBuffer_Release(view);
+        return -1;
     }
+    return 0;
+}
 
-#if PY_VERSION_HEX >= 0x030D0000 // 3.13
-    PyObject *builtins = PyEval_GetFrameBuiltins();
-#else
-    PyObject *builtins = PyEval_GetBuiltins();
-#endif
+static int
+reduce_flush_int64(AtomicDict *self, int64_t key, int64_t sum)
+{
+    PyObject *key_obj = NULL;
+    PyObject *sum_obj = NULL;
 
-    if (PyDict_GetItemStringRef(builtins, "zip", &builtin_zip) < 0)
+    key_obj = PyLong_FromLongLong(key);
+    if (key_obj == NULL)
         goto fail;
 
-#if PY_VERSION_HEX >= 0x030D0000 // 3.13
-    Py_DECREF(builtins);
-#endif
-
-    // the following lines implement this Python code:
-    //     import itertools
-    //     itertools.repeat(1)
-    itertools = PyImport_ImportModule("itertools");
-    if (itertools == NULL)
-        goto fail;
-    itertools_namespace = PyModule_GetDict(itertools);
-    if (itertools_namespace == NULL)
-        goto fail;
-    Py_INCREF(itertools_namespace);
-    if (PyDict_GetItemStringRef(itertools_namespace, "repeat", &itertools_repeat) < 0)
-        goto fail;
-    Py_CLEAR(itertools_namespace);
-    one = PyLong_FromLong(1);
-    if (one == NULL)
-        goto fail;
-    repeat_one = PyObject_CallFunctionObjArgs(itertools_repeat, one, NULL);
-    if (repeat_one == NULL)
+    sum_obj = PyLong_FromLongLong(sum);
+    if (sum_obj == NULL)
         goto fail;
 
-    zipped = PyObject_CallFunctionObjArgs(builtin_zip, iterator, repeat_one, NULL);
-    if (zipped == NULL)
+    if (flush_one(self, key_obj, NOT_FOUND, sum_obj, NULL, reduce_specialized_sum, 1) < 0)
         goto fail;
 
-    Py_DECREF(iterator);
-    Py_DECREF(builtin_zip);
-    Py_DECREF(itertools);
-    Py_DECREF(itertools_repeat);
-    Py_DECREF(one);
-    Py_DECREF(repeat_one);
-    return zipped;
+    Py_DECREF(key_obj);
+    Py_DECREF(sum_obj);
+    return 0;
+
     fail:
-    Py_XDECREF(iterator);
-    Py_XDECREF(builtin_zip);
-    Py_XDECREF(itertools);
-    Py_XDECREF(itertools_namespace);
-    Py_XDECREF(itertools_repeat);
-    Py_XDECREF(one);
-    Py_XDECREF(repeat_one);
-    return NULL;
+    Py_XDECREF(key_obj);
+    Py_XDECREF(sum_obj);
+    return -1;
 }
 
+/**
+ * Like reduce_sum(keys=..., values=...), but reading raw int64 keys and
+ * values from two buffers.
+ *
+ * The sums are computed in a ReduceTableInt64, without creating any Python
+ * object, and without holding the GIL. Then, each distinct key and its sum
+ * are boxed once, and flushed.
+ * If a sum would overflow int64, the partial sum is flushed right away, and
+ * the aggregation resumes from there: the result is exact.
+ **/
 int
-AtomicDict_ReduceCount(AtomicDict *self, PyObject *iterable)
+AtomicDict_ReduceSumBuffer(AtomicDict *self, PyObject *keys, PyObject *values)
 {
-    PyObject *it = NULL;
+    Py_buffer keys_view = {0};
+    Py_buffer values_view = {0};
+    int have_keys = 0, have_values = 0;
+    ReduceTableInt64 *table = NULL;
 
-    // todo: extend to all mappings
-    //   the problem is that PyMapping_Check(iterable) returns 1 also when iterable is a list or tuple
-    if (PyDict_Check(iterable)) {  // cannot fail: no error check
-        it = PyDict_Items(iterable);
-    } else {
-        it = reduce_count_zip_iter_with_ones(self, iterable);
-    }
-    if (it == NULL)
+    if (reduce_get_int64_buffer(keys, &keys_view, "keys") < 0)
         goto fail;
+    have_keys = 1;
 
-    const int res = AtomicDict_Reduce_impl(self, it, NULL, reduce_specialized_sum, 1);
-    if (res < 0)
+    if (reduce_get_int64_buffer(values, &values_view, "values") < 0)
         goto fail;
+    have_values = 1;
 
-    Py_DECREF(it);
+    if (keys_view.shape[0] != values_view.shape[0]) {
+        PyErr_SetString(PyExc_ValueError, "len(keys) != len(values)");
+        goto fail;
+    }
+
+    table = reduce_table_int64_new(REDUCE_TABLE_INITIAL_LOG_SIZE);
+    if (table == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    const char *keys_buf = keys_view.buf;
+    const char *values_buf = values_view.buf;
+    const Py_ssize_t size = keys_view.shape[0];
+    Py_ssize_t i = 0;
+
+    while (i < size) {
+        ReduceTableInt64Entry *overflowed = NULL;
+        int64_t key = 0, value = 0;
+        int res = 0;
+
+        Py_BEGIN_ALLOW_THREADS
+        for (; i < size; i++) {
+            // the buffers need not be aligned (e.g. memoryview.cast)
+            memcpy(&key, keys_buf + i * 8, 8);
+            memcpy(&value, values_buf + i * 8, 8);
+            res = reduce_table_int64_add(table, key, value, &overflowed);
+            if (res != 0)
+                break;
+        }
+        Py_END_ALLOW_THREADS
+
+        if (res < 0) {
+            PyErr_NoMemory();
+            goto fail;
+        }
+
+        if (res > 0) {
+            if (reduce_flush_int64(self, overflowed->key, overflowed->sum) < 0)
+                goto fail;
+            overflowed->sum = value;
+            i++;
+        }
+    }
+
+    if (table->used > 0) {
+        // see reduce_flush
+        uint64_t start = REHASH(_Py_ThreadId()) % table->used;
+        for (uint64_t j = 0; j < table->used; j++) {
+            ReduceTableInt64Entry *entry = &table->entries[(start + j) % table->used];
+            if (reduce_flush_int64(self, entry->key, entry->sum) < 0)
+                goto fail;
+        }
+    }
+
+    reduce_table_int64_free(table);
+    PyBuffer_Release(&keys_view);
+    PyBuffer_Release(&values_view);
     return 0;
+
     fail:
-    Py_XDECREF(it);
+    reduce_table_int64_free(table);
+    if (have_keys) {
+        PyBuffer_Release(&keys_view);
+    }
+    if (have_values) {
+        PyBuffer_Release(&values_view);
+    }
     return -1;
 }
 
 PyObject *
-AtomicDict_ReduceCount_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
+AtomicDict_ReduceSumBuffer_callable(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *iterable = NULL;
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
 
-    char *kw_list[] = {"iterable", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kw_list, &iterable))
+    char *kw_list[] = {"keys", "values", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", kw_list, &keys, &values))
         goto fail;
 
-    int res = AtomicDict_ReduceCount(self, iterable);
-    if (res < 0)
+    if (AtomicDict_ReduceSumBuffer(self, keys, values) < 0)
         goto fail;
 
     Py_RETURN_NONE;
@@ -11,44 +11,57 @@
 #include <cereggii/internal/py_core.h>
 
 
+/**
+ * Create an iterator over the entries of meta, from position to stop,
+ * skipping the pages of the other partitions.
+ * When batched, it yields the items of one page at a time.
+ * Steals a reference to meta.
+ **/
+static AtomicDictFastIterator *
+fast_iterator_new(AtomicDict *self, AtomicDictMeta *meta, uint64_t position, uint64_t stop, int partitions,
+                  int batched)
+{
+    AtomicDictFastIterator *iter = PyObject_New(AtomicDictFastIterator, &AtomicDictFastIterator_Type);
+    if (iter == NULL) {
+        Py_DECREF(meta);
+        return NULL;
+    }
+    iter->dict = (AtomicDict *) Py_NewRef(self);
+    iter->meta = meta;
+    iter->position = position;
+    iter->stop = stop;
+    iter->partitions = partitions;
+    iter->batched = batched;
+    iter->kind = ATOMIC_DICT_VIEW_ITEMS;
+    return iter;
+}
+
 PyObject *
 AtomicDict_FastIter(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
-    int partitions = 1, this_partition = 0;
+    int partitions = 1, this_partition = 0, batched = 0;
 
-    char *kw_list[] = {"partitions", "this_partition", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ii", kw_list, &partitions, &this_partition))
-        goto fail_parse;
+    char *kw_list[] = {"partitions", "this_partition", "batched", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ii$p", kw_list, &partitions, &this_partition, &batched))
+        goto fail;
 
     if (partitions <= 0) {
         PyErr_SetString(PyExc_ValueError, "partitions <= 0");
-        goto fail_parse;
+        goto fail;
     }
     if (this_partition < 0 || this_partition >= partitions) {
         PyErr_SetString(PyExc_ValueError, "this_partition not in range(partitions)");
-        goto fail_parse;
+        goto fail;
     }
 
-    AtomicDictFastIterator *iter = NULL;
-    Py_INCREF(self);
-
-    iter = PyObject_New(AtomicDictFastIterator, &AtomicDictFastIterator_Type);
-    if (iter == NULL)
-        goto fail;
-    iter->meta = NULL;
-    iter->meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
-    if (iter->meta == NULL)
+    AtomicDictMeta *meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
+    if (meta == NULL)
         goto fail;
-    iter->dict = self;
-    iter->position = this_partition * ATOMIC_DICT_ENTRIES_IN_PAGE;
-    iter->partitions = partitions;
 
-    return (PyObject *) iter;
+    return (PyObject *) fast_iterator_new(self, meta, (uint64_t) this_partition * ATOMIC_DICT_ENTRIES_IN_PAGE,
+                                          UINT64_MAX, partitions, batched);
 
     fail:
-    Py_XDECREF(iter);
-    Py_DECREF(self);
-    fail_parse:
     return NULL;
 }
 
@@ -67,6 +80,102 @@ PyObject *AtomicDictFastIterator_GetIter(AtomicDictFastIterator *self)
     return (PyObject *) self;
 }
 
+static inline void
+fast_iterator_advance(AtomicDictFastIterator *self)
+{
+    if (((self->position + 1) & (ATOMIC_DICT_ENTRIES_IN_PAGE - 1)) == 0) {
+        self->position =
+            (self->position & ~(ATOMIC_DICT_ENTRIES_IN_PAGE - 1))
+            + self->partitions * ATOMIC_DICT_ENTRIES_IN_PAGE;
+    }
+    else {
+        self->position++;
+    }
+}
+
+static PyObject *
+fast_iterator_pair(PyObject *first, PyObject *second)
+{
+    // steals both references, also on failure
+    PyObject *pair = PyTuple_New(2);
+    if (pair == NULL) {
+        Py_DECREF(first);
+        Py_DECREF(second);
+        return NULL;
+    }
+    PyTuple_SET_ITEM(pair, 0, first);
+    PyTuple_SET_ITEM(pair, 1, second);
+    return pair;
+}
+
+static void
+fast_iterator_concurrent_usage_detected(void)
+{
+    PyErr_SetString(Cereggii_ConcurrentUsageDetected, "please see https://dpdani.github.io/cereggii/api/AtomicDict/#cereggii._cereggii.AtomicDict.fast_iter");
+}
+
+/**
+ * Read the live items in the rest of the current page, and return them as a
+ * (keys, values) pair of lists. Pages without live items are skipped.
+ **/
+static PyObject *
+fast_iterator_next_batch(AtomicDictFastIterator *self, int64_t gap)
+{
+    PyObject *keys[ATOMIC_DICT_ENTRIES_IN_PAGE];
+    PyObject *values[ATOMIC_DICT_ENTRIES_IN_PAGE];
+    PyObject *keys_list = NULL;
+    PyObject *values_list = NULL;
+    AtomicDictEntry entry;
+    int count = 0;
+
+    while (count == 0) {
+        if (page_of(self->position) > (uint64_t) gap || self->position >= self->stop) {
+            PyErr_SetNone(PyExc_StopIteration);
+            return NULL;
+        }
+
+        int end_of_page;
+        do {
+            read_entry(get_entry_at(self->position, self->meta), &entry);
+            if (entry.value != NULL) {
+                if (entry.key == NULL || !_Py_TryIncref(entry.key))
+                    goto concurrent_usage_detected;
+                if (!_Py_TryIncref(entry.value)) {
+                    Py_DECREF(entry.key);
+                    goto concurrent_usage_detected;
+                }
+                keys[count] = entry.key;
+                values[count] = entry.value;
+                count++;
+            }
+            end_of_page = ((self->position + 1) & (ATOMIC_DICT_ENTRIES_IN_PAGE - 1)) == 0;
+            fast_iterator_advance(self);
+        } while (!end_of_page && self->position < self->stop);
+    }
+
+    keys_list = PyList_New(count);
+    values_list = PyList_New(count);
+    if (keys_list == NULL || values_list == NULL) {
+        Py_XDECREF(keys_list);
+        Py_XDECREF(values_list);
+        goto fail;
+    }
+    for (int i = 0; i < count; i++) {
+        PyList_SET_ITEM(keys_list, i, keys[i]);
+        PyList_SET_ITEM(values_list, i, values[i]);
+    }
+    return fast_iterator_pair(keys_list, values_list);
+
+    concurrent_usage_detected:
+    fast_iterator_concurrent_usage_detected();
+    fail:
+    for (int i = 0; i < count; i++) {
+        Py_DECREF(keys[i]);
+        Py_DECREF(values[i]);
+    }
+    return NULL;
+}
+
 PyObject *
 AtomicDictFastIterator_Next(AtomicDictFastIterator *self)
 {
@@ -81,23 +190,18 @@ AtomicDictFastIterator_Next(AtomicDictFastIterator *self)
         return NULL;
     }
 
+    if (self->batched)
+        return fast_iterator_next_batch(self, gap);
+
     while (entry.value == NULL) {
-        if (page_of(self->position) > (uint64_t) gap) {
+        if (page_of(self->position) > (uint64_t) gap || self->position >= self->stop) {
             PyErr_SetNone(PyExc_StopIteration);
             return NULL;
         }
 
         entry_p = get_entry_at(self->position, self->meta);
         read_entry(entry_p, &entry);
-
-        if (((self->position + 1) & (ATOMIC_DICT_ENTRIES_IN_PAGE - 1)) == 0) {
-            self->position =
-                (self->position & ~(ATOMIC_DICT_ENTRIES_IN_PAGE - 1))
-                + self->partitions * ATOMIC_DICT_ENTRIES_IN_PAGE;
-        }
-        else {
-            self->position++;
-        }
+        fast_iterator_advance(self);
     }
     if (entry.key == NULL || !_Py_TryIncref(entry.key)) {
         goto concurrent_usage_detected;
@@ -106,8 +210,572 @@ AtomicDictFastIterator_Next(AtomicDictFastIterator *self)
         Py_DECREF(entry.key);
         goto concurrent_usage_detected;
     }
-    return Py_BuildValue("(NN)", entry.key, entry.value);
+    switch (self->kind) {
+        case ATOMIC_DICT_VIEW_KEYS:
+            Py_DECREF(entry.value);
+            return entry.key;
+        case ATOMIC_DICT_VIEW_VALUES:
+            Py_DECREF(entry.key);
+            return entry.value;
+        default:
+            return fast_iterator_pair(entry.key, entry.value);
+    }
     concurrent_usage_detected:
-    PyErr_SetString(Cereggii_ConcurrentUsageDetected, "please see https://dpdani.github.io/cereggii/api/AtomicDict/#cereggii._cereggii.AtomicDict.fast_iter");
+    fast_iterator_concurrent_usage_detected();
+    return NULL;
+}
+
+/**
+ * Split the pages of this dictionary into n contiguous ranges, holding about
+ * the same number of live entries each, and return an iterator for each range.
+ * The last range also covers the pages allocated after this call.
+ **/
+PyObject *
+AtomicDict_IterPartitions(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    Py_ssize_t n;
+    int batched = 0;
+    AtomicDictMeta *meta = NULL;
+    int64_t *live = NULL;
+    PyObject *iterators = NULL;
+
+    char *kw_list[] = {"n", "batched", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|$p", kw_list, &n, &batched))
+        goto fail;
+
+    if (n <= 0) {
+        PyErr_SetString(PyExc_ValueError, "n <= 0");
+        goto fail;
+    }
+
+    meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
+    if (meta == NULL)
+        goto fail;
+
+    int64_t gap = atomic_load_explicit((_Atomic (int64_t) *) &meta->greatest_allocated_page, memory_order_acquire);
+    const int64_t pages = gap + 1;
+    live = PyMem_New(int64_t, pages > 0 ? pages : 1);
+    if (live == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    int64_t total = 0;
+    for (int64_t page_i = 0; page_i < pages; page_i++) {
+        live[page_i] = meta_count_live_entries_in_page(meta, page_i);
+        total += live[page_i];
+    }
+
+    iterators = PyList_New(n);
+    if (iterators == NULL)
+        goto fail;
+
+    int64_t page = 0, start = 0, seen = 0;
+    for (Py_ssize_t k = 0; k < n; k++) {
+        uint64_t stop = UINT64_MAX;
+        if (k < n - 1) {
+            // the first k + 1 partitions should hold (k + 1) / n of the live entries:
+            // a page goes to the partition in which its middle entry falls
+            const int64_t target = total / n * (k + 1) + total % n * (k + 1) / n;
+            while (page < pages && 2 * seen + live[page] <= 2 * target) {
+                seen += live[page];
+                page++;
+            }
+            stop = (uint64_t) page * ATOMIC_DICT_ENTRIES_IN_PAGE;
+        }
+
+        AtomicDictFastIterator *iter = fast_iterator_new(self, (AtomicDictMeta *) Py_NewRef(meta),
+                                                         (uint64_t) start * ATOMIC_DICT_ENTRIES_IN_PAGE, stop, 1,
+                                                         batched);
+        if (iter == NULL)
+            goto fail;
+        PyList_SET_ITEM(iterators, k, (PyObject *) iter);
+        start = page;
+    }
+
+    PyMem_Free(live);
+    Py_DECREF(meta);
+    return iterators;
+
+    fail:
+    PyMem_Free(live);
+    Py_XDECREF(meta);
+    Py_XDECREF(iterators);
+    return NULL;
+}
+
+
+// parallel_for_each
+//
+// the pages are split into ranges, which are taken by the workers one at a
+// time (see parallel_run): a worker that is done with its range takes the
+// next one, so that no worker sits idle while the others are still busy.
+// there are several ranges per worker, so that the work stays balanced even
+// when the live entries are not evenly spread across pages.
+
+#define ATOMIC_DICT_FOR_EACH_RANGES_PER_THREAD 16
+
+typedef struct AtomicDictParallelForEach {
+    AtomicDictMeta *meta;
+    PyObject *fn;
+    uint64_t pages_per_task;
+} AtomicDictParallelForEach;
+
+static int
+for_each_pages(AtomicDictParallel *parallel, PyObject *task)
+{
+    AtomicDictParallelForEach *fe = parallel->arg;
+    AtomicDictFastIterator *iter = NULL;
+    PyObject *batch = NULL;
+
+    uint64_t start = (uint64_t) PyLong_AsUnsignedLongLong(task);
+    if (start == (uint64_t) -1 && PyErr_Occurred())
+        goto fail;
+
+    iter = fast_iterator_new(parallel->self, (AtomicDictMeta *) Py_NewRef(fe->meta), start * ATOMIC_DICT_ENTRIES_IN_PAGE,
+                             (start + fe->pages_per_task) * ATOMIC_DICT_ENTRIES_IN_PAGE, 1, 1);
+    if (iter == NULL)
+        goto fail;
+
+    // a batch holds the items of one page
+    while (!parallel_failed(parallel) && (batch = AtomicDictFastIterator_Next(iter)) != NULL) {
+        PyObject *keys = PyTuple_GET_ITEM(batch, 0);
+        PyObject *values = PyTuple_GET_ITEM(batch, 1);
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(keys); i++) {
+            PyObject *result = PyObject_CallFunctionObjArgs(fe->fn, PyList_GET_ITEM(keys, i), PyList_GET_ITEM(values, i), NULL);
+            if (result == NULL)
+                goto fail;
+            Py_DECREF(result);
+        }
+        Py_CLEAR(batch);
+    }
+    if (PyErr_Occurred()) {
+        if (!PyErr_ExceptionMatches(PyExc_StopIteration))
+            goto fail;
+        PyErr_Clear();
+    }
+
+    Py_DECREF(iter);
+    return 0;
+
+    fail:
+    Py_XDECREF(batch);
+    Py_XDECREF(iter);
+    return -1;
+}
+
+PyObject *
+AtomicDict_ParallelForEach(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *fn = NULL;
+    Py_ssize_t threads;
+    AtomicDictParallel parallel = {0};
+    AtomicDictParallelForEach fe = {0};
+
+    char *kw_list[] = {"fn", "threads", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On", kw_list, &fn, &threads))
+        goto fail;
+
+    if (!PyCallable_Check(fn)) {
+        PyErr_Format(PyExc_TypeError, "%R is not callable.", fn);
+        goto fail;
+    }
+    if (threads <= 0) {
+        PyErr_SetString(PyExc_ValueError, "threads <= 0");
+        goto fail;
+    }
+
+    fe.fn = fn;
+    fe.meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
+    if (fe.meta == NULL)
+        goto fail;
+
+    int64_t gap = atomic_load_explicit((_Atomic (int64_t) *) &fe.meta->greatest_allocated_page, memory_order_acquire);
+    const uint64_t pages = gap >= 0 ? (uint64_t) gap + 1 : 0;
+    fe.pages_per_task = pages / ((uint64_t) threads * ATOMIC_DICT_FOR_EACH_RANGES_PER_THREAD);
+    if (fe.pages_per_task == 0) {
+        fe.pages_per_task = 1;
+    }
+
+    parallel.tasks = PyList_New(0);
+    if (parallel.tasks == NULL)
+        goto fail;
+    for (uint64_t start = 0; start < pages; start += fe.pages_per_task) {
+        PyObject *task = PyLong_FromUnsignedLongLong(start);
+        if (task == NULL)
+            goto fail;
+        int appended = PyList_Append(parallel.tasks, task);
+        Py_DECREF(task);
+        if (appended < 0)
+            goto fail;
+    }
+
+    if (PyList_GET_SIZE(parallel.tasks) > 0) {
+        parallel.self = self;
+        parallel.run = for_each_pages;
+        parallel.arg = &fe;
+        if (parallel_run(&parallel, threads) < 0)
+            goto fail;
+    }
+
+    Py_DECREF(parallel.tasks);
+    Py_DECREF(fe.meta);
+    Py_RETURN_NONE;
+
+    fail:
+    Py_XDECREF(parallel.tasks);
+    Py_XDECREF(fe.meta);
+    return NULL;
+}
+
+
+
+// views
+//
+// keys(), values(), and items() return views that hold no copy of the items:
+// iterating a view scans the pages of the dictionary, like fast_iter.
+// membership in keys() and items() is a lookup, and the length of a view is
+// approx_len of the dictionary.
+
+static PyObject *
+atomic_dict_view_new(AtomicDict *self, int kind)
+{
+    AtomicDictView *view = PyObject_GC_New(AtomicDictView, &AtomicDictView_Type);
+    if (view == NULL)
+        return NULL;
+    view->dict = (AtomicDict *) Py_NewRef(self);
+    view->kind = kind;
+    PyObject_GC_Track(view);
+    return (PyObject *) view;
+}
+
+PyObject *
+AtomicDict_Keys(AtomicDict *self, PyObject *Py_UNUSED(ignored))
+{
+    return atomic_dict_view_new(self, ATOMIC_DICT_VIEW_KEYS);
+}
+
+PyObject *
+AtomicDict_Values(AtomicDict *self, PyObject *Py_UNUSED(ignored))
+{
+    return atomic_dict_view_new(self, ATOMIC_DICT_VIEW_VALUES);
+}
+
+PyObject *
+AtomicDict_Items(AtomicDict *self, PyObject *Py_UNUSED(ignored))
+{
+    return atomic_dict_view_new(self, ATOMIC_DICT_VIEW_ITEMS);
+}
+
+int
+AtomicDictView_traverse(AtomicDictView *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->dict);
+    return 0;
+}
+
+int
+AtomicDictView_clear(AtomicDictView *self)
+{
+    Py_CLEAR(self->dict);
+    return 0;
+}
+
+void
+AtomicDictView_dealloc(AtomicDictView *self)
+{
+    PyObject_GC_UnTrack(self);
+    AtomicDictView_clear(self);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+PyObject *
+AtomicDictView_GetIter(AtomicDictView *self)
+{
+    AtomicDictMeta *meta = (AtomicDictMeta *) AtomicRef_Get(self->dict->metadata);
+    if (meta == NULL)
+        return NULL;
+
+    AtomicDictFastIterator *iter = fast_iterator_new(self->dict, meta, 0, UINT64_MAX, 1, 0);
+    if (iter == NULL)
+        return NULL;
+    iter->kind = self->kind;
+    return (PyObject *) iter;
+}
+
+Py_ssize_t
+AtomicDictView_Len(AtomicDictView *self)
+{
+    PyObject *len = AtomicDict_ApproxLen(self->dict);
+    if (len == NULL)
+        return -1;
+
+    Py_ssize_t len_ssize_t = PyLong_AsSsize_t(len);
+    Py_DECREF(len);
+    if (len_ssize_t < 0 && !PyErr_Occurred()) {
+        // concurrent deletions can make the approximation negative
+        len_ssize_t = 0;
+    }
+    return len_ssize_t;
+}
+
+static int
+atomic_dict_view_contains_value(AtomicDictView *self, PyObject *value)
+{
+    PyObject *iter = AtomicDictView_GetIter(self);
+    if (iter == NULL)
+        return -1;
+
+    int found = 0;
+    PyObject *current;
+    while (!found && (current = AtomicDictFastIterator_Next((AtomicDictFastIterator *) iter)) != NULL) {
+        found = PyObject_RichCompareBool(current, value, Py_EQ);
+        Py_DECREF(current);
+        if (found < 0)
+            goto fail;
+    }
+    if (!found) {
+        if (!PyErr_ExceptionMatches(PyExc_StopIteration))
+            goto fail;
+        PyErr_Clear();
+    }
+
+    Py_DECREF(iter);
+    return found;
+
+    fail:
+    Py_DECREF(iter);
+    return -1;
+}
+
+int
+AtomicDictView_Contains(AtomicDictView *self, PyObject *item)
+{
+    PyObject *key = item;
+    PyObject *value = NULL;
+
+    if (self->kind == ATOMIC_DICT_VIEW_VALUES)
+        return atomic_dict_view_contains_value(self, item);
+
+    if (self->kind == ATOMIC_DICT_VIEW_ITEMS) {
+        if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 2)
+            return 0;
+        key = PyTuple_GET_ITEM(item, 0);
+    }
+
+    PyObject *found = AtomicDict_GetItemOrDefault(self->dict, key, NOT_FOUND);
+    if (found == NULL)
+        return -1;
+
+    int contains = found != NOT_FOUND;
+    if (contains && self->kind == ATOMIC_DICT_VIEW_ITEMS) {
+        value = PyTuple_GET_ITEM(item, 1);
+        contains = PyObject_RichCompareBool(found, value, Py_EQ);
+    }
+    Py_DECREF(found);
+    return contains;
+}
+
+PyObject *
+AtomicDictView_Repr(AtomicDictView *self)
+{
+    static const char *names[] = {
+        [ATOMIC_DICT_VIEW_ITEMS] = "items",
+        [ATOMIC_DICT_VIEW_KEYS] = "keys",
+        [ATOMIC_DICT_VIEW_VALUES] = "values",
+    };
+    return PyUnicode_FromFormat("<AtomicDict %s view at %p>", names[self->kind], self);
+}
+
+
+// snapshot
+//
+// the live items are first read optimistically, without blocking writers.
+// each accessor counts the write operations it starts (see accessor_writes_inc):
+// if no counter changed while the entries were being read, then no write took
+// effect in the meantime, and the items read are those found in the dictionary
+// at a single point in time.
+// a scan is retried up to ATOMIC_DICT_SNAPSHOT_ATTEMPTS times, after which the
+// items are read within a synchronous operation.
+
+#define ATOMIC_DICT_SNAPSHOT_ATTEMPTS 8
+
+/**
+ * Append the live items of meta to keys and values.
+ * Entries that are not referenced by the index are skipped: they belong to
+ * insertions or updates that have not taken effect.
+ * Returns 1 on success, 0 if an entry changed while it was being read, or -1
+ * on error.
+ **/
+static int
+snapshot_scan(AtomicDictMeta *meta, PyObject *keys, PyObject *values)
+{
+    AtomicDictEntry entry;
+    AtomicDictSearchResult result;
+
+    int64_t gap = atomic_load_explicit((_Atomic (int64_t) *) &meta->greatest_allocated_page, memory_order_acquire);
+    if (gap < 0)
+        return 1;
+
+    for (uint64_t ix = 0; page_of(ix) <= (uint64_t) gap; ix++) {
+        read_entry(get_entry_at(ix, meta), &entry);
+        if (entry.value == NULL)
+            continue;
+        if (entry.key == NULL)
+            return 0;
+
+        lookup_entry(meta, ix, entry.hash, &result);
+        if (!result.found)
+            continue;
+
+        if (!_Py_TryIncref(entry.key))
+            return 0;
+        if (!_Py_TryIncref(entry.value)) {
+            Py_DECREF(entry.key);
+            return 0;
+        }
+        int appended = PyList_Append(keys, entry.key) == 0 && PyList_Append(values, entry.value) == 0;
+        Py_DECREF(entry.key);
+        Py_DECREF(entry.value);
+        if (!appended)
+            return -1;
+    }
+
+    return 1;
+}
+
+static Py_ssize_t
+snapshot_count_accessors(AtomicDict *self)
+{
+    Py_ssize_t count = 0;
+    AtomicDictAccessorStorage *storage;
+    FOR_EACH_ACCESSOR(self, storage) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Read the writes counter of the first `count` accessors.
+ * Locking each accessor in turn waits for the write operation it may be
+ * performing: any later one increments its counter again.
+ **/
+static void
+snapshot_read_writes(AtomicDict *self, int64_t *writes, Py_ssize_t count)
+{
+    Py_ssize_t i = 0;
+    AtomicDictAccessorStorage *storage;
+    FOR_EACH_ACCESSOR(self, storage) {
+        if (i == count)
+            break;
+        PyMutex_Lock(&storage->self_mutex);
+        writes[i++] = atomic_load_explicit((_Atomic (int64_t) *) &storage->local_writes, memory_order_relaxed);
+        PyMutex_Unlock(&storage->self_mutex);
+    }
+}
+
+/**
+ * Whether no accessor started a write operation since snapshot_read_writes.
+ * Accessors created in the meantime must not have written at all.
+ **/
+static int
+snapshot_writes_unchanged(AtomicDict *self, const int64_t *writes, Py_ssize_t count)
+{
+    // pairs with the fence in accessor_writes_inc
+    atomic_thread_fence(memory_order_acquire);
+
+    Py_ssize_t i = 0;
+    AtomicDictAccessorStorage *storage;
+    FOR_EACH_ACCESSOR(self, storage) {
+        int64_t expected = i < count ? writes[i] : 0;
+        if (atomic_load_explicit((_Atomic (int64_t) *) &storage->local_writes, memory_order_relaxed) != expected)
+            return 0;
+        i++;
+    }
+    return 1;
+}
+
+PyObject *
+AtomicDict_Snapshot(AtomicDict *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
+    PyObject *snapshot = NULL;
+    AtomicDictMeta *meta = NULL;
+    int64_t *writes = NULL;
+    Py_ssize_t count;
+    int consistent = 0;
+
+    keys = PyList_New(0);
+    if (keys == NULL)
+        goto fail;
+    values = PyList_New(0);
+    if (values == NULL)
+        goto fail;
+
+    for (int attempt = 0; attempt < ATOMIC_DICT_SNAPSHOT_ATTEMPTS && !consistent; attempt++) {
+        if (PyList_SetSlice(keys, 0, PY_SSIZE_T_MAX, NULL) < 0)
+            goto fail;
+        if (PyList_SetSlice(values, 0, PY_SSIZE_T_MAX, NULL) < 0)
+            goto fail;
+
+        count = snapshot_count_accessors(self);
+        PyMem_Free(writes);
+        writes = PyMem_New(int64_t, count > 0 ? count : 1);
+        if (writes == NULL) {
+            PyErr_NoMemory();
+            goto fail;
+        }
+        snapshot_read_writes(self, writes, count);
+
+        meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
+        if (meta == NULL)
+            goto fail;
+
+        int scanned = snapshot_scan(meta, keys, values);
+        if (scanned < 0)
+            goto fail;
+
+        consistent = scanned
+            && snapshot_writes_unchanged(self, writes, count)
+            && (AtomicDictMeta *) self->metadata->reference == meta;
+        Py_CLEAR(meta);
+    }
+
+    if (!consistent) {
+        if (PyList_SetSlice(keys, 0, PY_SSIZE_T_MAX, NULL) < 0)
+            goto fail;
+        if (PyList_SetSlice(values, 0, PY_SSIZE_T_MAX, NULL) < 0)
+            goto fail;
+
+        begin_synchronous_operation(self);
+        meta = (AtomicDictMeta *) AtomicRef_Get(self->metadata);
+        int scanned = meta == NULL ? -1 : snapshot_scan(meta, keys, values);
+        end_synchronous_operation(self);
+        Py_CLEAR(meta);
+        if (scanned < 0)
+            goto fail;
+        assert(scanned == 1);
+    }
+
+    snapshot = PyDict_New();
+    if (snapshot == NULL)
+        goto fail;
+
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(keys); i++) {
+        if (PyDict_SetItem(snapshot, PyList_GET_ITEM(keys, i), PyList_GET_ITEM(values, i)) < 0)
+            goto fail;
+    }
+
+    PyMem_Free(writes);
+    Py_DECREF(keys);
+    Py_DECREF(values);
+    return snapshot;
+
+    fail:
+    PyMem_Free(writes);
+    Py_XDECREF(meta);
+    Py_XDECREF(keys);
+    Py_XDECREF(values);
+    Py_XDECREF(snapshot);
     return NULL;
 }
@@ -17,9 +17,15 @@ lookup(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash,
 {
     // caller must ensure PyObject_Hash(.) didn't raise an error
     const uint64_t d0 = distance0_of(hash, meta);
+    const uint64_t size = 1ull << meta->log_size;
     uint64_t distance = 0;
 
-    for (; distance < (1ull << meta->log_size); distance++) {
+    for (; distance < size; distance++) {
+        // skip the nodes that are neither empty, nor have a matching tag
+        distance = probe_tag(meta, hash, d0, distance, size);
+        if (distance >= size)
+            break;
+
         read_node_at(d0 + distance, &result->node, meta);
 
         if (is_empty(&result->node))
@@ -73,9 +79,14 @@ lookup_entry(AtomicDictMeta *meta, uint64_t entry_ix, Py_hash_t hash,
     // index-only search
 
     const uint64_t d0 = distance0_of(hash, meta);
+    const uint64_t size = 1ull << meta->log_size;
     uint64_t distance = 0;
 
-    for (; distance < 1ull << meta->log_size; distance++) {
+    for (; distance < size; distance++) {
+        distance = probe_index(meta, entry_ix, d0, distance, size);
+        if (distance >= size)
+            break;
+
         read_node_at(d0 + distance, &result->node, meta);
 
         if (is_empty(&result->node))
@@ -162,6 +173,37 @@ AtomicDict_GetItemOrDefaultVarargs(AtomicDict *self, PyObject *args, PyObject *k
     return AtomicDict_GetItemOrDefault(self, key, default_value);
 }
 
+/**
+ * Prefetch the entries that the lookups of these hashes will most likely read.
+ * The index slots should have already been prefetched.
+ **/
+void
+prefetch_entries(AtomicDictMeta *meta, const Py_hash_t *hashes, Py_ssize_t n)
+{
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_hash_t hash = hashes[i];
+        uint64_t d0 = distance0_of(hash, meta);
+        AtomicDictNode node;
+
+        // only look at the beginning of the probe: long clusters
+        // are rare, and are handled by the lookup itself.
+        uint64_t distance = probe_tag(meta, hash, d0, 0, ATOMIC_DICT_BATCH_PROBE_WINDOW);
+        if (distance >= ATOMIC_DICT_BATCH_PROBE_WINDOW)
+            continue;
+
+        read_node_at(d0 + distance, &node, meta);
+
+        if (is_empty(&node))
+            continue;
+        if (is_tombstone(&node))
+            continue;
+
+        if (check_tag(hash, node, meta)) {
+            cereggii_prefetch(get_entry_at(node.index, meta));
+        }
+    }
+}
+
 PyObject *
 AtomicDict_BatchGetItem(AtomicDict *self, PyObject *args, PyObject *kwargs)
 {
@@ -226,24 +268,7 @@ AtomicDict_BatchGetItem(AtomicDict *self, PyObject *args, PyObject *kwargs)
             break;
     }
 
-    for (Py_ssize_t i = chunk_start; i < chunk_end; ++i) {
-        hash = hashes[i % chunk_size];
-        key = keys[i % chunk_size];
-
-        uint64_t d0 = distance0_of(hash, meta);
-        AtomicDictNode node;
-
-        read_node_at(d0, &node, meta);
-
-        if (is_empty(&node))
-            continue;
-        if (is_tombstone(&node))
-            continue;
-
-        if (check_tag(hash, node, meta)) {
-            cereggii_prefetch(get_entry_at(node.index, meta));
-        }
-    }
+    prefetch_entries(meta, hashes + chunk_start % chunk_size, chunk_end - chunk_start);
 
     for (Py_ssize_t i = chunk_start; i < chunk_end; ++i) {
         hash = hashes[i % chunk_size];
@@ -287,3 +312,124 @@ AtomicDict_BatchGetItem(AtomicDict *self, PyObject *args, PyObject *kwargs)
     }
     return NULL;
 }
+
+PyObject *
+AtomicDict_GetMany(AtomicDict *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *keys = NULL;
+    PyObject *default_value = NOT_FOUND;
+    Py_ssize_t chunk_size = 128;
+    PyObject *seq = NULL;
+    PyObject *values = NULL;
+    Py_hash_t *hashes = NULL;
+    PyObject **chunk = NULL;
+    Py_ssize_t chunk_len = 0;
+
+    char *kw_list[] = {"keys", "default", "chunk_size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|On", kw_list, &keys, &default_value, &chunk_size))
+        return NULL;
+
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size <= 0");
+        return NULL;
+    }
+
+    seq = PySequence_Fast(keys, "keys is not a sequence");
+    if (seq == NULL)
+        goto fail;
+
+    const Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    if (chunk_size > n) {
+        chunk_size = n > 0 ? n : 1;
+    }
+
+    values = PyList_New(n);
+    if (values == NULL)
+        goto fail;
+
+    hashes = PyMem_RawMalloc(chunk_size * sizeof(Py_hash_t));
+    chunk = PyMem_RawMalloc(chunk_size * sizeof(PyObject *));
+    if (hashes == NULL || chunk == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    AtomicDictSearchResult result;
+    AtomicDictAccessorStorage *storage = get_or_create_accessor_storage(self);
+    if (storage == NULL)
+        goto fail;
+
+    AtomicDictMeta *meta = NULL;
+    for (Py_ssize_t chunk_start = 0; chunk_start < n; chunk_start += chunk_size) {
+        const Py_ssize_t chunk_end = n - chunk_start < chunk_size ? n : chunk_start + chunk_size;
+
+        // keep the keys alive: hashing them may run arbitrary code
+        for (chunk_len = 0; chunk_start + chunk_len < chunk_end; ++chunk_len) {
+            if (chunk_start + chunk_len >= PySequence_Fast_GET_SIZE(seq)) {
+                PyErr_SetString(PyExc_RuntimeError, "keys changed size during iteration");
+                goto fail;
+            }
+            chunk[chunk_len] = Py_NewRef(PySequence_Fast_GET_ITEM(seq, chunk_start + chunk_len));
+        }
+
+        retry:
+        meta = get_meta(self, storage);
+        if (meta == NULL)
+            goto fail;
+
+        for (Py_ssize_t i = 0; i < chunk_len; ++i) {
+            Py_hash_t hash = PyObject_Hash(chunk[i]);
+            if (hash == -1)
+                goto fail;
+            hashes[i] = hash;
+            cereggii_prefetch(&meta->index[distance0_of(hash, meta)]);
+        }
+
+        prefetch_entries(meta, hashes, chunk_len);
+
+        for (Py_ssize_t i = 0; i < chunk_len; ++i) {
+            PyObject *value = NULL;
+            do {
+                result.found = 0;
+                lookup(meta, chunk[i], hashes[i], &result);
+                if (result.error)
+                    goto fail;
+
+                if (!result.found || result.entry.value == NULL) {
+                    value = Py_NewRef(default_value);
+                } else if (_Py_TryIncref(result.entry.value)) {
+                    value = result.entry.value;
+                }
+                // else, the value is being replaced or deleted: look it up again
+            } while (value == NULL);
+
+            // overwrites the result of a previous try, if any
+            PyObject *previous = PyList_GET_ITEM(values, chunk_start + i);
+            PyList_SET_ITEM(values, chunk_start + i, value);
+            Py_XDECREF(previous);
+        }
+
+        if (get_meta(self, storage) != meta)
+            goto retry;
+
+        for (Py_ssize_t i = 0; i < chunk_len; ++i) {
+            Py_DECREF(chunk[i]);
+        }
+        chunk_len = 0;
+    }
+
+    PyMem_RawFree(hashes);
+    PyMem_RawFree(chunk);
+    Py_DECREF(seq);
+    return values;
+
+    fail:
+    for (Py_ssize_t i = 0; i < chunk_len; ++i) {
+        Py_DECREF(chunk[i]);
+    }
+    PyMem_RawFree(hashes);
+    PyMem_RawFree(chunk);
+    Py_XDECREF(seq);
+    Py_XDECREF(values);
+    return NULL;
+}
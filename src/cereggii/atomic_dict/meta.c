@@ -6,10 +6,11 @@
 
 #include <stdatomic.h>
 #include <cereggii/internal/atomic_dict.h>
+#include <cereggii/internal/py_core.h>
 
 
 AtomicDictMeta *
-AtomicDictMeta_New(uint8_t log_size)
+AtomicDictMeta_New(uint8_t log_size, uint8_t log_entry_size)
 {
     uint64_t *index = NULL;
     AtomicDictMeta *meta = NULL;
@@ -26,6 +27,7 @@ AtomicDictMeta_New(uint8_t log_size)
     meta->greatest_allocated_page = -1;
 
     meta->log_size = log_size;
+    meta->log_entry_size = log_entry_size;
     meta->index = index;
 
     meta->new_gen_metadata = NULL;
@@ -117,6 +119,122 @@ meta_copy_pages(AtomicDictMeta *from_meta, AtomicDictMeta *to_meta)
     return -1;
 }
 
+int64_t
+meta_count_live_entries_in_page(AtomicDictMeta *meta, int64_t page_i)
+{
+    int64_t live = 0;
+    AtomicDictPage *page = atomic_load_explicit((_Atomic (AtomicDictPage *) *) &meta->pages[page_i], memory_order_acquire);
+
+    for (int j = 0; j < ATOMIC_DICT_ENTRIES_IN_PAGE; j++) {
+        if (atomic_load_explicit((_Atomic (PyObject *) *) &PAGE_ENTRY_AT(page, j)->value, memory_order_acquire) != NULL) {
+            live++;
+        }
+    }
+
+    return live;
+}
+
+int64_t
+meta_count_live_entries(AtomicDictMeta *meta)
+{
+    int64_t live = 0;
+    int64_t greatest_allocated_page = atomic_load_explicit((_Atomic (int64_t) *) &meta->greatest_allocated_page, memory_order_acquire);
+
+    for (int64_t page_i = 0; page_i <= greatest_allocated_page; ++page_i) {
+        live += meta_count_live_entries_in_page(meta, page_i);
+    }
+
+    return live;
+}
+
+/**
+ * Copy the live entries of from_meta into freshly allocated pages of to_meta,
+ * densely packed starting from entry 1, and build to_meta's index.
+ *
+ * Must be called while holding the synchronous lock: concurrent mutations of
+ * from_meta would otherwise be lost.
+ * The pages of from_meta are left untouched, so that concurrent readers still
+ * holding a reference to from_meta can safely keep using them.
+ *
+ * Returns the number of copied entries, or -1 on error.
+ **/
+int64_t
+meta_compact_pages(AtomicDictMeta *from_meta, AtomicDictMeta *to_meta)
+{
+    assert(from_meta != NULL);
+    assert(to_meta != NULL);
+
+    if (meta_init_pages(to_meta) < 0)
+        goto fail;
+
+    AtomicDictPage *page = AtomicDictPage_New(to_meta->log_entry_size);
+    if (page == NULL)
+        goto fail;
+    to_meta->pages[0] = page;
+    to_meta->greatest_allocated_page = 0;
+    PAGE_ENTRY_AT(page, 0)->flags = ENTRY_FLAGS_RESERVED;
+    // entry 0 must always be reserved: tombstones are pointers
+    // to entry 0, so it must always be empty.
+
+    const uint64_t pages_in_to_meta = (uint64_t) SIZE_OF(to_meta) >> ATOMIC_DICT_LOG_ENTRIES_IN_PAGE;
+    if (pages_in_to_meta > 1) {
+        to_meta->pages[1] = NULL;
+    }
+
+    uint64_t location = 0;
+    int64_t greatest_allocated_page = atomic_load_explicit((_Atomic (int64_t) *) &from_meta->greatest_allocated_page, memory_order_acquire);
+
+    for (int64_t page_i = 0; page_i <= greatest_allocated_page; ++page_i) {
+        AtomicDictPage *from_page = from_meta->pages[page_i];
+
+        for (int j = 0; j < ATOMIC_DICT_ENTRIES_IN_PAGE; j++) {
+            AtomicDictEntry entry;
+            read_entry(PAGE_ENTRY_AT(from_page, j), &entry);
+            if (entry.value == NULL)
+                continue;
+
+            location++;
+            if (location >= (uint64_t) SIZE_OF(to_meta)) {
+                PyErr_SetString(PyExc_RuntimeError, "compacted AtomicDict is too small.");
+                goto fail;
+            }
+
+            if (page_of(location) > (uint64_t) to_meta->greatest_allocated_page) {
+                page = AtomicDictPage_New(to_meta->log_entry_size);
+                if (page == NULL)
+                    goto fail;
+                to_meta->greatest_allocated_page++;
+                to_meta->pages[to_meta->greatest_allocated_page] = page;
+                if ((uint64_t) to_meta->greatest_allocated_page + 1 < pages_in_to_meta) {
+                    to_meta->pages[to_meta->greatest_allocated_page + 1] = NULL;
+                }
+            }
+
+            AtomicDictEntry *entry_p = get_entry_at(location, to_meta);
+            _Py_SetWeakrefAndIncref(entry.key);
+            _Py_SetWeakrefAndIncref(entry.value);
+            entry_p->flags = ENTRY_FLAGS_RESERVED;
+            entry_p->hash = entry.hash;
+            entry_p->key = entry.key;
+            entry_p->value = entry.value;
+
+            int inserted = unsafe_insert(to_meta, entry.hash, location);
+            if (inserted < 0) {
+                PyErr_SetString(PyExc_RuntimeError, "compacted AtomicDict is too small.");
+                goto fail;
+            }
+        }
+    }
+
+    return (int64_t) location;
+
+    fail:
+    if (!PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    return -1;
+}
+
 int
 AtomicDictMeta_traverse(AtomicDictMeta *self, visitproc visit, void *arg)
 {
@@ -127,8 +245,10 @@ AtomicDictMeta_traverse(AtomicDictMeta *self, visitproc visit, void *arg)
 
     if (self->pages == NULL)
         return 0;
-    if (self->new_gen_metadata)
+    if (self->new_gen_metadata && self->new_gen_metadata->pages != NULL
+        && self->new_gen_metadata->pages[0] == self->pages[0])
         return 0;  // don't visit pages which are shared with other metas
+    // (compactions don't share pages)
 
     int64_t greatest_allocated_page = atomic_load_explicit((_Atomic (int64_t) *) &self->greatest_allocated_page, memory_order_acquire);
     for (int64_t page_i = 0; page_i <= greatest_allocated_page; ++page_i) {
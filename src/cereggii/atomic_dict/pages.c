@@ -5,21 +5,31 @@
 #define PY_SSIZE_T_CLEAN
 
 #include <stdatomic.h>
+#include <stddef.h>
 #include <cereggii/atomic_dict.h>
 #include <cereggii/internal/atomic_dict.h>
 
 
+_Static_assert(sizeof(AtomicDictEntry) == 1 << ATOMIC_DICT_LOG_COMPACT_ENTRY_SIZE, "compact entries must not be padded");
+_Static_assert(sizeof(AtomicDictPaddedEntry) == 1 << ATOMIC_DICT_LOG_PADDED_ENTRY_SIZE, "padded entries must fill a cache line");
+
 AtomicDictPage *
-AtomicDictPage_New(void)
+AtomicDictPage_New(uint8_t log_entry_size)
 {
-    AtomicDictPage *new = NULL;
-    new = PyObject_New(AtomicDictPage, &AtomicDictPage_Type);
+    assert(log_entry_size == ATOMIC_DICT_LOG_PADDED_ENTRY_SIZE || log_entry_size == ATOMIC_DICT_LOG_COMPACT_ENTRY_SIZE);
+    const size_t entries_size = (size_t) ATOMIC_DICT_ENTRIES_IN_PAGE << log_entry_size;
 
-    if (new == NULL)
+    AtomicDictPage *new = NULL;
+    new = PyObject_Malloc(offsetof(AtomicDictPage, entries) + entries_size);
+    if (new == NULL) {
+        PyErr_NoMemory();
         return NULL;
+    }
+    PyObject_Init((PyObject *) new, &AtomicDictPage_Type);
 
+    new->log_entry_size = log_entry_size;
     cereggii_tsan_ignore_writes_begin();
-    memset(new->entries, 0, sizeof(AtomicDictPaddedEntry) * ATOMIC_DICT_ENTRIES_IN_PAGE);
+    memset(new->entries, 0, entries_size);
     cereggii_tsan_ignore_writes_end();
 
     return new;
@@ -30,7 +40,7 @@ AtomicDictPage_traverse(AtomicDictPage *self, visitproc visit, void *arg)
 {
     AtomicDictEntry entry;
     for (int i = 0; i < ATOMIC_DICT_ENTRIES_IN_PAGE; ++i) {
-        entry = self->entries[i].entry;
+        entry = *PAGE_ENTRY_AT(self, i);
 
         if (entry.value == NULL)
             continue;
@@ -47,7 +57,7 @@ AtomicDictPage_clear(AtomicDictPage *self)
 {
     AtomicDictEntry *entry;
     for (int i = 0; i < ATOMIC_DICT_ENTRIES_IN_PAGE; ++i) {
-        entry = &self->entries[i].entry;
+        entry = PAGE_ENTRY_AT(self, i);
 
         if (entry->value == NULL)
             continue;
@@ -86,9 +96,7 @@ reserve_entry_in_inserting_page(AtomicDict *self, AtomicDictMeta *meta, AtomicDi
 
     for (int offset = 0; offset < ATOMIC_DICT_ENTRIES_IN_PAGE; offset += self->reservation_buffer_size) {
         AtomicDictPage *page = atomic_load_explicit((_Atomic (AtomicDictPage *) *) &meta->pages[inserting_page], memory_order_acquire);
-        entry_loc->entry = &(page
-            ->entries[(insert_position + offset) % ATOMIC_DICT_ENTRIES_IN_PAGE]
-            .entry);
+        entry_loc->entry = PAGE_ENTRY_AT(page, (insert_position + offset) % ATOMIC_DICT_ENTRIES_IN_PAGE);
         if (atomic_load_explicit((_Atomic (uint8_t) *) &entry_loc->entry->flags, memory_order_acquire) == 0) {
             uint8_t expected = 0;
             if (atomic_compare_exchange_strong_explicit((_Atomic(uint8_t) *) &entry_loc->entry->flags, &expected, ENTRY_FLAGS_RESERVED, memory_order_acq_rel, memory_order_acquire)) {
@@ -118,7 +126,7 @@ handle_page_allocated(AtomicDict *self, AtomicDictMeta *meta, AtomicDictReservat
     assert(ok);
     cereggii_unused_in_release_build(ok);
     // this cas may fail because another thread helped increasing this counter
-    entry_loc->entry = &(page->entries[0].entry);
+    entry_loc->entry = PAGE_ENTRY_AT(page, 0);
     entry_loc->location = new_page << ATOMIC_DICT_LOG_ENTRIES_IN_PAGE;
     assert(atomic_dict_entry_ix_sanity_check(entry_loc->location, meta));
     reservation_buffer_put(rb, entry_loc->location, self->reservation_buffer_size, meta);
@@ -147,13 +155,12 @@ reserve_entry(AtomicDict *self, AtomicDictMeta *meta, AtomicDictReservationBuffe
         assert((uint64_t) greatest_allocated_page + 1u <= (uint64_t) SIZE_OF(meta) >> ATOMIC_DICT_LOG_ENTRIES_IN_PAGE);
 
         AtomicDictPage *page = NULL;
-        page = AtomicDictPage_New();
+        page = AtomicDictPage_New(meta->log_entry_size);
         if (page == NULL) {
-            PyErr_NoMemory();
             return -1;
         }
 
-        page->entries[0].entry.flags = ENTRY_FLAGS_RESERVED;
+        PAGE_ENTRY_AT(page, 0)->flags = ENTRY_FLAGS_RESERVED;
 
         AtomicDictPage *expected = NULL;
         int64_t new_page = greatest_allocated_page + 1;
@@ -208,11 +215,7 @@ get_entry_at(uint64_t ix, AtomicDictMeta *meta)
     assert(atomic_dict_entry_ix_sanity_check(ix, meta));
     AtomicDictPage *page = atomic_load_explicit((_Atomic (AtomicDictPage *) *) &meta->pages[page_of(ix)], memory_order_acquire);
     assert(page != NULL);
-    return &(
-        page
-            ->entries[position_in_page_of(ix)]
-            .entry
-    );
+    return PAGE_ENTRY_AT(page, position_in_page_of(ix));
 }
 
 void
@@ -0,0 +1,172 @@
+// SPDX-FileCopyrightText: 2023-present dpdani <git@danieleparmeggiani.me>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdatomic.h>
+#include <cereggii/atomic_event.h>
+#include <cereggii/internal/atomic_dict.h>
+#include <cereggii/vendor/pythoncapi_compat/pythoncapi_compat.h>
+#include <pythread.h>  // must be after pythoncapi_compat.h
+
+
+// parallel execution of tasks.
+//
+// the workers take one task at a time from a shared list, until there are
+// no more tasks, or until one of them fails.
+// the calling thread is one of the workers, the others are started with
+// PyThread_start_new_thread and attach to the interpreter with PyGILState_Ensure.
+
+static PyObject *
+fetch_error(void)
+{
+#if PY_VERSION_HEX >= 0x030C0000 // 3.12
+    return PyErr_GetRaisedException();
+#else
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+    if (traceback != NULL) {
+        PyException_SetTraceback(value, traceback);
+    }
+    Py_XDECREF(type);
+    Py_XDECREF(traceback);
+    return value;
+#endif
+}
+
+static void
+restore_error(PyObject *error)
+{
+    // steals a reference to error
+#if PY_VERSION_HEX >= 0x030C0000 // 3.12
+    PyErr_SetRaisedException(error);
+#else
+    PyErr_Restore(Py_NewRef((PyObject *) Py_TYPE(error)), error, PyException_GetTraceback(error));
+#endif
+}
+
+int
+parallel_failed(AtomicDictParallel *parallel)
+{
+    return atomic_load_explicit((_Atomic (int) *) &parallel->failed, memory_order_relaxed);
+}
+
+static void
+parallel_run_tasks(AtomicDictParallel *parallel)
+{
+    const Py_ssize_t tasks = PyList_GET_SIZE(parallel->tasks);
+
+    while (!parallel_failed(parallel)) {
+        Py_ssize_t i = atomic_fetch_add_explicit((_Atomic (Py_ssize_t) *) &parallel->next_task, 1, memory_order_relaxed);
+        if (i >= tasks)
+            break;
+
+        if (parallel->run(parallel, PyList_GET_ITEM(parallel->tasks, i)) < 0) {
+            PyObject *error = fetch_error();
+            PyMutex_Lock(&parallel->error_mutex);
+            if (parallel->error == NULL) {
+                parallel->error = error;
+                error = NULL;
+            }
+            atomic_store_explicit((_Atomic (int) *) &parallel->failed, 1, memory_order_relaxed);
+            PyMutex_Unlock(&parallel->error_mutex);
+            Py_XDECREF(error);
+            break;
+        }
+    }
+}
+
+static void
+parallel_worker(void *arg)
+{
+    AtomicDictParallel *parallel = arg;
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+
+    parallel_run_tasks(parallel);
+
+    if (atomic_fetch_sub_explicit((_Atomic (int) *) &parallel->running, 1, memory_order_acq_rel) == 1) {
+        AtomicEvent_Set(parallel->done);
+    }
+
+    PyGILState_Release(gil_state);
+}
+
+/**
+ * Run parallel->run on each of parallel->tasks, with up to `threads` workers.
+ * The caller must set self, tasks, run, and optionally arg; the other
+ * fields must be zeroed.
+ * Returns -1 with the first exception raised by any worker set.
+ **/
+int
+parallel_run(AtomicDictParallel *parallel, Py_ssize_t threads)
+{
+    assert(parallel->tasks != NULL && PyList_CheckExact(parallel->tasks));
+    assert(parallel->run != NULL);
+    assert(threads > 0);
+
+    if (threads > PyList_GET_SIZE(parallel->tasks)) {
+        threads = PyList_GET_SIZE(parallel->tasks);
+    }
+    if (threads > INT_MAX) {
+        threads = INT_MAX;
+    }
+
+    parallel->done = (AtomicEvent *) PyObject_CallObject((PyObject *) &AtomicEvent_Type, NULL);
+    if (parallel->done == NULL)
+        goto fail;
+
+    const int workers = threads > 0 ? (int) threads - 1 : 0;
+    int started = 0;
+    int must_wait = workers > 0;
+    parallel->running = workers;
+    for (; started < workers; started++) {
+        if (PyThread_start_new_thread(parallel_worker, parallel) == PYTHREAD_INVALID_THREAD_ID)
+            break;
+    }
+    if (started < workers) {
+        // carry on with the workers that were started
+        const int not_started = workers - started;
+        if (atomic_fetch_sub_explicit((_Atomic (int) *) &parallel->running, not_started, memory_order_acq_rel) == not_started) {
+            // the started workers are already done, and nobody will set parallel->done
+            must_wait = 0;
+        }
+    }
+
+    parallel_run_tasks(parallel);
+
+    if (must_wait) {
+        AtomicEvent_Wait(parallel->done);
+    }
+    Py_CLEAR(parallel->done);
+
+    if (parallel->error != NULL) {
+        restore_error(parallel->error);
+        parallel->error = NULL;
+        goto fail;
+    }
+
+    return 0;
+    fail:
+    Py_CLEAR(parallel->done);
+    return -1;
+}
+
+int
+parse_threads(PyObject *threads_arg, Py_ssize_t *threads)
+{
+    // threads_arg == NULL or None means that the argument was not given
+    *threads = 0;
+    if (threads_arg == NULL || threads_arg == Py_None)
+        return 0;
+
+    *threads = PyLong_AsSsize_t(threads_arg);
+    if (*threads == -1 && PyErr_Occurred())
+        return -1;
+    if (*threads <= 0) {
+        PyErr_SetString(PyExc_ValueError, "threads <= 0");
+        return -1;
+    }
+    return 0;
+}
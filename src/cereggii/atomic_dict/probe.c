@@ -0,0 +1,230 @@
+// SPDX-FileCopyrightText: 2023-present dpdani <git@danieleparmeggiani.me>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <cereggii/internal/atomic_dict.h>
+
+// vectorized probing of the index.
+//
+// the kernels only look for candidates: a node that is either empty, or
+// that matches (node & mask) == value.
+// the caller must then read the candidate node again with read_node_at,
+// and proceed as it would have without vectorization.
+// this way, vector loads never need to be atomic as a whole: a node that
+// was skipped can only have been seen as neither empty nor matching, which
+// is the same as having read it a little earlier.
+//
+// when running with the thread sanitizer, only the scalar kernel is used:
+// vector loads are not atomic loads.
+
+#if !defined(CEREGGII_THREAD_SANITIZER)
+#  if defined(__x86_64__) || defined(_M_X64)
+#    include <immintrin.h>
+#    if defined(__AVX2__)
+#      define CEREGGII_PROBE_AVX2 1
+#    elif defined(__GNUC__) || defined(__clang__)
+#      define CEREGGII_PROBE_AVX2 1
+#      define CEREGGII_PROBE_AVX2_DISPATCH 1
+#    endif
+#    if defined(__SSE4_1__) || defined(__AVX2__)
+#      define CEREGGII_PROBE_SSE 1
+#    endif
+#  elif defined(__aarch64__) || defined(_M_ARM64)
+#    include <arm_neon.h>
+#    define CEREGGII_PROBE_NEON 1
+#  endif
+#endif
+
+
+static inline uint64_t
+load_node(const uint64_t *index, uint64_t position)
+{
+    return atomic_load_explicit((_Atomic (uint64_t) *) &index[position], memory_order_acquire);
+}
+
+static inline int
+is_candidate(uint64_t node, uint64_t value, uint64_t mask)
+{
+    return node == 0 || (node & mask) == value;
+}
+
+static uint64_t
+probe_scalar(const uint64_t *index, uint64_t size_mask, uint64_t d0, uint64_t distance, uint64_t limit,
+             uint64_t value, uint64_t mask)
+{
+    for (; distance < limit; distance++) {
+        if (is_candidate(load_node(index, (d0 + distance) & size_mask), value, mask))
+            return distance;
+    }
+    return limit;
+}
+
+#if defined(CEREGGII_PROBE_SSE)
+static uint64_t
+probe_sse(const uint64_t *index, uint64_t size_mask, uint64_t d0, uint64_t distance, uint64_t limit,
+          uint64_t value, uint64_t mask)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v_value = _mm_set1_epi64x((int64_t) value);
+    const __m128i v_mask = _mm_set1_epi64x((int64_t) mask);
+
+    while (distance < limit) {
+        uint64_t position = (d0 + distance) & size_mask;
+        if (position + 2 > size_mask + 1 || distance + 2 > limit) {
+            if (is_candidate(load_node(index, position), value, mask))
+                return distance;
+            distance++;
+            continue;
+        }
+
+        __m128i nodes = _mm_loadu_si128((const __m128i *) &index[position]);
+        __m128i empty = _mm_cmpeq_epi64(nodes, zero);
+        __m128i match = _mm_cmpeq_epi64(_mm_and_si128(nodes, v_mask), v_value);
+        int bits = _mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(empty, match)));
+        if (bits)
+            return distance + (bits & 1 ? 0 : 1);
+        distance += 2;
+    }
+    return limit;
+}
+#endif
+
+#if defined(CEREGGII_PROBE_AVX2)
+#if defined(CEREGGII_PROBE_AVX2_DISPATCH)
+__attribute__((target("avx2")))
+#endif
+static uint64_t
+probe_avx2(const uint64_t *index, uint64_t size_mask, uint64_t d0, uint64_t distance, uint64_t limit,
+           uint64_t value, uint64_t mask)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i v_value = _mm256_set1_epi64x((int64_t) value);
+    const __m256i v_mask = _mm256_set1_epi64x((int64_t) mask);
+
+    while (distance < limit) {
+        uint64_t position = (d0 + distance) & size_mask;
+        if (position + 4 > size_mask + 1 || distance + 4 > limit) {
+            if (is_candidate(load_node(index, position), value, mask))
+                return distance;
+            distance++;
+            continue;
+        }
+
+        __m256i nodes = _mm256_loadu_si256((const __m256i *) &index[position]);
+        __m256i empty = _mm256_cmpeq_epi64(nodes, zero);
+        __m256i match = _mm256_cmpeq_epi64(_mm256_and_si256(nodes, v_mask), v_value);
+        int bits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(empty, match)));
+        if (bits) {
+            uint64_t lane = 0;
+            while (!(bits & 1)) {
+                bits >>= 1;
+                lane++;
+            }
+            return distance + lane;
+        }
+        distance += 4;
+    }
+    return limit;
+}
+#endif
+
+#if defined(CEREGGII_PROBE_NEON)
+static uint64_t
+probe_neon(const uint64_t *index, uint64_t size_mask, uint64_t d0, uint64_t distance, uint64_t limit,
+           uint64_t value, uint64_t mask)
+{
+    const uint64x2_t zero = vdupq_n_u64(0);
+    const uint64x2_t v_value = vdupq_n_u64(value);
+    const uint64x2_t v_mask = vdupq_n_u64(mask);
+
+    while (distance < limit) {
+        uint64_t position = (d0 + distance) & size_mask;
+        if (position + 2 > size_mask + 1 || distance + 2 > limit) {
+            if (is_candidate(load_node(index, position), value, mask))
+                return distance;
+            distance++;
+            continue;
+        }
+
+        uint64x2_t nodes = vld1q_u64(&index[position]);
+        uint64x2_t found = vorrq_u64(vceqq_u64(nodes, zero), vceqq_u64(vandq_u64(nodes, v_mask), v_value));
+        if (vgetq_lane_u64(found, 0))
+            return distance;
+        if (vgetq_lane_u64(found, 1))
+            return distance + 1;
+        distance += 2;
+    }
+    return limit;
+}
+#endif
+
+
+typedef uint64_t (*probe_kernel)(const uint64_t *index, uint64_t size_mask, uint64_t d0, uint64_t distance,
+                                 uint64_t limit, uint64_t value, uint64_t mask);
+
+static uint64_t
+probe_resolve(const uint64_t *index, uint64_t size_mask, uint64_t d0, uint64_t distance, uint64_t limit,
+              uint64_t value, uint64_t mask);
+
+static _Atomic(probe_kernel) probe_impl = probe_resolve;
+
+static probe_kernel
+probe_select(void)
+{
+    probe_kernel kernel = probe_scalar;
+#if defined(CEREGGII_PROBE_SSE)
+    kernel = probe_sse;
+#endif
+#if defined(CEREGGII_PROBE_NEON)
+    kernel = probe_neon;
+#endif
+#if defined(CEREGGII_PROBE_AVX2_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = probe_avx2;
+    }
+#elif defined(CEREGGII_PROBE_AVX2)
+    kernel = probe_avx2;
+#endif
+    return kernel;
+}
+
+static uint64_t
+probe_resolve(const uint64_t *index, uint64_t size_mask, uint64_t d0, uint64_t distance, uint64_t limit,
+              uint64_t value, uint64_t mask)
+{
+    // the selection is idempotent: no harm if multiple threads race here
+    probe_kernel kernel = probe_select();
+    atomic_store_explicit(&probe_impl, kernel, memory_order_relaxed);
+    return kernel(index, size_mask, d0, distance, limit, value, mask);
+}
+
+/**
+ * Find the smallest distance in [distance, limit) at which the node probed
+ * starting from d0 is either empty, or has (node & mask) == value.
+ * Returns limit if there is no such node.
+ **/
+uint64_t
+probe_candidate(AtomicDictMeta *meta, uint64_t d0, uint64_t distance, uint64_t limit, uint64_t value, uint64_t mask)
+{
+    if (limit > (uint64_t) SIZE_OF(meta)) {
+        limit = SIZE_OF(meta);
+    }
+    probe_kernel kernel = atomic_load_explicit(&probe_impl, memory_order_relaxed);
+    return kernel(meta->index, SIZE_OF(meta) - 1, d0, distance, limit, value, mask);
+}
+
+uint64_t
+probe_tag(AtomicDictMeta *meta, Py_hash_t hash, uint64_t d0, uint64_t distance, uint64_t limit)
+{
+    return probe_candidate(meta, d0, distance, limit, REHASH(hash) & TAG_MASK(meta), TAG_MASK(meta));
+}
+
+uint64_t
+probe_index(AtomicDictMeta *meta, uint64_t entry_ix, uint64_t d0, uint64_t distance, uint64_t limit)
+{
+    const uint64_t index_mask = ~((1ull << (NODE_SIZE - meta->log_size)) - 1);
+    return probe_candidate(meta, d0, distance, limit, entry_ix << (NODE_SIZE - meta->log_size), index_mask);
+}
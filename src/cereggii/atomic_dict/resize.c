@@ -12,8 +12,8 @@
 #include <cereggii/internal/thread_id.h>
 
 
-int
-grow(AtomicDict *self)
+static int
+resize_current(AtomicDict *self, int kind)
 {
     AtomicDictMeta *meta = NULL;
     AtomicDictAccessorStorage *storage = NULL;
@@ -23,7 +23,7 @@ grow(AtomicDict *self)
 
     meta = get_meta(self, storage);
 
-    int resized = resize(self, meta);
+    int resized = resize(self, meta, kind);
     if (resized < 0)
         goto fail;
 
@@ -33,6 +33,108 @@ grow(AtomicDict *self)
     return -1;
 }
 
+int
+grow(AtomicDict *self)
+{
+    return resize_current(self, ATOMIC_DICT_MIGRATION_GROW);
+}
+
+int
+compact(AtomicDict *self)
+{
+    return resize_current(self, ATOMIC_DICT_MIGRATION_COMPACT);
+}
+
+int
+purge(AtomicDict *self)
+{
+    return resize_current(self, ATOMIC_DICT_MIGRATION_PURGE);
+}
+
+static int
+pages_exhausted(AtomicDictMeta *meta)
+{
+    int64_t greatest_allocated_page = atomic_load_explicit((_Atomic (int64_t) *) &meta->greatest_allocated_page, memory_order_acquire);
+    return (uint64_t) greatest_allocated_page + 1u >= (uint64_t) SIZE_OF(meta) >> ATOMIC_DICT_LOG_ENTRIES_IN_PAGE;
+}
+
+int
+grow_or_compact(AtomicDict *self)
+{
+    // called when the index or the pages are full.
+    // if most of the space is taken by deleted items, there's no need to
+    // double the size of the dictionary: re-packing the live items is enough.
+    AtomicDictAccessorStorage *storage = get_or_create_accessor_storage(self);
+    if (storage == NULL)
+        return -1;
+
+    AtomicDictMeta *meta = get_meta(self, storage);
+    int64_t len = approx_len(self);
+    if (len * 4 < SIZE_OF(meta))
+        return compact(self);
+
+    if (len * 2 < SIZE_OF(meta)) {
+        // the live items would fit in an index of the same size:
+        // when only the index is crowded with tombstones, dropping them is
+        // enough; when the pages are full too, their deleted entries need
+        // to be reclaimed, and compaction keeps the current size.
+        if (pages_exhausted(meta))
+            return compact(self);
+        return purge(self);
+    }
+
+    return grow(self);
+}
+
+int
+should_shrink(AtomicDict *self, AtomicDictMeta *meta)
+{
+    // shrink when less than 1/8th of the index is used by live items:
+    // the compacted index will be at most 1/4th full, leaving room
+    // for new insertions before growing again.
+    return meta->log_size > self->min_log_size
+        && approx_len(self) * 8 < SIZE_OF(meta);
+}
+
+int
+should_purge(AtomicDict *self, AtomicDictMeta *meta)
+{
+    // re-build the index in place when tombstones dominate it:
+    // lookups must probe past tombstones, so that long clusters of
+    // deleted items slow down lookups even if few items are alive.
+    int64_t tombstones = approx_tombstones(self);
+    return tombstones * 4 >= SIZE_OF(meta)
+        && tombstones >= approx_len(self);
+}
+
+PyObject *
+AtomicDict_Compact(AtomicDict *self)
+{
+    if (compact(self) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static uint8_t
+compacted_log_size(AtomicDict *self, AtomicDictMeta *current_meta, int64_t live)
+{
+    uint8_t log_size = self->min_log_size;
+    if (log_size < ATOMIC_DICT_MIN_LOG_SIZE) {
+        log_size = ATOMIC_DICT_MIN_LOG_SIZE;
+    }
+    if (live < 0) {
+        live = 0;
+    }
+
+    // entry 0 is always reserved
+    while (log_size < current_meta->log_size && (live + 1) * 4 > (1ll << log_size)) {
+        log_size++;
+    }
+
+    return log_size;
+}
+
 int
 maybe_help_resize(AtomicDict *self, AtomicDictMeta *current_meta, PyMutex *self_mutex)
 {
@@ -49,7 +151,7 @@ maybe_help_resize(AtomicDict *self, AtomicDictMeta *current_meta, PyMutex *self_
 
 
 int
-resize(AtomicDict *self, AtomicDictMeta *current_meta /* borrowed */)
+resize(AtomicDict *self, AtomicDictMeta *current_meta /* borrowed */, int kind)
 {
     if (atomic_load_explicit((_Atomic(uintptr_t) *) &current_meta->resize_leader, memory_order_acquire) == 0) {
         uintptr_t expected = 0;
@@ -57,7 +159,7 @@ resize(AtomicDict *self, AtomicDictMeta *current_meta /* borrowed */)
             &current_meta->resize_leader,
             &expected, _Py_ThreadId(), memory_order_acq_rel, memory_order_acquire);
         if (i_am_leader) {
-            return leader_resize(self, current_meta);
+            return leader_resize(self, current_meta, kind);
         }
     }
 
@@ -67,58 +169,119 @@ resize(AtomicDict *self, AtomicDictMeta *current_meta /* borrowed */)
 }
 
 int
-leader_resize(AtomicDict *self, AtomicDictMeta *current_meta /* borrowed */)
+leader_resize(AtomicDict *self, AtomicDictMeta *current_meta /* borrowed */, int kind)
 {
     int holding_sync_lock = 0;
     AtomicDictMeta *new_meta = NULL;
-    uint8_t to_log_size = current_meta->log_size + 1;
+    int64_t compacted = 0;
+    uint8_t to_log_size;
+
+    if (kind == ATOMIC_DICT_MIGRATION_COMPACT) {
+        // only an estimate: the exact number of live items is known
+        // after having acquired the synchronous lock
+        to_log_size = compacted_log_size(self, current_meta, approx_len(self));
+    } else if (kind == ATOMIC_DICT_MIGRATION_PURGE) {
+        // same size: only the tombstones are dropped
+        to_log_size = current_meta->log_size;
+    } else {
+        to_log_size = current_meta->log_size + 1;
+    }
 
     if (to_log_size > ATOMIC_DICT_MAX_LOG_SIZE) {
         PyErr_SetString(PyExc_ValueError, "can hold at most 2^56 items.");
         goto fail;
     }
 
-    new_meta = AtomicDictMeta_New(to_log_size);
+    allocate:
+    new_meta = AtomicDictMeta_New(to_log_size, current_meta->log_entry_size);
     if (new_meta == NULL)
         goto fail;
 
     // pages
     begin_synchronous_operation(self);
     holding_sync_lock = 1;
-    int ok = meta_copy_pages(current_meta, new_meta);
-    if (ok < 0)
-        goto fail;
 
-    for (int64_t page_i = 0; page_i <= new_meta->greatest_allocated_page; ++page_i) {
-        Py_INCREF(new_meta->pages[page_i]);
-    }
+    if (kind == ATOMIC_DICT_MIGRATION_COMPACT) {
+        int64_t live = meta_count_live_entries(current_meta);
+        uint8_t needed_log_size = compacted_log_size(self, current_meta, live);
+        if (needed_log_size > to_log_size) {
+            // insertions that were in-flight when this resize started made
+            // the estimate too small. no new insertion can start from now on,
+            // because current_meta->resize_leader is set.
+            end_synchronous_operation(self);
+            holding_sync_lock = 0;
+            Py_CLEAR(new_meta);
+            to_log_size = needed_log_size;
+            goto allocate;
+        }
 
-    int32_t accessors_len = atomic_load_explicit((_Atomic (int32_t) *) &self->accessors_len, memory_order_acquire);
-    assert(accessors_len > 0);
-    int64_t *participants = PyMem_RawMalloc(sizeof(int64_t) * accessors_len);
-    if (participants == NULL) {
-        PyErr_NoMemory();
-        goto fail;
-    }
-    for (int32_t i = 0; i < accessors_len; ++i) {
-        atomic_store_explicit((_Atomic (int64_t) *) &participants[i], 0, memory_order_release);
+        meta_clear_index(new_meta);
+        compacted = meta_compact_pages(current_meta, new_meta);
+        if (compacted < 0)
+            goto fail;
+        assert(compacted == live);
+
+        // reservations point to entries of the previous generation
+        AtomicDictAccessorStorage *accessor;
+        FOR_EACH_ACCESSOR(self, accessor) {
+            accessor->reservation_buffer = (AtomicDictReservationBuffer) {0};
+        }
+
+        uint64_t location = (uint64_t) compacted + 1;
+        if (location % self->reservation_buffer_size != 0) {
+            // the remainder of the last reservation run can be used by this thread
+            AtomicDictAccessorStorage *storage = get_accessor_storage(self->accessor_key);
+            reservation_buffer_put(&storage->reservation_buffer, location,
+                                   self->reservation_buffer_size - (uint8_t) (location % self->reservation_buffer_size),
+                                   new_meta);
+        }
+    } else {
+        int ok = meta_copy_pages(current_meta, new_meta);
+        if (ok < 0)
+            goto fail;
+
+        for (int64_t page_i = 0; page_i <= new_meta->greatest_allocated_page; ++page_i) {
+            Py_INCREF(new_meta->pages[page_i]);
+        }
+
+        int32_t accessors_len = atomic_load_explicit((_Atomic (int32_t) *) &self->accessors_len, memory_order_acquire);
+        assert(accessors_len > 0);
+        int64_t *participants = PyMem_RawMalloc(sizeof(int64_t) * accessors_len);
+        if (participants == NULL) {
+            PyErr_NoMemory();
+            goto fail;
+        }
+        for (int32_t i = 0; i < accessors_len; ++i) {
+            atomic_store_explicit((_Atomic (int64_t) *) &participants[i], 0, memory_order_release);
+        }
+        atomic_store_explicit((_Atomic (int64_t *) *) &current_meta->participants, participants, memory_order_release);
+        atomic_store_explicit((_Atomic (int32_t) *) &current_meta->participants_count, accessors_len, memory_order_release);
     }
-    atomic_store_explicit((_Atomic (int64_t *) *) &current_meta->participants, participants, memory_order_release);
-    atomic_store_explicit((_Atomic (int32_t) *) &current_meta->participants_count, accessors_len, memory_order_release);
 
+    // the counters are re-computed during the migration
+    AtomicDictAccessorStorage *accessor;
 #ifdef CEREGGII_DEBUG
     int64_t inserted_before_resize = 0;
     int64_t tombstones_before_resize = 0;
-    AtomicDictAccessorStorage *accessor;
+#endif
     FOR_EACH_ACCESSOR(self, accessor) {
+#ifdef CEREGGII_DEBUG
         int64_t local_inserted = atomic_load_explicit((_Atomic (int64_t) *) &accessor->local_inserted, memory_order_acquire);
         int64_t local_tombstones = atomic_load_explicit((_Atomic (int64_t) *) &accessor->local_tombstones, memory_order_acquire);
         inserted_before_resize += local_inserted;
         tombstones_before_resize += local_tombstones;
+#endif
         atomic_store_explicit((_Atomic (int64_t) *) &accessor->local_inserted, 0, memory_order_release);
         atomic_store_explicit((_Atomic (int64_t) *) &accessor->local_tombstones, 0, memory_order_release);
     }
-#endif
+
+    if (kind == ATOMIC_DICT_MIGRATION_COMPACT) {
+        // the index was already re-built by this thread: followers have
+        // nothing left to migrate.
+        AtomicDictAccessorStorage *storage = get_accessor_storage(self->accessor_key);
+        atomic_store_explicit((_Atomic (int64_t) *) &storage->local_inserted, compacted, memory_order_release);
+        AtomicEvent_Set(current_meta->node_migration_done);
+    }
 
     // 👀
     Py_INCREF(new_meta);
@@ -158,6 +321,7 @@ leader_resize(AtomicDict *self, AtomicDictMeta *current_meta /* borrowed */)
     if (holding_sync_lock) {
         end_synchronous_operation(self);
     }
+    Py_XDECREF(new_meta);
     // don't block other threads indefinitely
     AtomicEvent_Set(current_meta->resize_done);
     AtomicEvent_Set(current_meta->node_migration_done);
@@ -224,8 +388,9 @@ migrate_node(AtomicDictNode *node, uint64_t current_pos, AtomicDictMeta* current
 
         if (read_raw_node_at(position, new_meta) == 0) {
 #ifdef CEREGGII_DEBUG
-            uint64_t range_start = (trailing_cluster_start * 2) & (SIZE_OF(new_meta) - 1);
-            uint64_t range_end = (2 * (trailing_cluster_start + trailing_cluster_size + 1)) & (SIZE_OF(new_meta) - 1);
+            uint8_t shift = new_meta->log_size - current_meta->log_size;
+            uint64_t range_start = (trailing_cluster_start << shift) & (SIZE_OF(new_meta) - 1);
+            uint64_t range_end = ((trailing_cluster_start + trailing_cluster_size + 1) << shift) & (SIZE_OF(new_meta) - 1);
             if (range_start < range_end) {
                 assert(position >= range_start && position < range_end);
             } else {
@@ -254,6 +419,11 @@ migrate_node_d0(AtomicDictNode *node, uint64_t current_pos, AtomicDictMeta *curr
     //   - the d0 position in the new index is given by the most significant
     //     bits of the hash; therefore
     //   - we know the d0 position in the new index.
+    // when the index keeps its size (i.e. tombstones are being purged),
+    // the d0 position doesn't change at all.
+    if (node->distance < UINT8_MAX && new_meta->log_size == current_meta->log_size) {
+        return current_pos - node->distance;
+    }
     if (node->distance < UINT8_MAX) {
         uint64_t tag_displacement = node->tag >> (NODE_SIZE - current_meta->log_size - 1);
         assert(tag_displacement == 0 || tag_displacement == 1);
@@ -269,11 +439,15 @@ migrate_node_d0(AtomicDictNode *node, uint64_t current_pos, AtomicDictMeta *curr
 }
 
 void
-initialize_in_new_meta(AtomicDictMeta *new_meta, const uint64_t start, const uint64_t end)
+initialize_in_new_meta(AtomicDictMeta *current_meta, AtomicDictMeta *new_meta, const uint64_t start, const uint64_t end)
 {
     // initialize slots in range [start, end)
-    uint64_t mapped_start = 2 * start;
-    uint64_t mapped_end = 2 * (end + 1);
+    // nodes of a cluster in the current index can only be moved into the
+    // range the cluster is mapped to: twice as far when growing, or the
+    // same range when purging tombstones.
+    uint8_t shift = new_meta->log_size - current_meta->log_size;
+    uint64_t mapped_start = start << shift;
+    uint64_t mapped_end = (end + 1) << shift;
 
     if (mapped_start == (mapped_start & (SIZE_OF(new_meta) - 1)) && mapped_end == (mapped_end & (SIZE_OF(new_meta) - 1))) {
         cereggii_tsan_ignore_writes_begin();
@@ -360,7 +534,7 @@ block_wise_migrate(AtomicDictMeta *current_meta, AtomicDictMeta *new_meta, int64
     uint64_t start_of_cluster = i;
     uint64_t cluster_size = 0;
 
-    initialize_in_new_meta(new_meta, i, end_of_block);
+    initialize_in_new_meta(current_meta, new_meta, i, end_of_block);
 
     for (; i < end_of_block; i++) {
         read_node_at(i, &node, current_meta);
@@ -393,7 +567,7 @@ block_wise_migrate(AtomicDictMeta *current_meta, AtomicDictMeta *new_meta, int64
         j++;
     }
     if (j > end_of_block) {
-        initialize_in_new_meta(new_meta, end_of_block, j - 1);
+        initialize_in_new_meta(current_meta, new_meta, end_of_block, j - 1);
         while (1) {
             read_node_at(i, &node, current_meta);
             if (is_empty(&node)) {
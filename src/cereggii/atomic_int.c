@@ -357,6 +357,35 @@ AtomicInt64_GetAndIncrement_callable(AtomicInt64 *self, PyObject *args)
     return NULL;
 }
 
+int64_t
+AtomicInt64_FetchAdd(AtomicInt64 *self, int64_t other)
+{
+    // a single fetch-and-add instruction, which never retries under
+    // contention: the sum wraps around instead of overflowing
+    return atomic_fetch_add_explicit(&self->integer, other, memory_order_acq_rel);
+}
+
+PyObject *
+AtomicInt64_FetchAdd_callable(AtomicInt64 *self, PyObject *args)
+{
+    int64_t other;
+    PyObject *py_other = NULL;
+
+    if (!PyArg_ParseTuple(args, "|O", &py_other))
+        goto fail;
+
+    if (py_other == NULL || py_other == Py_None) {
+        other = 1;
+    } else {
+        if (!AtomicInt64_ConvertToCLongOrSetException(py_other, &other))
+            goto fail;
+    }
+
+    return PyLong_FromInt64(AtomicInt64_FetchAdd(self, other));
+    fail:
+    return NULL;
+}
+
 int64_t
 AtomicInt64_DecrementAndGet(AtomicInt64 *self, int64_t other, int *overflow)
 {
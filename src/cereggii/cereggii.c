@@ -29,6 +29,7 @@ static PyMethodDef AtomicInt64_methods[] = {
     {"get_and_set",       (PyCFunction) AtomicInt64_GetAndSet_callable,       METH_VARARGS | METH_KEYWORDS, NULL},
     {"increment_and_get", (PyCFunction) AtomicInt64_IncrementAndGet_callable, METH_VARARGS, NULL},
     {"get_and_increment", (PyCFunction) AtomicInt64_GetAndIncrement_callable, METH_VARARGS, NULL},
+    {"fetch_add",         (PyCFunction) AtomicInt64_FetchAdd_callable,        METH_VARARGS, NULL},
     {"decrement_and_get", (PyCFunction) AtomicInt64_DecrementAndGet_callable, METH_VARARGS, NULL},
     {"get_and_decrement", (PyCFunction) AtomicInt64_GetAndDecrement_callable, METH_VARARGS, NULL},
     {"update_and_get",    (PyCFunction) AtomicInt64_UpdateAndGet_callable,    METH_O,       NULL},
@@ -141,11 +142,29 @@ static PyMethodDef AtomicDict_methods[] = {
     {"_debug",            (PyCFunction) AtomicDict_Debug,                   METH_NOARGS, NULL},
     {"_rehash",           (PyCFunction) AtomicDict_ReHash,                  METH_O,      NULL},
     {"get",               (PyCFunction) AtomicDict_GetItemOrDefaultVarargs, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"pop",               (PyCFunction) AtomicDict_Pop,                     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"setdefault",        (PyCFunction) AtomicDict_SetDefault,              METH_VARARGS | METH_KEYWORDS, NULL},
+    {"get_or_insert",     (PyCFunction) AtomicDict_GetOrInsert,             METH_VARARGS | METH_KEYWORDS, NULL},
+    {"update_and_get",    (PyCFunction) AtomicDict_UpdateAndGet,            METH_VARARGS | METH_KEYWORDS, NULL},
+    {"get_and_update",    (PyCFunction) AtomicDict_GetAndUpdate,            METH_VARARGS | METH_KEYWORDS, NULL},
     {"len_bounds",        (PyCFunction) AtomicDict_LenBounds,               METH_NOARGS, NULL},
     {"approx_len",        (PyCFunction) AtomicDict_ApproxLen,               METH_NOARGS, NULL},
     {"fast_iter",         (PyCFunction) AtomicDict_FastIter,                METH_VARARGS | METH_KEYWORDS, NULL},
+    {"iter_partitions",   (PyCFunction) AtomicDict_IterPartitions,          METH_VARARGS | METH_KEYWORDS, NULL},
+    {"parallel_for_each", (PyCFunction) AtomicDict_ParallelForEach,         METH_VARARGS | METH_KEYWORDS, NULL},
+    {"snapshot",          (PyCFunction) AtomicDict_Snapshot,                METH_NOARGS, NULL},
+    {"dump",              (PyCFunction) AtomicDict_Dump,                    METH_O,      NULL},
+    {"keys",              (PyCFunction) AtomicDict_Keys,                    METH_NOARGS, NULL},
+    {"values",            (PyCFunction) AtomicDict_Values,                  METH_NOARGS, NULL},
+    {"items",             (PyCFunction) AtomicDict_Items,                   METH_NOARGS, NULL},
     {"compare_and_set",   (PyCFunction) AtomicDict_CompareAndSet_callable,  METH_VARARGS | METH_KEYWORDS, NULL},
     {"batch_getitem",     (PyCFunction) AtomicDict_BatchGetItem,            METH_VARARGS | METH_KEYWORDS, NULL},
+    {"get_many",          (PyCFunction) AtomicDict_GetMany,                 METH_VARARGS | METH_KEYWORDS, NULL},
+    {"batch_setitem",     (PyCFunction) AtomicDict_BatchSetItem,            METH_VARARGS | METH_KEYWORDS, NULL},
+    {"batch_delitem",     (PyCFunction) AtomicDict_BatchDelItem,            METH_VARARGS | METH_KEYWORDS, NULL},
+    {"pop_many",          (PyCFunction) AtomicDict_PopMany,                 METH_VARARGS | METH_KEYWORDS, NULL},
+    {"update",            (PyCFunction) AtomicDict_Update,                  METH_VARARGS | METH_KEYWORDS, NULL},
+    {"compact",           (PyCFunction) AtomicDict_Compact,                 METH_NOARGS, NULL},
     {"reduce",            (PyCFunction) AtomicDict_Reduce_callable,         METH_VARARGS | METH_KEYWORDS, NULL},
     {"reduce_sum",        (PyCFunction) AtomicDict_ReduceSum_callable,      METH_VARARGS | METH_KEYWORDS, NULL},
     {"reduce_and",        (PyCFunction) AtomicDict_ReduceAnd_callable,      METH_VARARGS | METH_KEYWORDS, NULL},
@@ -154,7 +173,17 @@ static PyMethodDef AtomicDict_methods[] = {
     {"reduce_min",        (PyCFunction) AtomicDict_ReduceMin_callable,      METH_VARARGS | METH_KEYWORDS, NULL},
     {"reduce_list",       (PyCFunction) AtomicDict_ReduceList_callable,     METH_VARARGS | METH_KEYWORDS, NULL},
     {"reduce_count",      (PyCFunction) AtomicDict_ReduceCount_callable,    METH_VARARGS | METH_KEYWORDS, NULL},
+    {"reduce_mean",       (PyCFunction) AtomicDict_ReduceMean_callable,     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"reduce_topk",       (PyCFunction) AtomicDict_ReduceTopK_callable,     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"reduce_set",        (PyCFunction) AtomicDict_ReduceSet_callable,      METH_VARARGS | METH_KEYWORDS, NULL},
+    {"reduce_hll",        (PyCFunction) AtomicDict_ReduceHLL_callable,      METH_VARARGS | METH_KEYWORDS, NULL},
+    {"reduce_batched",    (PyCFunction) AtomicDict_ReduceBatched_callable,  METH_VARARGS | METH_KEYWORDS, NULL},
+    {"reduce_sum_buffer", (PyCFunction) AtomicDict_ReduceSumBuffer_callable, METH_VARARGS | METH_KEYWORDS, NULL},
     {"get_handle",        (PyCFunction) AtomicDict_GetHandle,               METH_NOARGS, NULL},
+    {"hll_estimate",      (PyCFunction) AtomicDict_HLLEstimate,             METH_O | METH_STATIC, NULL},
+    {"from_items",        (PyCFunction) AtomicDict_FromItems,               METH_VARARGS | METH_KEYWORDS | METH_CLASS, NULL},
+    {"parallel_load",     (PyCFunction) AtomicDict_ParallelLoad,            METH_VARARGS | METH_KEYWORDS | METH_CLASS, NULL},
+    {"load",              (PyCFunction) AtomicDict_Load,                    METH_VARARGS | METH_KEYWORDS | METH_CLASS, NULL},
     {"__class_getitem__", (PyCFunction) _generic_class_getitem,             METH_O | METH_CLASS, NULL},
     {NULL, NULL, 0, NULL}
 };
@@ -201,10 +230,11 @@ PyTypeObject AtomicDictMeta_Type = {
 PyTypeObject AtomicDictPage_Type = {
     PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "cereggii._AtomicDictPage",
-    .tp_basicsize = sizeof(AtomicDictPage),
+    // pages are only created by AtomicDictPage_New, which allocates
+    // the entries after the header, according to their size
+    .tp_basicsize = offsetof(AtomicDictPage, entries),
     .tp_itemsize = 0,
     .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_new = PyType_GenericNew,
     .tp_clear = (inquiry) AtomicDictPage_clear,
     .tp_dealloc = (destructor) AtomicDictPage_dealloc,
 };
@@ -221,6 +251,25 @@ PyTypeObject AtomicDictFastIterator_Type = {
     .tp_iternext = (iternextfunc) AtomicDictFastIterator_Next,
 };
 
+static PySequenceMethods AtomicDictView_as_sequence = {
+    .sq_length = (lenfunc) AtomicDictView_Len,
+    .sq_contains = (objobjproc) AtomicDictView_Contains,
+};
+
+PyTypeObject AtomicDictView_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cereggii._AtomicDictView",
+    .tp_basicsize = sizeof(AtomicDictView),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_traverse = (traverseproc) AtomicDictView_traverse,
+    .tp_clear = (inquiry) AtomicDictView_clear,
+    .tp_dealloc = (destructor) AtomicDictView_dealloc,
+    .tp_repr = (reprfunc) AtomicDictView_Repr,
+    .tp_iter = (getiterfunc) AtomicDictView_GetIter,
+    .tp_as_sequence = &AtomicDictView_as_sequence,
+};
+
 
 static PyMethodDef AtomicEvent_methods[] = {
     {"wait",   (PyCFunction) AtomicEvent_Wait_callable,  METH_NOARGS, NULL},
@@ -385,6 +434,8 @@ PyInit__cereggii(void)
         return NULL;
     if (PyType_Ready(&AtomicDictFastIterator_Type) < 0)
         return NULL;
+    if (PyType_Ready(&AtomicDictView_Type) < 0)
+        return NULL;
     if (PyType_Ready(&AtomicEvent_Type) < 0)
         return NULL;
     if (PyType_Ready(&AtomicRef_Type) < 0)
@@ -40,6 +40,9 @@ extern PyTypeObject AtomicDict_Type;
 struct AtomicDictFastIterator;
 typedef struct AtomicDictFastIterator AtomicDictFastIterator;
 
+struct AtomicDictView;
+typedef struct AtomicDictView AtomicDictView;
+
 
 PyObject *AtomicDict_GetItemOrDefault(AtomicDict *self, PyObject *key, PyObject *default_value);
 
@@ -51,6 +54,16 @@ int AtomicDict_SetItem(AtomicDict *self, PyObject *key, PyObject *value);
 
 int AtomicDict_DelItem(AtomicDict *self, PyObject *key);
 
+PyObject *AtomicDict_Pop(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_SetDefault(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_GetOrInsert(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_UpdateAndGet(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_GetAndUpdate(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
 PyObject *AtomicDict_CompareAndSet(AtomicDict *self, PyObject *key, PyObject *expected, PyObject *desired);
 
 PyObject *AtomicDict_CompareAndSet_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
@@ -87,6 +100,22 @@ int AtomicDict_ReduceCount(AtomicDict *self, PyObject *iterable);
 
 PyObject *AtomicDict_ReduceCount_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
 
+PyObject *AtomicDict_ReduceMean_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_ReduceTopK_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_ReduceSet_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_ReduceHLL_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_HLLEstimate(PyObject *cls, PyObject *sketch);
+
+PyObject *AtomicDict_ReduceBatched_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+int AtomicDict_ReduceSumBuffer(AtomicDict *self, PyObject *keys, PyObject *values);
+
+PyObject *AtomicDict_ReduceSumBuffer_callable(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
 PyObject *AtomicDict_LenBounds(AtomicDict *self);
 
 PyObject *AtomicDict_ApproxLen(AtomicDict *self);
@@ -97,8 +126,40 @@ Py_ssize_t AtomicDict_Len_impl(AtomicDict *self);
 
 PyObject *AtomicDict_FastIter(AtomicDict *self, PyObject *args, PyObject *kwargs);
 
+PyObject *AtomicDict_IterPartitions(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_ParallelForEach(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_Snapshot(AtomicDict *self, PyObject *Py_UNUSED(ignored));
+
+PyObject *AtomicDict_Keys(AtomicDict *self, PyObject *Py_UNUSED(ignored));
+
+PyObject *AtomicDict_Values(AtomicDict *self, PyObject *Py_UNUSED(ignored));
+
+PyObject *AtomicDict_Items(AtomicDict *self, PyObject *Py_UNUSED(ignored));
+
 PyObject *AtomicDict_BatchGetItem(AtomicDict *self, PyObject *args, PyObject *kwargs);
 
+PyObject *AtomicDict_GetMany(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_BatchSetItem(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_BatchDelItem(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_PopMany(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_Update(AtomicDict *self, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_FromItems(PyObject *cls, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_ParallelLoad(PyObject *cls, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_Dump(AtomicDict *self, PyObject *fileobj);
+
+PyObject *AtomicDict_Load(PyObject *cls, PyObject *args, PyObject *kwargs);
+
+PyObject *AtomicDict_Compact(AtomicDict *self);
+
 PyObject *AtomicDict_GetHandle(AtomicDict *self);
 
 PyObject *AtomicDict_Debug(AtomicDict *self);
@@ -49,6 +49,10 @@ int64_t AtomicInt64_GetAndIncrement(AtomicInt64 *self, int64_t other, int *overf
 
 PyObject *AtomicInt64_GetAndIncrement_callable(AtomicInt64 *self, PyObject *py_other);
 
+int64_t AtomicInt64_FetchAdd(AtomicInt64 *self, int64_t other);
+
+PyObject *AtomicInt64_FetchAdd_callable(AtomicInt64 *self, PyObject *py_other);
+
 int64_t AtomicInt64_DecrementAndGet(AtomicInt64 *self, int64_t other, int *overflow);
 
 PyObject *AtomicInt64_DecrementAndGet_callable(AtomicInt64 *self, PyObject *other);
@@ -66,14 +66,42 @@ typedef struct AtomicDictPaddedEntry {
     int8_t _padding[LEVEL1_DCACHE_LINESIZE - sizeof(AtomicDictEntry)];
 } AtomicDictPaddedEntry;
 
+/*
+ * Entries layout in a page
+ *
+ * padded:  one entry per cache line, avoids false sharing between threads
+ * compact: entries are densely packed, sizeof(AtomicDictEntry) = 32 bytes
+ *
+ * entries are addressed with log_entry_size, the log2 of the space each
+ * entry takes in the page.
+ * */
+#if LEVEL1_DCACHE_LINESIZE == 32
+#  define ATOMIC_DICT_LOG_PADDED_ENTRY_SIZE 5
+#elif LEVEL1_DCACHE_LINESIZE == 64
+#  define ATOMIC_DICT_LOG_PADDED_ENTRY_SIZE 6
+#elif LEVEL1_DCACHE_LINESIZE == 128
+#  define ATOMIC_DICT_LOG_PADDED_ENTRY_SIZE 7
+#elif LEVEL1_DCACHE_LINESIZE == 256
+#  define ATOMIC_DICT_LOG_PADDED_ENTRY_SIZE 8
+#else
+#  error "unsupported cache line size"
+#endif
+#define ATOMIC_DICT_LOG_COMPACT_ENTRY_SIZE 5
+
 typedef struct AtomicDictPage {
     PyObject_HEAD
 
     // PyObject *iteration;
 
-    AtomicDictPaddedEntry entries[ATOMIC_DICT_ENTRIES_IN_PAGE];
+    uint8_t log_entry_size;
+
+    // variable size: ATOMIC_DICT_ENTRIES_IN_PAGE entries, strided by log_entry_size
+    AtomicDictPaddedEntry entries[1];
 } AtomicDictPage;
 
+#define PAGE_ENTRY_AT(page, position) \
+    ((AtomicDictEntry *) ((char *) (page)->entries + ((uint64_t) (position) << (page)->log_entry_size)))
+
 extern PyTypeObject AtomicDictPage_Type;
 
 int AtomicDictPage_traverse(AtomicDictPage *self, visitproc visit, void *arg);
@@ -91,6 +119,7 @@ struct AtomicDictMeta {
     PyObject_HEAD
 
     uint8_t log_size;  // = node index_size
+    uint8_t log_entry_size;  // of new pages, see AtomicDictPage
 
     uint64_t *index;
 
@@ -118,7 +147,7 @@ void AtomicDictMeta_dealloc(AtomicDictMeta *self);
 
 extern PyTypeObject AtomicDictMeta_Type;
 
-AtomicDictMeta *AtomicDictMeta_New(uint8_t log_size);
+AtomicDictMeta *AtomicDictMeta_New(uint8_t log_size, uint8_t log_entry_size);
 
 void meta_clear_index(AtomicDictMeta *meta);
 
@@ -126,7 +155,13 @@ int meta_init_pages(AtomicDictMeta *meta);
 
 int meta_copy_pages(AtomicDictMeta *from_meta, AtomicDictMeta *to_meta);
 
-AtomicDictPage *AtomicDictPage_New(void);
+int64_t meta_count_live_entries_in_page(AtomicDictMeta *meta, int64_t page_i);
+
+int64_t meta_count_live_entries(AtomicDictMeta *meta);
+
+int64_t meta_compact_pages(AtomicDictMeta *from_meta, AtomicDictMeta *to_meta);
+
+AtomicDictPage *AtomicDictPage_New(uint8_t log_entry_size);
 
 uint64_t page_of(uint64_t entry_ix);
 
@@ -170,6 +205,16 @@ int atomic_write_node_at(uint64_t ix, AtomicDictNode *expected, AtomicDictNode *
 void print_node_at(uint64_t ix, AtomicDictMeta *meta);
 
 
+/// probing (see ./probe.c)
+#define ATOMIC_DICT_BATCH_PROBE_WINDOW 8
+
+uint64_t probe_candidate(AtomicDictMeta *meta, uint64_t d0, uint64_t distance, uint64_t limit, uint64_t value, uint64_t mask);
+
+uint64_t probe_tag(AtomicDictMeta *meta, Py_hash_t hash, uint64_t d0, uint64_t distance, uint64_t limit);
+
+uint64_t probe_index(AtomicDictMeta *meta, uint64_t entry_ix, uint64_t d0, uint64_t distance, uint64_t limit);
+
+
 /// reservation buffer (see ./reservation_buffer.c)
 #define RESERVATION_BUFFER_SIZE 64
 
@@ -196,6 +241,7 @@ typedef struct AtomicDictAccessorStorage {
     int64_t local_len;
     int64_t local_inserted;
     int64_t local_tombstones;
+    int64_t local_writes;  // number of write operations started, see AtomicDict_Snapshot
     int32_t accessor_ix;
     PyMutex self_mutex;
     AtomicDictReservationBuffer reservation_buffer;
@@ -226,22 +272,40 @@ int64_t approx_len(AtomicDict *self);
 
 int64_t approx_inserted(AtomicDict *self);
 
+int64_t approx_tombstones(AtomicDict *self);
+
 void accessor_len_inc(AtomicDict *self, AtomicDictAccessorStorage *storage, int32_t inc);
 
 void accessor_inserted_inc(AtomicDict *self, AtomicDictAccessorStorage *storage, int32_t inc);
 
 void accessor_tombstones_inc(AtomicDict *self, AtomicDictAccessorStorage *storage, int32_t inc);
 
+void accessor_writes_inc(AtomicDictAccessorStorage *storage);
+
 int lock_accessor_storage_or_help_resize(AtomicDict* self, AtomicDictAccessorStorage *storage, AtomicDictMeta *meta);
 
 /// migrations
+#define ATOMIC_DICT_MIGRATION_GROW    0
+#define ATOMIC_DICT_MIGRATION_COMPACT 1
+#define ATOMIC_DICT_MIGRATION_PURGE   2
+
 int grow(AtomicDict *self);
 
+int compact(AtomicDict *self);
+
+int purge(AtomicDict *self);
+
+int grow_or_compact(AtomicDict *self);
+
+int should_shrink(AtomicDict *self, AtomicDictMeta *meta);
+
+int should_purge(AtomicDict *self, AtomicDictMeta *meta);
+
 int maybe_help_resize(AtomicDict* self, AtomicDictMeta *meta, PyMutex *self_mutex);
 
-int resize(AtomicDict *self, AtomicDictMeta *current_meta);
+int resize(AtomicDict *self, AtomicDictMeta *current_meta, int kind);
 
-int leader_resize(AtomicDict *self, AtomicDictMeta *current_meta);
+int leader_resize(AtomicDict *self, AtomicDictMeta *current_meta, int kind);
 
 void follower_resize(AtomicDict* self, AtomicDictMeta *current_meta);
 
@@ -263,8 +327,11 @@ struct AtomicDictFastIterator {
     AtomicDict *dict;
     AtomicDictMeta *meta;
     uint64_t position;
+    uint64_t stop;  // the iteration ends at this position
 
     int partitions;
+    int batched;  // yield (keys, values) lists, one page at a time
+    int kind;  // what is yielded for each item, see AtomicDictView
 };
 
 extern PyTypeObject AtomicDictFastIterator_Type;
@@ -276,6 +343,35 @@ PyObject *AtomicDictFastIterator_Next(AtomicDictFastIterator *self);
 PyObject *AtomicDictFastIterator_GetIter(AtomicDictFastIterator *self);
 
 
+/// views
+#define ATOMIC_DICT_VIEW_ITEMS  0
+#define ATOMIC_DICT_VIEW_KEYS   1
+#define ATOMIC_DICT_VIEW_VALUES 2
+
+struct AtomicDictView {
+    PyObject_HEAD
+
+    AtomicDict *dict;
+    int kind;
+};
+
+extern PyTypeObject AtomicDictView_Type;
+
+int AtomicDictView_traverse(AtomicDictView *self, visitproc visit, void *arg);
+
+int AtomicDictView_clear(AtomicDictView *self);
+
+void AtomicDictView_dealloc(AtomicDictView *self);
+
+PyObject *AtomicDictView_GetIter(AtomicDictView *self);
+
+Py_ssize_t AtomicDictView_Len(AtomicDictView *self);
+
+int AtomicDictView_Contains(AtomicDictView *self, PyObject *item);
+
+PyObject *AtomicDictView_Repr(AtomicDictView *self);
+
+
 /// semi-internal
 typedef struct AtomicDictSearchResult {
     int error;
@@ -292,12 +388,42 @@ void lookup(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash,
 void lookup_entry(AtomicDictMeta *meta, uint64_t entry_ix, Py_hash_t hash,
                             AtomicDictSearchResult *result);
 
+void prefetch_entries(AtomicDictMeta *meta, const Py_hash_t *hashes, Py_ssize_t n);
+
 void delete_(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash, AtomicDictSearchResult *result);
 
 int unsafe_insert(AtomicDictMeta *meta, Py_hash_t hash, uint64_t pos);
 
+int unpack_item(PyObject *item, PyObject **key, PyObject **value);
+
 PyObject* expected_insert_or_update(AtomicDictMeta *meta, PyObject *key, Py_hash_t hash,
                                     PyObject *expected, PyObject *desired,
                                     AtomicDictEntryLoc *entry_loc, int *must_grow, int skip_entry_check);
 
+
+// parallel execution
+
+typedef struct AtomicDictParallel AtomicDictParallel;
+
+struct AtomicDictParallel {
+    AtomicDict *self;
+    PyObject *tasks;  // list
+    int (*run)(AtomicDictParallel *parallel, PyObject *task);
+    void *arg;
+
+    Py_ssize_t next_task;
+    int failed;
+    int running;
+    AtomicEvent *done;
+
+    PyMutex error_mutex;
+    PyObject *error;  // the first exception raised by any worker
+};
+
+int parallel_run(AtomicDictParallel *parallel, Py_ssize_t threads);
+
+int parallel_failed(AtomicDictParallel *parallel);
+
+int parse_threads(PyObject *threads_arg, Py_ssize_t *threads);
+
 #endif //CEREGGII_DEV_ATOMIC_DICT_INTERNAL_H
@@ -0,0 +1,13 @@
+// SPDX-FileCopyrightText: 2023-present dpdani <git@danieleparmeggiani.me>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CEREGGII_CONFIG_H
+#define CEREGGII_CONFIG_H
+
+#define CEREGGII_DEBUG
+
+#define LEVEL1_DCACHE_LINESIZE 64
+
+
+#endif //CEREGGII_CONFIG_H
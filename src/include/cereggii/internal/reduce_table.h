@@ -6,14 +6,31 @@
 #define CEREGGII_REDUCE_TABLE_H
 
 #include <Python.h>
+#include <stdint.h>
+#include <string.h>
 
 
 // Hash table for local aggregation during AtomicDict.reduce operations.
 // Maps keys to (expected, desired) pairs using linear probing.
 // Similar to CPython's dict with split entries and index.
+//
+// Entries are allocated in pages, like AtomicDictPage, so that they never
+// move: growing the table only requires a larger index. The index is grown
+// incrementally: the slots of the previous index are moved into the new one
+// a few at a time, on each insertion, so that no single insertion pays for
+// rehashing the whole table. While moving, lookups search both indexes.
 
 #define REDUCE_TABLE_MIN_LOG_SIZE 7
 #define REDUCE_TABLE_INITIAL_LOG_SIZE 7
+#define REDUCE_TABLE_MAX_LOG_SIZE 48
+#define REDUCE_TABLE_LOG_ENTRIES_IN_PAGE (REDUCE_TABLE_MIN_LOG_SIZE)
+#define REDUCE_TABLE_ENTRIES_IN_PAGE (1ULL << REDUCE_TABLE_LOG_ENTRIES_IN_PAGE)
+
+// Slots of the previous index moved on each insertion.
+// After a resize, the new index can take as many insertions as there were
+// entries before it fills up, and the previous index has 3/2 slots per
+// entry: moving at least 2 slots per insertion always completes in time.
+#define REDUCE_TABLE_MIGRATE_SLOTS 4
 
 typedef struct ReduceTableEntry {
     Py_hash_t hash;
@@ -25,26 +42,69 @@ typedef struct ReduceTableEntry {
 typedef struct ReduceTable {
     uint8_t log_size;               // log2 of index size
     uint64_t used;                  // number of active entries
-    uint64_t *index;                // indices into entries array
-    ReduceTableEntry *entries;      // contiguous entries array
+    uint64_t *index;                // indices into entries pages
+    ReduceTableEntry **pages;       // REDUCE_TABLE_ENTRIES_IN_PAGE entries each
+    uint64_t pages_allocated;       // number of pages allocated
+    uint64_t pages_capacity;        // length of the pages array
+    uint8_t old_log_size;           // log2 of old_index size
+    uint64_t *old_index;            // previous index, while it is being migrated
+    uint64_t migrated;              // slots of old_index already migrated
+    Py_ssize_t chunks;              // number of inputs aggregated (parallel reduce)
 } ReduceTable;
 
 #define REDUCE_TABLE_SIZE(table) (1ULL << (table)->log_size)
 #define REDUCE_TABLE_MASK(table) (REDUCE_TABLE_SIZE(table) - 1)
 #define REDUCE_TABLE_EMPTY_ENTRY UINT64_MAX
 
+#define REDUCE_TABLE_ENTRY(table, entry_ix) \
+    (&(table)->pages[(entry_ix) >> REDUCE_TABLE_LOG_ENTRIES_IN_PAGE] \
+                    [(entry_ix) & (REDUCE_TABLE_ENTRIES_IN_PAGE - 1)])
+
 static inline uint64_t
 reduce_table_hash_to_index(Py_hash_t hash, ReduceTable *table)
 {
     return hash & REDUCE_TABLE_MASK(table);
 }
 
+// The smallest log size of a table that can hold size_hint entries without
+// resizing.
+static inline uint8_t
+reduce_table_log_size_for(uint64_t size_hint)
+{
+    uint8_t log_size = REDUCE_TABLE_MIN_LOG_SIZE;
+    while (log_size < REDUCE_TABLE_MAX_LOG_SIZE && size_hint > (1ULL << log_size) * 2 / 3) {
+        log_size++;
+    }
+    return log_size;
+}
+
+static inline uint64_t *
+reduce_table_index_new(uint8_t log_size)
+{
+    uint64_t index_size = 1ULL << log_size;
+    uint64_t *index = PyMem_Malloc(index_size * sizeof(uint64_t));
+    if (index == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    // Initialize index with empty markers
+    for (uint64_t i = 0; i < index_size; i++) {
+        index[i] = REDUCE_TABLE_EMPTY_ENTRY;
+    }
+
+    return index;
+}
+
 static inline ReduceTable *
 reduce_table_new(uint8_t log_size)
 {
     if (log_size < REDUCE_TABLE_MIN_LOG_SIZE) {
         log_size = REDUCE_TABLE_MIN_LOG_SIZE;
     }
+    if (log_size > REDUCE_TABLE_MAX_LOG_SIZE) {
+        log_size = REDUCE_TABLE_MAX_LOG_SIZE;
+    }
 
     ReduceTable *table = PyMem_Malloc(sizeof(ReduceTable));
     if (table == NULL) {
@@ -52,122 +112,151 @@ reduce_table_new(uint8_t log_size)
         return NULL;
     }
 
-    table->log_size = log_size;
-    table->used = 0;
+    *table = (ReduceTable) {
+        .log_size = log_size,
+        .used = 0,
+        .index = NULL,
+        .pages = NULL,
+        .pages_allocated = 0,
+        .pages_capacity = 0,
+        .old_log_size = 0,
+        .old_index = NULL,
+        .migrated = 0,
+        .chunks = 0,
+    };
 
-    uint64_t index_size = REDUCE_TABLE_SIZE(table);
-    table->index = PyMem_Malloc(index_size * sizeof(uint64_t));
+    table->index = reduce_table_index_new(log_size);
     if (table->index == NULL) {
         PyMem_Free(table);
-        PyErr_NoMemory();
         return NULL;
     }
 
-    table->entries = PyMem_Malloc(index_size * sizeof(ReduceTableEntry));
-    if (table->entries == NULL) {
+    // pages are allocated on demand, but the pages array is sized up front
+    table->pages_capacity = (REDUCE_TABLE_SIZE(table) >> REDUCE_TABLE_LOG_ENTRIES_IN_PAGE) + 1;
+    table->pages = PyMem_Calloc(table->pages_capacity, sizeof(ReduceTableEntry *));
+    if (table->pages == NULL) {
         PyMem_Free(table->index);
         PyMem_Free(table);
         PyErr_NoMemory();
         return NULL;
     }
 
-    // Initialize index with empty markers
-    for (uint64_t i = 0; i < index_size; i++) {
-        table->index[i] = REDUCE_TABLE_EMPTY_ENTRY;
-    }
-
     return table;
 }
 
+static inline void
+reduce_table_release_entries(ReduceTable *table)
+{
+    for (uint64_t i = 0; i < table->used; i++) {
+        ReduceTableEntry *entry = REDUCE_TABLE_ENTRY(table, i);
+        Py_DECREF(entry->key);
+        Py_DECREF(entry->expected);
+        Py_DECREF(entry->desired);
+    }
+}
+
+// Releases the references held by the entries, and frees the table.
 static inline void
 reduce_table_free(ReduceTable *table)
 {
     if (table == NULL)
         return;
 
-    PyMem_Free(table->entries);
+    reduce_table_release_entries(table);
+    for (uint64_t i = 0; i < table->pages_allocated; i++) {
+        PyMem_Free(table->pages[i]);
+    }
+    PyMem_Free(table->pages);
+    PyMem_Free(table->old_index);
     PyMem_Free(table->index);
     PyMem_Free(table);
 }
 
-static inline int
-reduce_table_resize(ReduceTable *table)
+// Releases the references held by the entries, and empties the table.
+// The allocations are kept, so that the table can be reused.
+static inline void
+reduce_table_clear(ReduceTable *table)
 {
-    uint8_t old_log_size = table->log_size;
-    uint8_t new_log_size = old_log_size + 1;
-    uint64_t new_index_size = 1ULL << new_log_size;
-
-    // Allocate new index
-    uint64_t *new_index = PyMem_Malloc(new_index_size * sizeof(uint64_t));
-    if (new_index == NULL) {
-        PyErr_NoMemory();
-        return -1;
-    }
-
-    // Allocate new entries array
-    ReduceTableEntry *new_entries = PyMem_Malloc(new_index_size * sizeof(ReduceTableEntry));
-    if (new_entries == NULL) {
-        PyMem_Free(new_index);
-        PyErr_NoMemory();
-        return -1;
+    reduce_table_release_entries(table);
+    for (uint64_t i = 0; i < REDUCE_TABLE_SIZE(table); i++) {
+        table->index[i] = REDUCE_TABLE_EMPTY_ENTRY;
     }
+    PyMem_Free(table->old_index);
+    table->old_index = NULL;
+    table->migrated = 0;
+    table->used = 0;
+}
 
-    // Initialize new index
-    for (uint64_t i = 0; i < new_index_size; i++) {
-        new_index[i] = REDUCE_TABLE_EMPTY_ENTRY;
-    }
+// Move up to `slots` slots of old_index into index.
+static inline void
+reduce_table_migrate(ReduceTable *table, uint64_t slots)
+{
+    if (table->old_index == NULL)
+        return;
 
-    // Rehash all entries
-    ReduceTable new_table = {
-        .log_size = new_log_size,
-        .used = 0,
-        .index = new_index,
-        .entries = new_entries,
-    };
+    uint64_t old_size = 1ULL << table->old_log_size;
+    uint64_t mask = REDUCE_TABLE_MASK(table);
 
-    for (uint64_t i = 0; i < table->used; i++) {
-        ReduceTableEntry *old_entry = &table->entries[i];
-        Py_hash_t hash = old_entry->hash;
-        uint64_t ix = reduce_table_hash_to_index(hash, &new_table);
+    for (; slots > 0 && table->migrated < old_size; slots--, table->migrated++) {
+        uint64_t entry_ix = table->old_index[table->migrated];
+        if (entry_ix == REDUCE_TABLE_EMPTY_ENTRY)
+            continue;
 
-        // Linear probing to find empty slot
-        while (new_index[ix] != REDUCE_TABLE_EMPTY_ENTRY) {
-            ix = (ix + 1) & (new_index_size - 1);
+        uint64_t ix = reduce_table_hash_to_index(REDUCE_TABLE_ENTRY(table, entry_ix)->hash, table);
+        while (table->index[ix] != REDUCE_TABLE_EMPTY_ENTRY) {
+            ix = (ix + 1) & mask;
         }
+        table->index[ix] = entry_ix;
+    }
 
-        // Insert into new table
-        uint64_t entry_ix = new_table.used++;
-        new_index[ix] = entry_ix;
-        new_entries[entry_ix] = *old_entry;
+    if (table->migrated == old_size) {
+        PyMem_Free(table->old_index);
+        table->old_index = NULL;
+        table->migrated = 0;
     }
+}
 
-    // Free old allocations and update table
-    PyMem_Free(table->index);
-    PyMem_Free(table->entries);
-    table->log_size = new_log_size;
+static inline int
+reduce_table_resize(ReduceTable *table)
+{
+    if (table->log_size >= REDUCE_TABLE_MAX_LOG_SIZE) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    // a previous resize must be completed first
+    reduce_table_migrate(table, UINT64_MAX);
+
+    uint64_t *new_index = reduce_table_index_new(table->log_size + 1);
+    if (new_index == NULL)
+        return -1;
+
+    table->old_index = table->index;
+    table->old_log_size = table->log_size;
+    table->migrated = 0;
     table->index = new_index;
-    table->entries = new_entries;
+    table->log_size++;
 
     return 0;
 }
 
-// Lookup key in table. Returns pointer to entry if found, NULL otherwise.
-// Sets *entry_ix to the entry index if found.
+// Lookup key in one index of table. See reduce_table_lookup.
 static inline ReduceTableEntry *
-reduce_table_lookup(ReduceTable *table, PyObject *key, Py_hash_t hash, uint64_t *entry_ix)
+reduce_table_lookup_in(ReduceTable *table, const uint64_t *index, uint8_t log_size,
+                       PyObject *key, Py_hash_t hash, uint64_t *entry_ix)
 {
-    uint64_t ix = reduce_table_hash_to_index(hash, table);
+    uint64_t mask = (1ULL << log_size) - 1;
+    uint64_t ix = hash & mask;
     uint64_t start_ix = ix;
-    uint64_t mask = REDUCE_TABLE_MASK(table);
 
     while (1) {
-        uint64_t entry_index = table->index[ix];
+        uint64_t entry_index = index[ix];
 
         if (entry_index == REDUCE_TABLE_EMPTY_ENTRY) {
             return NULL;
         }
 
-        ReduceTableEntry *entry = &table->entries[entry_index];
+        ReduceTableEntry *entry = REDUCE_TABLE_ENTRY(table, entry_index);
 
         if (entry->hash == hash) {
             if (entry->key == key) {
@@ -198,8 +287,49 @@ reduce_table_lookup(ReduceTable *table, PyObject *key, Py_hash_t hash, uint64_t
     }
 }
 
+// Lookup key in table. Returns pointer to entry if found, NULL otherwise.
+// Sets *entry_ix to the entry index if found.
+static inline ReduceTableEntry *
+reduce_table_lookup(ReduceTable *table, PyObject *key, Py_hash_t hash, uint64_t *entry_ix)
+{
+    ReduceTableEntry *entry = reduce_table_lookup_in(table, table->index, table->log_size, key, hash, entry_ix);
+    if (entry != NULL || table->old_index == NULL || PyErr_Occurred())
+        return entry;
+
+    // not migrated yet
+    return reduce_table_lookup_in(table, table->old_index, table->old_log_size, key, hash, entry_ix);
+}
+
+// Allocate the page of entry_ix, if needed.
+static inline int
+reduce_table_reserve_entry(ReduceTable *table, uint64_t entry_ix)
+{
+    uint64_t page = entry_ix >> REDUCE_TABLE_LOG_ENTRIES_IN_PAGE;
+    if (page < table->pages_allocated)
+        return 0;
+
+    if (page >= table->pages_capacity) {
+        uint64_t new_capacity = table->pages_capacity * 2;
+        ReduceTableEntry **new_pages = PyMem_Realloc(table->pages, new_capacity * sizeof(ReduceTableEntry *));
+        if (new_pages == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        table->pages = new_pages;
+        table->pages_capacity = new_capacity;
+    }
+
+    table->pages[page] = PyMem_Malloc(REDUCE_TABLE_ENTRIES_IN_PAGE * sizeof(ReduceTableEntry));
+    if (table->pages[page] == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    table->pages_allocated++;
+    return 0;
+}
+
 // Insert or update entry in table.
-// Steals references to key, expected, and desired.
+// Steals references to key, expected, and desired on success.
 // Returns 0 on success, -1 on error.
 static inline int
 reduce_table_set(ReduceTable *table, PyObject *key, Py_hash_t hash,
@@ -215,10 +345,14 @@ reduce_table_set(ReduceTable *table, PyObject *key, Py_hash_t hash,
             return -1;
         }
     }
+    reduce_table_migrate(table, REDUCE_TABLE_MIGRATE_SLOTS);
 
     // Check if key already exists
     uint64_t existing_entry_ix;
     ReduceTableEntry *existing = reduce_table_lookup(table, key, hash, &existing_entry_ix);
+    if (existing == NULL && PyErr_Occurred()) {
+        return -1;
+    }
 
     if (existing != NULL) {
         // Update existing entry - steal new refs, decref old ones
@@ -236,6 +370,11 @@ reduce_table_set(ReduceTable *table, PyObject *key, Py_hash_t hash,
     }
 
     // Insert new entry
+    uint64_t entry_ix = table->used;
+    if (reduce_table_reserve_entry(table, entry_ix) < 0) {
+        return -1;
+    }
+
     uint64_t ix = reduce_table_hash_to_index(hash, table);
     uint64_t mask = REDUCE_TABLE_MASK(table);
 
@@ -244,10 +383,10 @@ reduce_table_set(ReduceTable *table, PyObject *key, Py_hash_t hash,
         ix = (ix + 1) & mask;
     }
 
-    uint64_t entry_ix = table->used++;
+    table->used++;
     table->index[ix] = entry_ix;
 
-    ReduceTableEntry *entry = &table->entries[entry_ix];
+    ReduceTableEntry *entry = REDUCE_TABLE_ENTRY(table, entry_ix);
     entry->hash = hash;
     entry->key = key;            // steal reference
     entry->expected = expected;  // steal reference
@@ -275,4 +414,159 @@ reduce_table_get(ReduceTable *table, PyObject *key, Py_hash_t hash,
     return 1;
 }
 
+
+// Hash table for local aggregation of int64 keys and values, as in
+// AtomicDict.reduce_sum_buffer.
+// It holds no Python objects: it is allocated with PyMem_Raw* so that it
+// can be used without an attached thread state.
+// Its entries are small, and rehashing them calls no Python code, so they
+// are kept in a single array that is grown all at once.
+
+typedef struct ReduceTableInt64Entry {
+    int64_t key;
+    int64_t sum;
+} ReduceTableInt64Entry;
+
+typedef struct ReduceTableInt64 {
+    uint8_t log_size;
+    uint64_t used;
+    uint64_t *index;
+    ReduceTableInt64Entry *entries;
+} ReduceTableInt64;
+
+static inline uint64_t
+reduce_table_int64_hash(int64_t key)
+{
+    // splitmix64 finalizer: the low bits of integer keys are often not
+    // well distributed (e.g. multiples of a power of 2)
+    uint64_t x = (uint64_t) key;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Returns NULL if out of memory, without setting an exception.
+static inline ReduceTableInt64 *
+reduce_table_int64_new(uint8_t log_size)
+{
+    if (log_size < REDUCE_TABLE_MIN_LOG_SIZE) {
+        log_size = REDUCE_TABLE_MIN_LOG_SIZE;
+    }
+
+    ReduceTableInt64 *table = PyMem_RawMalloc(sizeof(ReduceTableInt64));
+    if (table == NULL)
+        return NULL;
+
+    table->log_size = log_size;
+    table->used = 0;
+    table->index = PyMem_RawMalloc(REDUCE_TABLE_SIZE(table) * sizeof(uint64_t));
+    table->entries = PyMem_RawMalloc(REDUCE_TABLE_SIZE(table) * sizeof(ReduceTableInt64Entry));
+    if (table->index == NULL || table->entries == NULL) {
+        PyMem_RawFree(table->index);
+        PyMem_RawFree(table->entries);
+        PyMem_RawFree(table);
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < REDUCE_TABLE_SIZE(table); i++) {
+        table->index[i] = REDUCE_TABLE_EMPTY_ENTRY;
+    }
+
+    return table;
+}
+
+static inline void
+reduce_table_int64_free(ReduceTableInt64 *table)
+{
+    if (table == NULL)
+        return;
+
+    PyMem_RawFree(table->entries);
+    PyMem_RawFree(table->index);
+    PyMem_RawFree(table);
+}
+
+static inline int
+reduce_table_int64_resize(ReduceTableInt64 *table)
+{
+    uint8_t new_log_size = table->log_size + 1;
+    uint64_t new_size = 1ULL << new_log_size;
+    uint64_t new_mask = new_size - 1;
+
+    uint64_t *new_index = PyMem_RawMalloc(new_size * sizeof(uint64_t));
+    ReduceTableInt64Entry *new_entries = PyMem_RawMalloc(new_size * sizeof(ReduceTableInt64Entry));
+    if (new_index == NULL || new_entries == NULL) {
+        PyMem_RawFree(new_index);
+        PyMem_RawFree(new_entries);
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < new_size; i++) {
+        new_index[i] = REDUCE_TABLE_EMPTY_ENTRY;
+    }
+
+    // entries keep their position, only the index is rebuilt
+    memcpy(new_entries, table->entries, table->used * sizeof(ReduceTableInt64Entry));
+    for (uint64_t i = 0; i < table->used; i++) {
+        uint64_t ix = reduce_table_int64_hash(new_entries[i].key) & new_mask;
+        while (new_index[ix] != REDUCE_TABLE_EMPTY_ENTRY) {
+            ix = (ix + 1) & new_mask;
+        }
+        new_index[ix] = i;
+    }
+
+    PyMem_RawFree(table->index);
+    PyMem_RawFree(table->entries);
+    table->log_size = new_log_size;
+    table->index = new_index;
+    table->entries = new_entries;
+    return 0;
+}
+
+// Find the entry of key, inserting it with a sum of 0 if it is not found.
+// Returns NULL if out of memory, without setting an exception.
+static inline ReduceTableInt64Entry *
+reduce_table_int64_entry(ReduceTableInt64 *table, int64_t key)
+{
+    if (table->used > REDUCE_TABLE_SIZE(table) * 2 / 3) {
+        if (reduce_table_int64_resize(table) < 0)
+            return NULL;
+    }
+
+    uint64_t mask = REDUCE_TABLE_MASK(table);
+    uint64_t ix = reduce_table_int64_hash(key) & mask;
+
+    while (table->index[ix] != REDUCE_TABLE_EMPTY_ENTRY) {
+        ReduceTableInt64Entry *entry = &table->entries[table->index[ix]];
+        if (entry->key == key)
+            return entry;
+        ix = (ix + 1) & mask;
+    }
+
+    uint64_t entry_ix = table->used++;
+    table->index[ix] = entry_ix;
+    table->entries[entry_ix].key = key;
+    table->entries[entry_ix].sum = 0;
+    return &table->entries[entry_ix];
+}
+
+// Add value to the sum of key, unless that would overflow.
+// Returns 0 on success, 1 on overflow (and sets *overflowed to the entry of
+// key, which was left unchanged), or -1 if out of memory.
+static inline int
+reduce_table_int64_add(ReduceTableInt64 *table, int64_t key, int64_t value, ReduceTableInt64Entry **overflowed)
+{
+    ReduceTableInt64Entry *entry = reduce_table_int64_entry(table, key);
+    if (entry == NULL)
+        return -1;
+
+    if ((value > 0 && entry->sum > INT64_MAX - value) || (value < 0 && entry->sum < INT64_MIN - value)) {
+        *overflowed = entry;
+        return 1;
+    }
+
+    entry->sum += value;
+    return 0;
+}
+
 #endif  // CEREGGII_REDUCE_TABLE_H
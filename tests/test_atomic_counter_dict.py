@@ -0,0 +1,126 @@
+# SPDX-FileCopyrightText: 2026-present dpdani <git@danieleparmeggiani.me>
+#
+# SPDX-License-Identifier: Apache-2.0
+
+import threading
+
+import pytest
+from cereggii import AtomicCounterDict
+
+from .utils import TestingThreadSet
+
+
+def test_init():
+    counts = AtomicCounterDict({"spam": 1, "eggs": 2})
+    assert counts["spam"] == 1
+    assert counts["eggs"] == 2
+    assert len(counts) == 2
+    counts = AtomicCounterDict([("spam", 3)], min_size=2**10)
+    assert counts["spam"] == 3
+    assert len(AtomicCounterDict()) == 0
+
+
+def test_increment():
+    counts = AtomicCounterDict()
+    assert counts.increment("spam") is None
+    assert counts["spam"] == 1
+    counts.increment("spam", 10)
+    assert counts["spam"] == 11
+    counts.increment("spam", -1)
+    assert counts["spam"] == 10
+    with pytest.raises(OverflowError):
+        counts.increment("spam", 2**63)
+    assert counts["spam"] == 10
+    with pytest.raises(OverflowError):
+        counts.increment("eggs", 2**63)
+    assert counts.get("eggs") is None
+    counts.increment("eggs", -3)
+    assert counts["eggs"] == -3
+
+
+def test_range():
+    with pytest.raises(OverflowError):
+        AtomicCounterDict({"spam": 2**62})
+    counts = AtomicCounterDict({"spam": 2**62 - 1, "eggs": -(2**62)})
+    with pytest.raises(OverflowError):
+        counts.increment("spam")
+    with pytest.raises(OverflowError):
+        counts.increment("eggs", -1)
+    with pytest.raises(OverflowError):
+        counts.increment("ham", 2**62)
+    with pytest.raises(OverflowError):
+        counts["spam"] = -(2**62) - 1
+    assert dict(counts.fast_iter()) == {"spam": 2**62 - 1, "eggs": -(2**62)}
+
+
+def test_getitem_setitem_delitem():
+    counts = AtomicCounterDict()
+    counts["spam"] = 5
+    assert counts["spam"] == 5
+    assert counts.get("spam") == 5
+    assert counts.get("eggs") is None
+    assert counts.get("eggs", 0) == 0
+    with pytest.raises(KeyError):
+        counts["eggs"]
+    del counts["spam"]
+    with pytest.raises(KeyError):
+        del counts["spam"]
+    assert len(counts) == 0
+
+
+def test_pop():
+    counts = AtomicCounterDict({"spam": 1})
+    assert counts.pop("spam") == 1
+    assert counts.pop("spam", 0) == 0
+    with pytest.raises(KeyError):
+        counts.pop("spam")
+
+
+def test_reduce():
+    counts = AtomicCounterDict({"spam": 1})
+    counts.reduce_count(["spam", "eggs", "eggs"])
+    counts.reduce_count({"ham": 3})
+    counts.reduce_sum([("spam", 10), ("ham", -1), ("spam", 1)])
+    assert dict(counts.fast_iter()) == {"spam": 13, "eggs": 2, "ham": 2}
+
+
+def test_concurrent_increment():
+    counts = AtomicCounterDict()
+
+    @TestingThreadSet.repeat(4)
+    def incrementers():
+        for _ in range(2**12):
+            counts.increment(_ % 8)
+        counts.reduce_count(_ % 8 for _ in range(2**12))
+
+    incrementers.start_and_join()
+    assert dict(counts.fast_iter()) == {_: 2 * 4 * 2**9 for _ in range(8)}
+
+
+def test_concurrent_increment_and_delete():
+    counts = AtomicCounterDict()
+    iterations = 2**14
+    popped = []
+    done = threading.Event()
+
+    @TestingThreadSet.repeat(3)
+    def incrementers():
+        for _ in range(iterations):
+            counts.increment("spam")
+            counts["eggs"] = 1
+
+    @TestingThreadSet.repeat(1)
+    def deleters():
+        while not done.is_set():
+            popped.append(counts.pop("spam", 0))
+            try:
+                del counts["eggs"]
+            except KeyError:
+                pass
+
+    deleters.start()
+    incrementers.start_and_join()
+    done.set()
+    deleters.join()
+    assert sum(popped) + counts.get("spam", 0) == 3 * iterations
+    assert all(value >= 0 for value in popped)
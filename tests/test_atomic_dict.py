@@ -1,10 +1,18 @@
 # SPDX-FileCopyrightText: 2023-present dpdani <git@danieleparmeggiani.me>
 #
 # SPDX-License-Identifier: Apache-2.0
+import array
 import gc
+import io
 import itertools
+import os
+import pickle
 import random
+import subprocess
+import sys
 import threading
+import time
+import tracemalloc
 import weakref
 from collections import Counter
 
@@ -87,6 +95,214 @@ def test_init():
         AtomicDict(initial=[])
 
 
+@pytest.mark.parametrize("layout", ["padded", "compact"])
+def test_layout(layout):
+    d = AtomicDict({"spam": 0}, layout=layout)
+    for _ in range(2**12):
+        d[_] = _
+    for _ in range(0, 2**12, 2):
+        del d[_]
+    assert d["spam"] == 0
+    for _ in range(1, 2**12, 2):
+        assert d[_] == _
+    assert dict(d.fast_iter()) == {"spam": 0} | {_: _ for _ in range(1, 2**12, 2)}
+    d.compact()
+    assert len(d) == 2**11 + 1
+    assert (d._debug()["meta"]["log_entry_size"] == 5) == (layout == "compact")
+
+
+def test_compact_layout_uses_less_memory():
+    def allocated(layout):
+        tracemalloc.start()
+        d = AtomicDict(layout=layout)
+        for _ in range(2**13):
+            d[_] = None
+        size, _ = tracemalloc.get_traced_memory()
+        tracemalloc.stop()
+        del d
+        return size
+
+    assert allocated("compact") < allocated("padded")
+
+
+def test_invalid_layout():
+    with pytest.raises(ValueError):
+        AtomicDict(layout="spam")
+    with pytest.raises(TypeError):
+        AtomicDict(layout=1)
+
+
+def test_from_items():
+    initial = {_: _ * 2 for _ in range(2**12)}
+    d = AtomicDict.from_items(initial)
+    assert len(d) == 2**12
+    for _ in range(2**12):
+        assert d[_] == _ * 2
+    assert d._debug()["meta"]["log_size"] <= AtomicDict(initial)._debug()["meta"]["log_size"]
+
+    # generators have no length: the dictionary is grown while loading
+    d = AtomicDict.from_items((_ % 100, _) for _ in range(2**12))
+    assert len(d) == 100
+    assert d[99] == 3999
+    d = AtomicDict.from_items(((_, None) for _ in range(2**12)), size_hint=0)
+    assert len(d) == 2**12
+
+    d = AtomicDict.from_items([[1, 2], "ab", (3, 4)], min_size=2**10, layout="compact")
+    assert dict(d.fast_iter()) == {1: 2, "a": "b", 3: 4}
+    assert d._debug()["meta"]["log_size"] == 10
+    assert d._debug()["meta"]["log_entry_size"] == 5
+    d[5] = 6
+    del d[1]
+    assert dict(d.fast_iter()) == {"a": "b", 3: 4, 5: 6}
+
+    with pytest.raises(ValueError):
+        AtomicDict.from_items([(1, 2, 3)])
+    with pytest.raises(TypeError):
+        AtomicDict.from_items([([], 2)])
+    with pytest.raises(TypeError):
+        AtomicDict.from_items(None)
+    with pytest.raises(ValueError):
+        AtomicDict.from_items([], size_hint=-1)
+    with pytest.raises(ValueError):
+        AtomicDict.from_items([], layout="spam")
+
+
+def test_from_items_atomic_dict():
+    source = AtomicDict()
+    for _ in range(2**12):
+        source[_] = _
+    for _ in range(0, 2**12, 2):
+        del source[_]
+
+    d = AtomicDict.from_items(source)
+    assert dict(d.fast_iter()) == dict(source.fast_iter())
+    assert len(d) == 2**11
+    for _ in range(2**12, 2**13):
+        d[_] = _
+    assert len(d) == 2**11 + 2**12
+    assert len(source) == 2**11
+
+
+def test_parallel_load():
+    partitions = [[(_, _) for _ in range(p * 2**12, (p + 1) * 2**12)] for p in range(4)]
+    d = AtomicDict.parallel_load(partitions, threads=3)
+    assert len(d) == 2**14
+    for _ in range(2**14):
+        assert d[_] == _
+    log_size = d._debug()["meta"]["log_size"]
+    assert log_size == AtomicDict.parallel_load(partitions, threads=1)._debug()["meta"]["log_size"]
+
+    d = AtomicDict.parallel_load([{"spam": 0}, iter([("foo", 1)]), ((_, None) for _ in range(2**10))], layout="compact")
+    assert len(d) == 2**10 + 2
+    assert d["spam"] == 0
+    assert d["foo"] == 1
+    assert d._debug()["meta"]["log_entry_size"] == 5
+
+    assert len(AtomicDict.parallel_load([])) == 0
+
+    with pytest.raises(ValueError):
+        AtomicDict.parallel_load([], threads=0)
+    with pytest.raises(ValueError):
+        AtomicDict.parallel_load([], size_hint=-1)
+    with pytest.raises(TypeError):
+        AtomicDict.parallel_load(None)
+
+
+def test_parallel_load_raises():
+    def failing():
+        yield 0, 0
+        raise HashError
+
+    partitions = [[(_, _) for _ in range(2**10)] for _ in range(4)]
+    with pytest.raises(HashError):
+        AtomicDict.parallel_load([*partitions, failing(), *partitions], threads=4)
+    with pytest.raises(TypeError):
+        AtomicDict.parallel_load([[([], None)]] * 4, threads=4)
+
+
+def test_dump_load():
+    d = AtomicDict({i: str(i) for i in range(5000)})
+    for i in range(0, 5000, 3):
+        del d[i]
+    keys = [HostileKey(i) for i in range(10)]
+    for key in keys:
+        d[key] = key.value
+    d["buffer"] = pickle.PickleBuffer(bytearray(b"spam" * 1000))
+
+    file = io.BytesIO()
+    assert d.dump(file) is None
+    file.seek(0)
+    loaded = AtomicDict.load(file, min_size=2**14)
+    assert file.read() == b""
+
+    assert len(loaded) == len(d)
+    assert loaded["buffer"] == bytearray(b"spam" * 1000)
+    loaded_keys = [k for k, _ in loaded.fast_iter() if isinstance(k, HostileKey)]
+    # instances of user-defined classes are always hashed again
+    assert sorted(k.hash_calls for k in loaded_keys) == sorted(k.hash_calls + 1 for k in keys)
+    del d["buffer"], loaded["buffer"]
+    assert loaded.snapshot() == d.snapshot()
+    assert loaded[HostileKey(3)] == 3
+    loaded[5000] = "5000"
+    del loaded[1]
+    assert loaded[5000] == "5000"
+    assert loaded.get(1) is None
+
+    empty = io.BytesIO()
+    AtomicDict().dump(empty)
+    empty.seek(0)
+    assert len(AtomicDict.load(empty)) == 0
+
+    with raises(ValueError):
+        AtomicDict.load(io.BytesIO(b"spam" * 100))
+    with raises(EOFError):
+        AtomicDict.load(io.BytesIO(file.getvalue()[:-1]))
+    with raises(AttributeError):
+        d.dump(None)
+
+
+def test_dump_load_identity_hashed_keys():
+    keys = [Payload(), Payload, test_init, (1, Payload()), frozenset([1, "two", 3.0]), (1, ("two", b"three"))]
+    d = AtomicDict({key: i for i, key in enumerate(keys)})
+    file = io.BytesIO()
+    d.dump(file)
+    file.seek(0)
+    loaded = AtomicDict.load(file)
+
+    # copies of keys hashed by identity can only be found by iterating
+    for key, value in list(loaded.fast_iter()):
+        assert loaded[key] == value
+        loaded[key] = value
+    assert len(loaded) == len(keys)
+    assert loaded[Payload] == 1
+    assert loaded[frozenset([3.0, "two", 1])] == 4
+    assert loaded[(1, ("two", b"three"))] == 5
+    loaded[Payload] = "again"
+    assert len(loaded) == len(keys)
+
+
+def test_load_with_different_hash_seed(tmp_path):
+    path = tmp_path / "dump"
+    dump = (
+        "from cereggii import AtomicDict, AtomicInt64\n"
+        "d = AtomicDict({f'key-{i}': i for i in range(1000)})\n"
+        "d[AtomicInt64] = 'class'\n"
+        f"d.dump(open({str(path)!r}, 'wb'))\n"
+    )
+    load = (
+        "from cereggii import AtomicDict, AtomicInt64\n"
+        f"d = AtomicDict.load(open({str(path)!r}, 'rb'))\n"
+        "assert all(d[f'key-{i}'] == i for i in range(1000))\n"
+        "assert d[AtomicInt64] == 'class'\n"
+        "d[AtomicInt64] = 'again'\n"
+        "assert len(d) == 1001\n"
+    )
+    subprocess.run([sys.executable, "-c", dump], env={**os.environ, "PYTHONHASHSEED": "0"}, check=True)
+    for seed in ("0", "1"):
+        env = {**os.environ, "PYTHONHASHSEED": seed}
+        subprocess.run([sys.executable, "-c", load], env=env, check=True)
+
+
 def test_multiple_inits():
     d = AtomicDict()
     with raises(RuntimeError):
@@ -400,6 +616,148 @@ def test_dont_implode():
     assert d._debug()["meta"]["log_size"] == 7
 
 
+def test_compact():
+    d = AtomicDict()
+    for _ in range(2**12):
+        d[_] = _
+    assert d._debug()["meta"]["log_size"] == 13
+    pages_before = len(d._debug()["pages"])
+    for _ in range(10, 2**12):
+        del d[_]
+    d.compact()
+    debug = d._debug()
+    assert debug["meta"]["log_size"] == 7
+    assert len(debug["pages"]) < pages_before
+    assert len(d) == 10
+    for _ in range(10):
+        assert d[_] == _
+    for _ in range(10, 2**12):
+        assert d.get(_, cereggii.NOT_FOUND) is cereggii.NOT_FOUND
+    for _ in range(100, 200):
+        d[_] = _
+    assert len(d) == 110
+    assert dict(d.fast_iter()) == {_: _ for _ in [*range(10), *range(100, 200)]}
+
+
+def test_compact_respects_min_size():
+    d = AtomicDict(min_size=2**10)
+    for _ in range(100):
+        d[_] = None
+    d.compact()
+    assert d._debug()["meta"]["log_size"] == 10
+    assert len(d) == 100
+
+
+def test_shrink_after_deletes():
+    d = AtomicDict()
+    for _ in range(2**12):
+        d[_] = None
+    assert d._debug()["meta"]["log_size"] == 13
+    for _ in range(2**12):
+        del d[_]
+    assert d._debug()["meta"]["log_size"] == 7
+    assert len(d) == 0
+    d["spam"] = "eggs"
+    assert d["spam"] == "eggs"
+
+
+def test_churn_does_not_grow_indefinitely():
+    d = AtomicDict()
+    for _ in range(2**14):
+        d[_] = None
+        if _ >= 10:
+            del d[_ - 10]
+    assert d._debug()["meta"]["log_size"] == 7
+    assert len(d) == 10
+
+
+def test_compact_during_concurrent_mutations():
+    d = AtomicDict()
+    n = 4
+    keys = 2000
+    barrier = threading.Barrier(n + 1)
+
+    @TestingThreadSet.range(n)
+    def writers(thread_id):
+        barrier.wait()
+        for _ in range(keys):
+            d[(thread_id, _)] = _
+            if _ % 2 == 0:
+                del d[(thread_id, _)]
+
+    @TestingThreadSet.repeat(1)
+    def compacting():
+        barrier.wait()
+        for _ in range(20):
+            d.compact()
+
+    (writers | compacting).start_and_join()
+    assert len(d) == n * keys // 2
+    for thread_id in range(n):
+        for _ in range(1, keys, 2):
+            assert d[(thread_id, _)] == _
+
+
+def count_tombstones(d):
+    debug = d._debug()
+    log_size = debug["meta"]["log_size"]
+    return sum(1 for node in debug["index"] if node != 0 and node >> (64 - log_size) == 0)
+
+
+def test_purge_tombstones_after_deletes():
+    d = AtomicDict()
+    for _ in range(600):
+        d[_] = _
+    debug = d._debug()
+    assert debug["meta"]["log_size"] == 10
+    pages_before = len(debug["pages"])
+    for _ in range(310):
+        del d[_]
+    debug = d._debug()
+    assert debug["meta"]["log_size"] == 10
+    assert len(debug["pages"]) == pages_before  # the index was purged, not compacted
+    assert count_tombstones(d) < 310
+    assert len(d) == 290
+    for _ in range(310, 600):
+        assert d[_] == _
+    for _ in range(310):
+        assert d.get(_, cereggii.NOT_FOUND) is cereggii.NOT_FOUND
+
+
+def test_churn_keeps_size():
+    d = AtomicDict()
+    for _ in range(400):
+        d[_] = _
+    assert d._debug()["meta"]["log_size"] == 10
+    for _ in range(400, 2**14):
+        d[_] = _
+        del d[_ - 400]
+    assert d._debug()["meta"]["log_size"] == 10
+    assert len(d) == 400
+    for _ in range(2**14 - 400, 2**14):
+        assert d[_] == _
+
+
+def test_purge_during_concurrent_mutations():
+    d = AtomicDict()
+    n = 4
+    keys = 4000
+    live = 100
+
+    @TestingThreadSet.range(n)
+    def churn(thread_id):
+        for _ in range(keys):
+            d[(thread_id, _)] = _
+            if _ >= live:
+                del d[(thread_id, _ - live)]
+
+    churn.start_and_join()
+    assert len(d) == n * live
+    for thread_id in range(n):
+        for _ in range(keys - live, keys):
+            assert d[(thread_id, _)] == _
+
+
 def test_readers_and_cas_writers_during_repeated_growth():
     d = AtomicDict({"counter": 0})
     writers = 4
@@ -528,6 +886,130 @@ def test_fast_iter_partitions_form_exact_union(size, partitions):
     assert dict(items) == {i: i * 2 for i in range(size)}
 
 
+def test_views():
+    d = AtomicDict({i: str(i) for i in range(1000)})
+    keys, values, items = d.keys(), d.values(), d.items()
+
+    assert sorted(keys) == list(range(1000))
+    assert sorted(values) == sorted(str(i) for i in range(1000))
+    assert sorted(items) == [(i, str(i)) for i in range(1000)]
+    assert len(keys) == len(values) == len(items) == 1000
+
+    assert 5 in keys
+    assert 5000 not in keys
+    assert "5" in values
+    assert "spam" not in values
+    assert (5, "5") in items
+    assert (5, "6") not in items
+    assert (5000, "5000") not in items
+    assert 5 not in items
+    assert (5,) not in items
+    with raises(TypeError):
+        assert [] in keys
+    with raises(HashError):
+        assert HostileKey(0, hash_error=True) in keys
+
+    # views reflect later mutations
+    d[1000] = "1000"
+    del d[0]
+    assert 1000 in keys
+    assert 0 not in keys
+    assert (1000, "1000") in items
+    assert len(keys) == 1000
+
+    assert list(AtomicDict().keys()) == []
+    assert len(AtomicDict().items()) == 0
+    assert "keys" in repr(keys)
+
+    # views keep the dictionary alive
+    reference = weakref.ref(d)
+    del d
+    gc_collect_until_stable()
+    assert reference() is not None
+    assert len(list(values)) == 1000
+
+
+def test_fast_iter_batched():
+    d = AtomicDict({i: i * 2 for i in range(1, 1000)})
+    for i in range(200, 400):
+        del d[i]
+
+    batches = list(d.fast_iter(batched=True))
+    for keys, values in batches:
+        assert type(keys) is list and type(values) is list
+        # pages without items are skipped
+        assert 0 < len(keys) == len(values) <= 128
+    items = [item for keys, values in batches for item in zip(keys, values)]
+    assert dict(items) == {i: i * 2 for i in range(1, 1000) if not 200 <= i < 400}
+    assert len(items) == len(d)
+
+    items = []
+    for partition in range(3):
+        for keys, values in d.fast_iter(3, partition, batched=True):
+            items.extend(zip(keys, values))
+    assert dict(items) == dict(d.fast_iter())
+    assert len(items) == len(d)
+
+    items = []
+    for iterator in d.iter_partitions(2, batched=True):
+        for keys, values in iterator:
+            items.extend(zip(keys, values))
+    assert dict(items) == dict(d.fast_iter())
+
+    assert list(AtomicDict().fast_iter(batched=True)) == []
+
+
+def test_iter_partitions():
+    d = AtomicDict({i: i for i in range(10_000)})
+    # the first half of the pages is left empty
+    for i in range(5_000):
+        del d[i]
+
+    partitions = d.iter_partitions(4)
+    assert len(partitions) == 4
+    items = [list(_) for _ in partitions]
+    assert dict(itertools.chain(*items)) == {i: i for i in range(5_000, 10_000)}
+    assert sum(map(len, items)) == 5_000
+    for partition in items:
+        assert abs(len(partition) - 5_000 / 4) <= 128
+
+    assert [list(_) for _ in AtomicDict().iter_partitions(3)] == [[], [], []]
+    assert dict(*AtomicDict({1: 2}).iter_partitions(1)) == {1: 2}
+
+    @TestingThreadSet.range(4)
+    def iterating(p):
+        items[p] = list(partitions[p])
+
+    partitions = d.iter_partitions(4)
+    iterating.start_and_join()
+    assert dict(itertools.chain(*items)) == {i: i for i in range(5_000, 10_000)}
+
+    with raises(ValueError):
+        d.iter_partitions(0)
+
+
+def test_parallel_for_each():
+    d = AtomicDict({i: i for i in range(10_000)})
+    seen = AtomicDict()
+    d.parallel_for_each(seen.__setitem__, threads=4)
+    assert seen.snapshot() == d.snapshot()
+
+    calls = AtomicInt64(0)
+    AtomicDict().parallel_for_each(lambda k, v: calls.increment_and_get(), 2)
+    assert calls.get() == 0
+
+    def fail(k, v):
+        raise HashError(k)
+
+    with raises(HashError):
+        d.parallel_for_each(fail, 3)
+
+    with raises(ValueError):
+        d.parallel_for_each(print, 0)
+    with raises(TypeError):
+        d.parallel_for_each(None, 1)
+
+
 def test_fast_iterator_keeps_dictionary_and_generation_alive():
     d = AtomicDict({i: i for i in range(200)})
     reference = weakref.ref(d)
@@ -590,6 +1072,62 @@ def test_fast_iter_race_with_delete():
         (iterating | deleting | inserting).join()
 
 
+def test_snapshot():
+    assert AtomicDict().snapshot() == {}
+
+    d = AtomicDict({i: i for i in range(1000)})
+    del d[5]
+    d[7] = None
+    snapshot = d.snapshot()
+    assert type(snapshot) is dict
+    assert snapshot == {i: None if i == 7 else i for i in range(1000) if i != 5}
+
+    # the snapshot is a copy
+    d[7] = 7
+    assert snapshot[7] is None
+
+
+def test_snapshot_with_concurrent_writers():
+    # each writer first sets a, then b, to the same counter:
+    # in any point-in-time view, a is either equal to b, or one more than b
+    num_writers = 3
+    num_snapshots = 200
+    d = AtomicDict({(w, k): 0 for w in range(num_writers) for k in "ab"})
+    barrier = threading.Barrier(num_writers + 1)
+    stop = threading.Event()
+    snapshots = []
+
+    @TestingThreadSet.range(num_writers)
+    def writing(w):
+        dh = ThreadHandle(d)
+        barrier.wait()
+        n = 0
+        while not stop.is_set():
+            n += 1
+            dh[w, "a"] = n
+            dh[w, "b"] = n
+            # insert and delete other keys too
+            dh[w, n] = n
+            del dh[w, n]
+
+    @TestingThreadSet.repeat(1)
+    def snapshotting():
+        barrier.wait()
+        try:
+            for _ in range(num_snapshots):
+                snapshots.append(d.snapshot())
+        finally:
+            stop.set()
+
+    (writing | snapshotting).start_and_join()
+
+    assert len(snapshots) == num_snapshots
+    for snapshot in snapshots:
+        assert len(snapshot) == 2 * num_writers
+        for w in range(num_writers):
+            assert snapshot[w, "a"] - snapshot[w, "b"] in (0, 1)
+
+
 def test_racy_deletes():
     num_deleting = 2
     num_inserting = 2
@@ -655,6 +1193,115 @@ def test_compare_and_set():
     assert d["bar"] == "baz"
 
 
+def test_pop():
+    d = AtomicDict({"spam": 1, "foo": None})
+    assert d.pop("spam") == 1
+    assert d.pop("spam", "default") == "default"
+    assert d.pop(key="foo", default=0) is None
+    with pytest.raises(KeyError):
+        d.pop("foo")
+    assert len(d) == 0
+    with pytest.raises(TypeError, match="unhashable type"):
+        d.pop([])
+
+
+def test_setdefault():
+    d = AtomicDict()
+    assert d.setdefault("spam") is None
+    assert d.setdefault("spam", 1) is None
+    assert d.setdefault(key="eggs", default=2) == 2
+    assert d.setdefault("eggs", 3) == 2
+    for _ in range(2**10):
+        assert d.setdefault(_, str(_)) == str(_)
+    assert len(d) == 2**10 + 2
+    assert d[100] == "100"
+    with pytest.raises(ValueError):
+        d.setdefault("witch", cereggii.NOT_FOUND)
+    with pytest.raises(ValueError):
+        d.setdefault(cereggii.ANY, 0)
+    assert d.get("witch", cereggii.NOT_FOUND) is cereggii.NOT_FOUND
+
+
+def test_get_or_insert():
+    calls = []
+
+    def factory():
+        calls.append(None)
+        return []
+
+    d = AtomicDict({"spam": [1]})
+    assert d.get_or_insert("spam", factory) == [1]
+    assert calls == []
+    eggs = d.get_or_insert("eggs", factory)
+    assert eggs == [] and d["eggs"] is eggs
+    assert d.get_or_insert(key="eggs", factory=factory) is eggs
+    assert len(calls) == 1
+    with pytest.raises(TypeError):
+        d.get_or_insert("foo", None)
+    with pytest.raises(ValueError):
+        d.get_or_insert("foo", lambda: cereggii.NOT_FOUND)
+    with pytest.raises(ZeroDivisionError):
+        d.get_or_insert("foo", lambda: 1 / 0)
+    assert d.get("foo", cereggii.NOT_FOUND) is cereggii.NOT_FOUND
+
+
+def test_concurrent_setdefault():
+    d = AtomicDict()
+    winners = AtomicDict()
+
+    @TestingThreadSet.repeat(4)
+    def setters():
+        for _ in range(2**12):
+            winners[(_, d.setdefault(_, threading.get_ident()))] = None
+
+    setters.start_and_join()
+    assert len(d) == 2**12
+    assert len(winners) == 2**12
+
+
+def test_update_and_get():
+    d = AtomicDict({"spam": 1})
+    assert d.update_and_get("spam", lambda v: v + 1) == 2
+    assert d.get_and_update("spam", lambda v: v * 10) == 2
+    assert d["spam"] == 20
+    assert d.update_and_get(key="eggs", fn=lambda v: v + 1, default=0) == 1
+    assert d.get_and_update("foo", lambda v: v + [1], default=[]) == []
+    assert d["foo"] == [1]
+    with pytest.raises(KeyError):
+        d.update_and_get("bar", lambda v: v)
+    with pytest.raises(ZeroDivisionError):
+        d.update_and_get("spam", lambda v: v / 0)
+    with pytest.raises(ValueError):
+        d.get_and_update("spam", lambda v: cereggii.NOT_FOUND)
+    with pytest.raises(TypeError):
+        d.update_and_get("spam", None)
+    assert d["spam"] == 20
+    assert d.get("bar", cereggii.NOT_FOUND) is cereggii.NOT_FOUND
+
+
+def test_update_and_get_reentrant():
+    d = AtomicDict({"spam": 0})
+
+    def fn(v):
+        d["eggs"] = v
+        return v + 1
+
+    assert d.update_and_get("spam", fn) == 1
+    assert d["eggs"] == 0
+
+
+def test_concurrent_update_and_get():
+    d = AtomicDict({_: 0 for _ in range(8)})
+
+    @TestingThreadSet.repeat(4)
+    def incrementers():
+        for _ in range(2**12):
+            d.update_and_get(_ % 16, lambda v: v + 1, default=0)
+
+    incrementers.start_and_join()
+    assert dict(d.fast_iter()) == {_: 4 * 2**8 for _ in range(16)}
+
+
 def test_batch_getitem():
     keys_count = 2**12
     d = AtomicDict({_: _ for _ in range(keys_count)})
@@ -679,6 +1326,179 @@ def test_batch_getitem_invalid_calls():
         d.batch_getitem([])
 
 
+@pytest.mark.parametrize("chunk_size", [1, 7, 128])
+def test_get_many(chunk_size):
+    keys_count = 2**12
+    d = AtomicDict({_: _ for _ in range(keys_count)})
+    keys = [random.randrange(0, 2 * keys_count) for _ in range(keys_count // 2)]  # noqa: S311
+    values = d.get_many(keys, chunk_size=chunk_size)
+    assert values == [d.get(k, cereggii.NOT_FOUND) for k in keys]
+    assert d.get_many(tuple(keys), None, chunk_size) == [d.get(k) for k in keys]
+    assert d.get_many([]) == []
+
+
+def test_get_many_with_concurrent_writers():
+    keys = list(range(256))
+    d = AtomicDict({k: [k] for k in keys})
+    barrier = threading.Barrier(3)
+
+    @TestingThreadSet.repeat(2)
+    def writers():
+        barrier.wait()
+        for _ in range(50):
+            for k in keys:
+                # the previous value is released right away
+                d[k] = [k]
+                if k % 8 == 0:
+                    del d[k]
+
+    @TestingThreadSet.repeat(1)
+    def reader():
+        barrier.wait()
+        for _ in range(50):
+            for k, value in zip(keys, d.get_many(keys, chunk_size=32)):
+                assert value is cereggii.NOT_FOUND or value == [k]
+
+    (writers | reader).start_and_join()
+
+
+def test_get_many_invalid_calls():
+    d = AtomicDict()
+    for chunk_size in (0, -1):
+        with pytest.raises(ValueError, match="chunk_size"):
+            d.get_many([], chunk_size=chunk_size)
+    with pytest.raises(TypeError):
+        d.get_many(None)
+    with pytest.raises(TypeError, match="unhashable type"):
+        d.get_many([0, []])
+    with pytest.raises(HashError):
+        d.get_many([HostileKey(0, hash_error=True)])
+
+
+@pytest.mark.parametrize("chunk_size", [1, 7, 128])
+def test_batch_setitem(chunk_size):
+    d = AtomicDict()
+    d.batch_setitem({_: _ for _ in range(2**12)}, chunk_size)
+    assert len(d) == 2**12
+    d.batch_setitem(((_, -_) for _ in range(0, 2**13, 2)), chunk_size=chunk_size)
+    assert len(d) == 2**12 + 2**11
+    for _ in range(2**13):
+        if _ % 2 == 0:
+            assert d[_] == -_
+        elif _ < 2**12:
+            assert d[_] == _
+        else:
+            assert d.get(_, cereggii.NOT_FOUND) is cereggii.NOT_FOUND
+
+
+def test_batch_setitem_invalid_calls():
+    d = AtomicDict()
+    for chunk_size in (0, -1):
+        with pytest.raises(ValueError, match="chunk_size"):
+            d.batch_setitem({}, chunk_size)
+    with pytest.raises(ValueError):
+        d.batch_setitem({cereggii.NOT_FOUND: 0})
+    with pytest.raises(ValueError):
+        d.batch_setitem({0: cereggii.ANY})
+    with pytest.raises(TypeError):
+        d.batch_setitem(None)
+    with pytest.raises(HashError):
+        d.batch_setitem([(0, 0), (HostileKey(1, hash_error=True), 1), (2, 2)], chunk_size=1)
+    assert d[0] == 0
+    assert d.get(2) is None
+
+
+@pytest.mark.parametrize("chunk_size", [1, 7, 128])
+def test_batch_delitem(chunk_size):
+    d = AtomicDict({_: _ for _ in range(2**12)})
+    assert d.batch_delitem(range(0, 2**13, 2), chunk_size) == 2**11
+    assert len(d) == 2**11
+    assert dict(d.fast_iter()) == {_: _ for _ in range(1, 2**12, 2)}
+    assert d.batch_delitem([1, 1, 1], chunk_size=chunk_size) == 1
+    assert d.batch_delitem(range(2**12), chunk_size=chunk_size) == 2**11 - 1
+    assert len(d) == 0
+    d[0] = 0
+    assert d[0] == 0
+
+
+def test_pop_many():
+    d = AtomicDict({_: str(_) for _ in range(2**10)})
+    assert d.pop_many([0, 2**10, 1]) == ["0", cereggii.NOT_FOUND, "1"]
+    assert d.pop_many(iter([2, 2]), None) == ["2", None]
+    assert d.pop_many(range(2**10), chunk_size=3) == [cereggii.NOT_FOUND] * 3 + [str(_) for _ in range(3, 2**10)]
+    assert len(d) == 0
+    assert d.pop_many([]) == []
+
+
+def test_batch_delitem_invalid_calls():
+    d = AtomicDict({0: 0, 1: 1})
+    for chunk_size in (0, -1):
+        with pytest.raises(ValueError, match="chunk_size"):
+            d.batch_delitem([], chunk_size)
+        with pytest.raises(ValueError, match="chunk_size"):
+            d.pop_many([], chunk_size=chunk_size)
+    with pytest.raises(TypeError):
+        d.batch_delitem(None)
+    with pytest.raises(TypeError, match="unhashable type"):
+        d.pop_many([[]])
+    with pytest.raises(HashError):
+        d.batch_delitem([0, HostileKey(1, hash_error=True)], chunk_size=1)
+    assert dict(d.fast_iter()) == {1: 1}
+
+
+def test_concurrent_batch_delitem():
+    d = AtomicDict({_: _ for _ in range(2**14)})
+    deleted = AtomicInt64(0)
+
+    @TestingThreadSet.repeat(4)
+    def deleters():
+        deleted.increment_and_get(d.batch_delitem(range(2**14), chunk_size=64))
+
+    deleters.start_and_join()
+    assert deleted == 2**14
+    assert len(d) == 0
+
+
+def test_update():
+    class Mapping:
+        def keys(self):
+            return ["spam", "eggs"]
+
+        def __getitem__(self, item):
+            return item.upper()
+
+    d = AtomicDict()
+    d.update({"a": 1})
+    d.update([("b", 2), ["c", 3]], d=4)
+    d.update(Mapping())
+    d.update()
+    assert dict(d.fast_iter()) == {"a": 1, "b": 2, "c": 3, "d": 4, "spam": "SPAM", "eggs": "EGGS"}
+
+    other = AtomicDict()
+    other.update(d)
+    other.update(d)
+    assert dict(other.fast_iter()) == dict(d.fast_iter())
+    assert len(other) == 6
+
+    with pytest.raises(TypeError):
+        d.update({}, {})
+    with pytest.raises(ValueError):
+        d.update([(1, 2, 3)])
+
+
+def test_concurrent_batch_setitem():
+    d = AtomicDict()
+
+    @TestingThreadSet.range(4)
+    def writers(i):
+        d.batch_setitem({_: i for _ in range(i * 2**11, (i + 2) * 2**11)}, chunk_size=64)
+
+    writers.start_and_join()
+    assert len(d) == 5 * 2**11
+    for _ in range(5 * 2**11):
+        assert d[_] in (_ // 2**11, _ // 2**11 - 1)
+
+
 def test_len():
     d = AtomicDict({_: None for _ in range(10)})
     assert len(d) == 10
@@ -898,6 +1718,504 @@ def test_reduce_specialized_count_threads():
     assert as_dict(d) == {"spam": iterations * n}
 
 
+def test_reduce_specialized_mean():
+    d = AtomicDict()
+    d.reduce_mean([("spam", 1), ("spam", 2), ("eggs", 3), ("spam", 3)])
+    assert d["spam"] == (6, 3)
+    assert d["eggs"] == (3, 1)
+
+    d.reduce_mean(keys=["spam"], values=[4.0])
+    assert d["spam"] == (10.0, 4)
+
+    @TestingThreadSet.repeat(4)
+    def threads():
+        d.reduce_mean([("ham", _) for _ in range(100)])
+
+    threads.start_and_join()
+    assert d["ham"] == (4 * sum(range(100)), 400)
+
+
+def test_reduce_specialized_mean_pairs():
+    d = AtomicDict({"spam": 5, "eggs": (1, 2)})
+    d.reduce_mean([("spam", 1)])
+    assert d["spam"] == (6, 2)
+
+    # a 2-tuple value is a (total, count) pair
+    d.reduce_mean([("spam", (10, 2))])
+    assert d["spam"] == (16, 4)
+    d.reduce_mean([("eggs", 3)])
+    assert d["eggs"] == (4, 3)
+
+    # other tuples are single values
+    d.reduce_mean([("ham", (1, 2, 3))])
+    assert d["ham"] == ((1, 2, 3), 1)
+
+
+def test_reduce_specialized_topk():
+    d = AtomicDict()
+    values = list(range(1000))
+    random.shuffle(values)
+    d.reduce_topk([("spam", _) for _ in values], 5)
+    assert d["spam"] == [999, 998, 997, 996, 995]
+
+    top = d["spam"]
+    d.reduce_topk([("spam", 2000), ("spam", 0)], k=5)
+    assert d["spam"] == [2000, 999, 998, 997, 996]
+    assert top == [999, 998, 997, 996, 995]  # never modified once stored
+
+    # lists are collections of values, and are not modified
+    collection = [1, 3, 2]
+    d.reduce_topk([("eggs", collection), ("eggs", 0)], 2)
+    assert d["eggs"] == [3, 2]
+    assert collection == [1, 3, 2]
+
+    d = AtomicDict()
+    d.reduce_topk([[("spam", _) for _ in range(i, 1000, 8)] for i in range(8)], 3, threads=4)
+    assert d["spam"] == [999, 998, 997]
+
+
+def test_reduce_specialized_set():
+    d = AtomicDict()
+    d.reduce_set([("spam", 1), ("spam", 2), ("spam", 1), ("eggs", "a")])
+    assert d["spam"] == {1, 2}
+    assert d["eggs"] == {"a"}
+
+    stored = d["spam"]
+    d.reduce_set([("spam", 3)])
+    assert d["spam"] == {1, 2, 3}
+    assert stored == {1, 2}  # never modified once stored
+
+    d = AtomicDict()
+    d.reduce_set([[("spam", _ % 17)] * 4 for _ in range(40)], threads=4)
+    assert d["spam"] == set(range(17))
+
+    with raises(TypeError):
+        d.reduce_set([("spam", [])])
+
+
+def test_reduce_specialized_hll():
+    d = AtomicDict()
+    d.reduce_hll(("spam", _) for _ in range(100_000))
+    d.reduce_hll([("eggs", _ % 10) for _ in range(1000)])
+    assert isinstance(d["spam"], bytearray)
+    assert len(d["spam"]) == 2**12
+    assert abs(AtomicDict.hll_estimate(d["spam"]) - 100_000) < 5_000
+    assert round(AtomicDict.hll_estimate(d["eggs"])) == 10
+
+    d.reduce_hll([("spam", _) for _ in range(50_000, 150_000)])
+    assert abs(AtomicDict.hll_estimate(d["spam"]) - 150_000) < 7_500
+
+    d = AtomicDict()
+    d.reduce_hll([[("spam", _) for _ in range(i, 20_000, 8)] for i in range(8)], precision=14, threads=4)
+    assert len(d["spam"]) == 2**14
+    assert abs(AtomicDict.hll_estimate(d["spam"]) - 20_000) < 1_000
+
+
+def test_reduce_specialized_invalid_args():
+    d = AtomicDict()
+    with raises(TypeError, match="k"):
+        d.reduce_topk([("spam", 1)])
+    with raises(ValueError, match="k"):
+        d.reduce_topk([("spam", 1)], 0)
+    for precision in (3, 17):
+        with raises(ValueError, match="precision"):
+            d.reduce_hll([("spam", 1)], precision=precision)
+    d.reduce_hll([("spam", 1)], precision=4)
+    with raises(ValueError, match="registers"):
+        d.reduce_hll([("spam", 1)])
+    with raises(ValueError):
+        AtomicDict.hll_estimate(bytearray(3))
+    with raises(TypeError):
+        AtomicDict.hll_estimate(b"\x00" * 16)
+
+
+def test_parallel_reduce():
+    chunks = [[(_ % 16, 1) for _ in range(2**10)] for _ in range(8)]
+    d = AtomicDict()
+    d.reduce(chunks, lambda key, current, new: new if current is cereggii.NOT_FOUND else current + new, threads=4)
+    assert as_dict(d) == {_: 8 * 2**6 for _ in range(16)}
+
+    d = AtomicDict()
+    d.reduce_sum(iter(chunks), threads=3)
+    d.reduce_max([[("max", 1), ("max", 3)], [("max", 2)]], threads=2)
+    d.reduce_count([[_ % 16 for _ in range(2**10)], {"spam": 2}, ["spam"]], threads=8)
+    assert as_dict(d) == {**{_: 8 * 2**6 + 2**6 for _ in range(16)}, "max": 3, "spam": 3}
+
+    d.reduce_sum([], threads=1)
+    d.reduce_sum([("spam", 1)], threads=None)
+    assert d["spam"] == 4
+
+
+def test_parallel_reduce_invalid_calls():
+    d = AtomicDict()
+    for threads in (0, -1):
+        with raises(ValueError, match="threads"):
+            d.reduce_sum([], threads=threads)
+    with raises(TypeError):
+        d.reduce([[("spam", 1)]], None, threads=2)
+    with raises(TypeError):
+        d.reduce_sum(None, threads=2)
+    with raises(TypeError):
+        d.reduce_sum([[("spam", 1)], [1]], threads=2)
+    with raises(TypeError):
+        d.reduce_sum([("spam", 1)], 2)
+
+
+def test_parallel_reduce_combines_chunks():
+    chunks = [[("hot", 1), (_, 1)] for _ in range(64)]
+    d = AtomicDict()
+    d.reduce_sum(chunks, threads=4)
+    assert d["hot"] == 64
+    assert len(d) == 65
+
+    d = AtomicDict()
+    d.reduce_list([[("hot", _)] for _ in range(64)], threads=4)
+    assert sorted(d["hot"]) == list(range(64))
+
+    def fails_when_combining(key, current, new):
+        if current is cereggii.NOT_FOUND:
+            return new
+        raise ZeroDivisionError
+
+    d = AtomicDict()
+    with raises(ZeroDivisionError):
+        d.reduce([[("hot", 1)]] * 64, fails_when_combining, threads=4)
+
+
+def test_reduce_releases_references():
+    finalized = []
+    key, value = Payload(), Payload()
+    weakref.finalize(key, finalized.append, "key")
+    weakref.finalize(value, finalized.append, "value")
+
+    def keep_new(_key, _current, new):
+        return new
+
+    not_found_refcount = sys.getrefcount(cereggii.NOT_FOUND)
+    d = AtomicDict()
+    d.reduce([(key, value), (key, value)], keep_new)
+    d.reduce([(key, value)], keep_new)
+    d.reduce([[(key, value)]] * 8, keep_new, threads=2)
+    d.reduce_list([(key, value)])
+    d.reduce_sum(iter([("spam", 1)]))
+    # outside of the assert: pytest's assertion rewriting keeps references
+    refcount = sys.getrefcount(cereggii.NOT_FOUND)
+    assert refcount == not_found_refcount
+    del key, value, d
+    gc_collect_until_stable()
+    assert sorted(finalized) == ["key", "value"]
+
+
+def test_compare_and_set_releases_references():
+    finalized = []
+    key, desired = Payload(), Payload()
+    weakref.finalize(key, finalized.append, "key")
+    weakref.finalize(desired, finalized.append, "desired")
+
+    d = AtomicDict({key: 1})
+    d.compare_and_set(key, 1, 2)
+    with raises(cereggii.ExpectationFailed):
+        d.compare_and_set(key, 1, desired)
+    del desired
+    gc_collect_until_stable()
+    assert finalized == ["desired"]
+    del key, d
+    gc_collect_until_stable()
+    assert sorted(finalized) == ["desired", "key"]
+
+
+def test_reduce_max_buffered_keys():
+    d = AtomicDict()
+    visible = []
+
+    def stream():
+        for i in range(100):
+            yield i % 10, 1
+            visible.append(len(d))
+
+    d.reduce_sum(stream(), max_buffered_keys=4)
+    assert [d[_] for _ in range(10)] == [10] * 10
+    # partial results were visible while the stream was being consumed
+    assert visible[3] == 4
+    assert visible[7] == 8
+
+    d = AtomicDict()
+    d.reduce_count((_ % 10 for _ in range(100)), max_buffered_keys=1)
+    assert [d[_] for _ in range(10)] == [10] * 10
+
+    d = AtomicDict()
+    d.reduce_list([[("spam", _) for _ in range(10)]] * 4, max_buffered_keys=1, threads=2)
+    assert sorted(d["spam"]) == sorted(list(range(10)) * 4)
+
+
+def test_reduce_flush_interval():
+    d = AtomicDict()
+    visible = []
+
+    def stream():
+        for i in range(5):
+            yield "spam", 1
+            time.sleep(0.001)
+            visible.append(d.get("spam"))
+
+    d.reduce_sum(stream(), flush_interval=1e-6)
+    assert visible == [1, 2, 3, 4, 5]
+    assert d["spam"] == 5
+
+    d = AtomicDict()
+    d.reduce_sum([("spam", 1)] * 10, flush_interval=3600)
+    assert d["spam"] == 10
+
+
+def test_reduce_invalid_flush_options():
+    d = AtomicDict()
+    for max_buffered_keys in (0, -1):
+        with raises(ValueError, match="max_buffered_keys"):
+            d.reduce_sum([], max_buffered_keys=max_buffered_keys)
+    for flush_interval in (0, -1.0):
+        with raises(ValueError, match="flush_interval"):
+            d.reduce_count([], flush_interval=flush_interval)
+    with raises(TypeError):
+        d.reduce_sum([], max_buffered_keys="spam")
+    with raises(TypeError):
+        d.reduce_sum([], flush_interval="spam")
+    d.reduce([("spam", 1)], lambda _, __, new: new, max_buffered_keys=None, flush_interval=None)
+    assert d["spam"] == 1
+
+
+def test_reduce_size_hint():
+    # enough distinct keys to grow the thread-local dictionary many times,
+    # while keys already seen keep coming
+    keys = list(range(50_000))
+    d = AtomicDict()
+    d.reduce_sum((k, 1) for _ in keys for k in (_, _ // 2))
+    assert len(d) == len(keys)
+    assert all(d[_] == 3 for _ in range(len(keys) // 2))
+    assert all(d[_] == 1 for _ in range(len(keys) // 2, len(keys)))
+
+    for size_hint in (0, 1, 10, len(keys), 10 * len(keys)):
+        d = AtomicDict()
+        d.reduce_count(keys + keys, size_hint=size_hint)
+        assert len(d) == len(keys)
+        assert all(d[_] == 2 for _ in keys)
+
+    d = AtomicDict()
+    d.reduce_max(keys=keys, values=keys, size_hint=len(keys), threads=2)
+    assert all(d[_] == _ for _ in keys)
+
+    d = AtomicDict()
+    d.reduce_topk(((_ % 10, _) for _ in range(100)), 2, size_hint=10, max_buffered_keys=3)
+    assert d[0] == [90, 80]
+
+    d = AtomicDict()
+    d.reduce([("spam", 1)], lambda _, __, new: new, size_hint=None)
+    assert d["spam"] == 1
+
+    with raises(ValueError, match="size_hint"):
+        d.reduce_sum([], size_hint=-1)
+    with raises(TypeError):
+        d.reduce_sum([], size_hint="spam")
+    with raises(MemoryError):
+        d.reduce_sum([], size_hint=2**62)
+
+
+def test_reduce_columns():
+    d = AtomicDict()
+    d.reduce_sum(keys=["spam", "eggs", "spam"], values=[1, 2, 3])
+    assert d["spam"] == 4
+    assert d["eggs"] == 2
+
+    d = AtomicDict()
+    d.reduce_max(keys=array.array("q", [1, 2, 1]), values=array.array("q", [5, 3, 7]))
+    assert d[1] == 7
+    assert d[2] == 3
+
+    def concat(_, current, new):
+        if current is cereggii.NOT_FOUND:
+            return new
+        return current + new
+
+    d = AtomicDict()
+    d.reduce(keys=("spam", "spam"), values=("a", "b"), aggregate=concat)
+    assert d["spam"] == "ab"
+
+    d = AtomicDict()
+    d.reduce_count(keys=list("abracadabra"))
+    assert dict(d.fast_iter()) == Counter("abracadabra")
+
+    d = AtomicDict()
+    keys = [_ % 7 for _ in range(1000)]
+    d.reduce_sum(keys=keys, values=[1] * 1000, threads=3)
+    d.reduce_count(keys=keys, threads=3, max_buffered_keys=2)
+    assert dict(d.fast_iter()) == {k: 2 * v for k, v in Counter(keys).items()}
+
+
+def test_reduce_columns_invalid_calls():
+    d = AtomicDict()
+    with raises(TypeError, match="together"):
+        d.reduce_sum(keys=[1])
+    with raises(TypeError, match="exactly one"):
+        d.reduce_sum(values=[1])
+    with raises(TypeError, match="exactly one"):
+        d.reduce_sum([], keys=[1], values=[1])
+    with raises(TypeError, match="exactly one"):
+        d.reduce_sum()
+    with raises(TypeError):
+        d.reduce_count(keys=[1], values=[1])
+    with raises(TypeError, match="aggregate"):
+        d.reduce(keys=[1], values=[1])
+    with raises(TypeError, match="sequence"):
+        d.reduce_sum(keys=1, values=[1])
+    for threads in (None, 2):
+        with raises(ValueError, match="len"):
+            d.reduce_sum(keys=[1, 2], values=[1], threads=threads)
+    assert len(d) == 0
+
+
+def test_reduce_sum_buffer():
+    d = AtomicDict({1: 100})
+    d.reduce_sum_buffer(array.array("q", [1, 2, 1, 3]), array.array("q", [5, 6, 7, 0]))
+    assert dict(d.fast_iter()) == {1: 112, 2: 6, 3: 0}
+
+    d = AtomicDict()
+    keys = array.array("q", range(10_000))
+    d.reduce_sum_buffer(keys, keys)
+    d.reduce_sum_buffer(memoryview(keys), memoryview(keys))
+    assert len(d) == 10_000
+    assert all(d[_] == 2 * _ for _ in range(10_000))
+
+    # unaligned buffers
+    unaligned = memoryview(b"\x00" + bytes(8 * 5))[1:].cast("q")
+    d = AtomicDict()
+    d.reduce_sum_buffer(unaligned, array.array("q", range(5)))
+    assert d[0] == 10
+
+
+def test_reduce_sum_buffer_overflow():
+    int64_max = 2**63 - 1
+    int64_min = -(2**63)
+    d = AtomicDict()
+    d.reduce_sum_buffer(array.array("q", [1] * 4), array.array("q", [int64_max] * 4))
+    d.reduce_sum_buffer(array.array("q", [2] * 4), array.array("q", [int64_min] * 4))
+    assert d[1] == 4 * int64_max
+    assert d[2] == 4 * int64_min
+
+
+def test_reduce_sum_buffer_invalid_calls():
+    d = AtomicDict()
+    with raises(TypeError):
+        d.reduce_sum_buffer([1], [1])
+    with raises(TypeError, match="keys"):
+        d.reduce_sum_buffer(array.array("i", [1]), array.array("q", [1]))
+    with raises(TypeError, match="values"):
+        d.reduce_sum_buffer(array.array("q", [1]), array.array("d", [1]))
+    with raises(ValueError, match="len"):
+        d.reduce_sum_buffer(array.array("q", [1, 2]), array.array("q", [1]))
+    assert len(d) == 0
+
+
+def test_reduce_batched():
+    calls = []
+
+    def top_3(key, current, values):
+        calls.append(key)
+        if current is cereggii.NOT_FOUND:
+            current = ()
+        return tuple(sorted([*current, *values], reverse=True)[:3])
+
+    d = AtomicDict()
+    d.reduce_batched([("spam", _) for _ in range(100)] + [("eggs", 1)], top_3)
+    assert d["spam"] == (99, 98, 97)
+    assert d["eggs"] == (1,)
+    assert sorted(calls) == ["eggs", "spam"]
+
+    d.reduce_batched(keys=["spam", "spam"], values=[1000, 0], aggregate_many=top_3)
+    assert d["spam"] == (1000, 99, 98)
+
+
+def test_concurrent_reduce_batched():
+    d = AtomicDict()
+
+    def count(_, current, values):
+        if current is cereggii.NOT_FOUND:
+            return len(values)
+        return current + len(values)
+
+    @TestingThreadSet.repeat(4)
+    def reducers():
+        for _ in range(2**6):
+            d.reduce_batched([(_, None) for _ in range(16)] * 4, count)
+
+    reducers.start_and_join()
+    assert dict(d.fast_iter()) == {_: 4 * 2**6 * 4 for _ in range(16)}
+
+
+def test_reduce_batched_mutating_aggregate():
+    d = AtomicDict({"spam": 0})
+    barrier = threading.Barrier(2)
+
+    def consume(_, current, values):
+        total = 0
+        while values:
+            total += values.pop()
+        if current is cereggii.NOT_FOUND:
+            current = 0
+        return current + total
+
+    @TestingThreadSet.repeat(2)
+    def reducers():
+        barrier.wait()
+        for _ in range(2**8):
+            d.reduce_batched([("spam", 1), ("spam", 2)], consume)
+
+    reducers.start_and_join()
+    assert d["spam"] == 2 * 2**8 * 3
+
+
+def test_reduce_batched_options():
+    calls = []
+
+    def count(key, current, values):
+        calls.append((key, len(values)))
+        if current is cereggii.NOT_FOUND:
+            return len(values)
+        return current + len(values)
+
+    d = AtomicDict()
+    d.reduce_batched(((_ % 2, None) for _ in range(8)), count, max_buffered_keys=2, size_hint=2)
+    assert d[0] == 4
+    assert d[1] == 4
+    assert len(calls) == 8
+
+    d = AtomicDict()
+    d.reduce_batched([[(_ % 4, None) for _ in range(100)]] * 8, count, threads=4)
+    assert dict(d.fast_iter()) == {_: 25 * 8 for _ in range(4)}
+
+    d = AtomicDict()
+    d.reduce_batched(keys=[_ % 4 for _ in range(100)], values=[None] * 100, aggregate_many=count, threads=3)
+    assert dict(d.fast_iter()) == {_: 25 for _ in range(4)}
+
+    d = AtomicDict()
+    d.reduce_batched([("spam", None)] * 10, count, flush_interval=1e-9)
+    assert d["spam"] == 10
+
+    with raises(ValueError):
+        d.reduce_batched([("spam", None)], count, max_buffered_keys=0)
+
+
+def test_reduce_batched_invalid_calls():
+    d = AtomicDict()
+    with raises(TypeError, match="aggregate_many"):
+        d.reduce_batched([("spam", 1)])
+    with raises(TypeError):
+        d.reduce_batched([("spam", 1)], None)
+    with raises(TypeError):
+        d.reduce_batched([1], lambda _, __, values: values)
+    with raises(ZeroDivisionError):
+        d.reduce_batched([("spam", 1)], lambda _, __, ___: 1 / 0)
+    assert len(d) == 0
+
+
 def test_get_handle():
     d = AtomicDict()
     h = d.get_handle()
@@ -1086,6 +2404,25 @@ def test_long_collision_probe_chains():
     assert d._debug()["meta"]["log_size"] > original_size
 
 
+def test_probe_clusters_wrapping_around_the_index():
+    d = AtomicDict()
+    assert d._debug()["meta"]["log_size"] == 7
+    keys = [k for pos in (125, 126, 127) for k in keys_for_hash_for_log_size[7][pos][:8]]
+    absent = keys_for_hash_for_log_size[7][126][8:16]
+    for key in keys:
+        d[key] = key
+    assert d._debug()["meta"]["log_size"] == 7
+    for key in keys[::2]:
+        del d[key]
+    for key in keys[1::2]:
+        assert d[key] == key
+    for key in [*keys[::2], *absent]:
+        assert d.get(key, cereggii.NOT_FOUND) is cereggii.NOT_FOUND
+    assert d.batch_getitem(dict.fromkeys(keys[:6])) == {
+        key: cereggii.NOT_FOUND if i % 2 == 0 else key for i, key in enumerate(keys[:6])
+    }
+
+
 def test_single_referent_after_resize():
     # After resizing, there may be accessor storages still referring to the old
     # metadata generation. The GC should ignore them and not traverse them.
@@ -98,6 +98,34 @@ def test_get_and_increment():
     assert i.get() == 1
 
 
+def test_fetch_add():
+    i = AtomicInt64(0)
+    assert i.fetch_add(2) == 0
+    assert i.fetch_add(None) == 2
+    assert i.fetch_add() == 3
+    assert i.fetch_add(-5) == 4
+    assert i.get() == -1
+    with raises(OverflowError):
+        i.fetch_add(2**63)
+    assert i.get() == -1
+
+    i = AtomicInt64(2**63 - 1)
+    assert i.fetch_add(1) == 2**63 - 1
+    assert i.get() == -(2**63)
+
+
+def test_concurrent_fetch_add():
+    i = AtomicInt64(0)
+
+    @TestingThreadSet.repeat(4)
+    def adders():
+        for _ in range(2**12):
+            i.fetch_add(3)
+
+    adders.start_and_join()
+    assert i.get() == 4 * 3 * 2**12
+
+
 def test_decrement_and_get():
     assert AtomicInt64(0).decrement_and_get(1) == -1
     assert AtomicInt64(0).decrement_and_get(None) == -1